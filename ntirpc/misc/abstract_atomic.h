@@ -2119,6 +2119,32 @@ static inline void atomic_store_voidptr(void **var, void *val)
 }
 #endif
 
+/**
+ * @brief Atomically compare and swap a void *
+ *
+ * This function atomically stores newval in the variable indicated
+ * by the supplied pointer, if it still holds oldval.
+ *
+ * @param[in,out] var    Pointer to the variable to modify
+ * @param[in]     oldval The expected value
+ * @param[in]     newval The value to store
+ *
+ * @return nonzero if the value was stored.
+ */
+
+#ifdef GCC_ATOMIC_FUNCTIONS
+static inline int atomic_cas_voidptr(void **var, void *oldval, void *newval)
+{
+	return __atomic_compare_exchange_n(var, &oldval, newval, 0,
+					   __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+#elif defined(GCC_SYNC_FUNCTIONS)
+static inline int atomic_cas_voidptr(void **var, void *oldval, void *newval)
+{
+	return __sync_bool_compare_and_swap(var, oldval, newval);
+}
+#endif
+
 /**
  * @brief Atomically fetch an int64_t
  *
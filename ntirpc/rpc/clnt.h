@@ -102,6 +102,15 @@ struct rpc_err {
 #define RPC_ERR_FLAGS_NONE             0x0000
 #define RPC_ERR_FLAGS_ASYNC_REPLYFAIL  0x0001
 
+struct rpc_client;
+
+/*
+ * Completion of an asynchronous call, see clnt_call_async().
+ * Called once, with the reply decoded into the caller's results.
+ */
+typedef void (*clnt_call_cb_t) (struct rpc_client *, struct rpc_err *,
+				void *);
+
 /*
  * Client rpc handle.
  * Created by individual implementations
@@ -134,6 +143,13 @@ typedef struct rpc_client {
 
 		/* the ioctl() of rpc */
 		 bool(*cl_control) (struct rpc_client *, u_int, void *);
+
+		/* call remote procedure, complete without waiting */
+		enum clnt_stat (*cl_call_async) (struct rpc_client *, AUTH *,
+						 rpcproc_t, xdrproc_t, void *,
+						 xdrproc_t, void *,
+						 struct timeval,
+						 clnt_call_cb_t, void *);
 	} *cl_ops;
 
 	void *cl_p1;		/* private data */
@@ -217,6 +233,30 @@ struct rpc_timers {
 #define clnt_call(rh, ah, proc, xargs, argsp, xres, resp, secs) \
 	((*(rh)->cl_ops->cl_call)(rh, ah, proc, xargs, argsp, xres, resp, secs))
 
+/*
+ * enum clnt_stat
+ * clnt_call_async(rh, proc, xargs, argsp, xres, resp, timeout, cb, arg)
+ *  (as CLNT_CALL)
+ * clnt_call_cb_t cb;
+ * void *arg;
+ *
+ * Returns as soon as the call is queued.  On RPC_SUCCESS, cb is called
+ * exactly once from a library thread (it should not block), when the
+ * reply is decoded into resp or the timeout expires.  argsp may be
+ * reused on return; resp must remain valid until cb.  Credentials
+ * are not refreshed, the caller may retry on RPC_AUTHERROR.
+ */
+static inline enum clnt_stat
+clnt_call_async(struct rpc_client *rh, AUTH *ah, rpcproc_t proc,
+		xdrproc_t xargs, void *argsp, xdrproc_t xres, void *resp,
+		struct timeval secs, clnt_call_cb_t cb, void *arg)
+{
+	if (!rh->cl_ops->cl_call_async)
+		return (RPC_CANTSEND);
+	return ((*rh->cl_ops->cl_call_async)(rh, ah, proc, xargs, argsp,
+					     xres, resp, secs, cb, arg));
+}
+
 /*
  * void
  * CLNT_ABORT(rh);
@@ -299,6 +339,53 @@ struct rpc_timers {
 #define CLGET_RETRY_TIMEOUT 5	/* get retry timeout (timeval) */
 #define CLSET_ASYNC  19
 #define CLSET_CONNECT  20	/* Use connect() for UDP. (int) */
+#define CLGET_RTT  24		/* retransmit timer (struct clnt_rtt) */
+#define CLSET_RTT_MIN  25	/* floor of retransmit timer (timeval) */
+/*
+ * Connection oriented only
+ */
+#define CLGET_CTX_STATS 21	/* call context pool (struct clnt_ctx_stats) */
+#define CLSET_CORK 22		/* batch calls (struct clnt_cork) */
+#define CLSET_UNCORK 23		/* write batched calls, stop batching */
+
+/*
+ * While corked, encoded calls are held, then written together when there
+ * are calls of them, usecs after the first (0: no deadline), at the next
+ * synchronous call, or at CLSET_UNCORK.
+ */
+struct clnt_cork {
+	uint32_t calls;
+	uint32_t usecs;
+};
+
+/*
+ * Call context pool, per client.  Each call takes a context from the
+ * pool (hit) or allocates one (alloc); on release it goes back, or is
+ * freed (free) when the pool already holds the maximum.
+ */
+struct clnt_ctx_stats {
+	uint64_t hits;
+	uint64_t allocs;
+	uint64_t frees;
+	uint32_t idle;		/* in the pool */
+	uint32_t busy;		/* owned by calls */
+};
+
+/*
+ * Connectionless retransmit timer, per client (destination), in usecs.
+ * A call is first retransmitted after rto, then at doubling intervals up
+ * to the retry timeout.  rto follows the smoothed round trip and its
+ * deviation (srtt + 4 * rttvar), bounded by CLSET_RTT_MIN and the retry
+ * timeout; setting both equal retransmits at a fixed interval.
+ */
+struct clnt_rtt {
+	uint32_t srtt;		/* 0 until a round trip is sampled */
+	uint32_t rttvar;
+	uint32_t rto;
+	uint32_t rto_min;
+	uint64_t calls;
+	uint64_t retransmits;
+};
 
 /*
  * void
@@ -83,6 +83,7 @@ typedef enum xprt_stat (*svc_xprt_xdr_fun_t) (SVCXPRT *, XDR *);
 #define SVC_INIT_EPOLL          0x0002
 #define SVC_INIT_NOREG_XPRTS    0x0008
 #define SVC_INIT_BLKIN          0x0010
+#define SVC_INIT_WORK_STEAL     0x0020	/* per-worker work_pool queues */
 
 #define SVC_SHUTDOWN_FLAG_NONE  0x0000
 
@@ -97,6 +98,18 @@ typedef enum xprt_stat (*svc_xprt_xdr_fun_t) (SVCXPRT *, XDR *);
 #define SVCSET_XP_FLAGS         8
 #define SVCGET_XP_FREE_USER_DATA        15
 #define SVCSET_XP_FREE_USER_DATA        16
+#define SVCGET_ZEROCOPY         17	/* u_int minimum reply bytes */
+#define SVCSET_ZEROCOPY         18	/* 0 disables MSG_ZEROCOPY */
+#define SVCGET_OUTQ             19	/* struct svc_outq_stats */
+
+/* SVCGET_OUTQ, replies waiting for the transport */
+struct svc_outq_stats {
+	uint32_t replies;	/* queued (first may be partially written) */
+	uint32_t bytes;		/* queued */
+	uint32_t max_replies;	/* most ever queued */
+	uint64_t waits;		/* socket was full, waited for output event */
+	uint64_t throttles;	/* input waited for output to drain */
+};
 
 /*
  * Operations for rpc_control().
@@ -123,11 +136,17 @@ typedef struct svc_init_params {
 	u_int gss_max_gc;
 	uint32_t channels;
 	int32_t idle_timeout;
+	u_int max_inline;	/* evchan events handled inline per wakeup */
+	u_int vc_recv_max;	/* svc_vc requests parsed per event */
+	u_int dg_recv_max;	/* svc_dg datagrams per recvmmsg() (>1) */
+	u_int dg_pool_max;	/* svc_dg idle request xprts kept per socket */
+	u_int ioq_queue_max;	/* reply bytes queued before input waits */
 } svc_init_params;
 
 /* Svc param flags */
 #define SVC_FLAG_NONE             0x0000
 #define SVC_FLAG_NOREG_XPRTS      0x0001
+#define SVC_FLAG_WORK_STEAL       0x0002
 
 /*
  * SVCXPRT xp_flags
@@ -136,6 +155,7 @@ typedef struct svc_init_params {
 #define SVC_XPRT_FLAG_NONE		0x0000
 /* uint16_t actually used */
 #define SVC_XPRT_FLAG_ADDED		0x0001
+#define SVC_XPRT_FLAG_PENDING		0x0002	/* (edge) event while not ADDED */
 
 #define SVC_XPRT_FLAG_INITIAL		0x0004
 #define SVC_XPRT_FLAG_INITIALIZED	0x0008
@@ -143,6 +163,7 @@ typedef struct svc_init_params {
 #define SVC_XPRT_FLAG_DESTROYING	0x0020	/* SVC_DESTROY() was called */
 #define SVC_XPRT_FLAG_RELEASING		0x0040	/* (*xp_destroy) was called */
 #define SVC_XPRT_FLAG_UREG		0x0080
+#define SVC_XPRT_FLAG_EDGE		0x0100	/* recv handles edge triggers */
 
 #define SVC_XPRT_FLAG_DESTROYED (SVC_XPRT_FLAG_DESTROYING \
 				| SVC_XPRT_FLAG_RELEASING)
@@ -595,6 +616,32 @@ extern SVCXPRT *svc_tli_ncreate(const int, const struct netconfig *,
  *      const u_int sendsz;             -- max sendsize
  *      const u_int recvsz;             -- max recvsize
  */
+
+/*
+ * Listeners on one address, each its own socket (SO_REUSEPORT) registered
+ * on its own event channel.  The kernel spreads connections (or datagrams)
+ * across them, and accepted connections stay on their listener's channel.
+ */
+struct svc_reuseport {
+	const struct sockaddr *addr;	/* port 0: chosen by the first */
+	socklen_t addrlen;
+	int type;			/* SOCK_STREAM or SOCK_DGRAM */
+	int backlog;			/* SOCK_STREAM, 0 for SOMAXCONN */
+	u_int count;			/* listeners */
+	u_int sendsz;
+	u_int recvsz;
+	uint32_t chan_flags;		/* svc_rqst_new_evchan() flags */
+	const int *cpus;		/* [count] channel cpus (-1 none), or NULL */
+	svc_xprt_fun_t rendezvous_cb;	/* set before each is registered */
+};
+
+extern u_int svc_reuseport_ncreate(const struct svc_reuseport *, SVCXPRT **);
+/*
+ *      const struct svc_reuseport *rp; -- listeners
+ *      SVCXPRT **xprts;                -- OUT [rp->count] listener xprts
+ *
+ * Returns the number created (in order), fewer on failure.
+ */
 __END_DECLS
 
 /*
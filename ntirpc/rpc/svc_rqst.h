@@ -36,6 +36,7 @@
  *
  *  svc_rqst_init -- init module; usually called by svc_init()
  *  svc_rqst_new_evchan -- create event channel
+ *  svc_rqst_new_evchan_cpu -- create event channel, run on a cpu
  *  svc_rqst_evchan_reg -- set {xprt, dispatcher} mapping
  *  svc_rqst_foreach_xprt -- scan registered xprts at id (or 0 for all)
  *  svc_rqst_thrd_signal -- request thread to run a callout function
@@ -53,16 +54,20 @@
 #define SVC_RQST_FLAG_SHUTDOWN		SVC_XPRT_FLAG_DESTROYING
 #define SVC_RQST_FLAG_XPRT_UREG		SVC_XPRT_FLAG_UREG
 #define SVC_RQST_FLAG_CHAN_AFFINITY	0x1000 /* bind conn to parent chan */
-#define SVC_RQST_FLAG_MASK (SVC_RQST_FLAG_CHAN_AFFINITY)
+#define SVC_RQST_FLAG_EDGE		0x2000 /* edge triggered, no rearm */
+#define SVC_RQST_FLAG_MASK (SVC_RQST_FLAG_CHAN_AFFINITY | SVC_RQST_FLAG_EDGE)
 
 /* uint32_t instructions */
 #define SVC_RQST_FLAG_LOCKED		SVC_XPRT_FLAG_LOCKED
 #define SVC_RQST_FLAG_UNLOCK		SVC_XPRT_FLAG_UNLOCK
 #define SVC_RQST_FLAG_EPOLL		0x00080000
+#define SVC_RQST_FLAG_URING		0x00100000 /* when built USE_URING */
 
 void svc_rqst_init(uint32_t);
 int svc_rqst_new_evchan(uint32_t *chan_id /* OUT */ , void *u_data,
 			uint32_t flags);
+int svc_rqst_new_evchan_cpu(uint32_t *chan_id /* OUT */ , void *u_data,
+			    uint32_t flags, int cpu);
 int svc_rqst_evchan_reg(uint32_t chan_id, SVCXPRT *xprt, uint32_t flags);
 
 int svc_rqst_thrd_signal(uint32_t chan_id, uint32_t flags);
@@ -32,6 +32,10 @@
  *
  * This provides simple work queues using pthreads and TAILQ primitives.
  *
+ * With WORK_POOL_FLAG_STEAL, each worker also has its own queue.  Work
+ * submitted by a worker is queued there, and idle workers steal from
+ * the other queues before waiting on the shared queue.
+ *
  * @note    Loosely based upon previous thrdpool by
  *          Matt Benjamin <matt@cohortfs.com>
  */
@@ -44,17 +48,30 @@
 struct work_pool_params {
 	int32_t thrd_max;
 	int32_t thrd_min;
+	uint32_t flags;
 };
 
+/* params flags */
+#define WORK_POOL_FLAG_NONE	0x0000
+#define WORK_POOL_FLAG_STEAL	0x0001	/* per-worker queues, steal idle */
+
 struct work_pool_thread;
 
+struct work_pool_queue {
+	struct poolq_head pqh;
+	struct work_pool_thread *wpt;	/* owner, NULL when unused */
+};
+
 struct work_pool {
 	struct poolq_head pqh;
 	TAILQ_HEAD(work_pool_s, work_pool_thread) wptqh;
+	struct work_pool_queue *wpq;	/* per-worker queues (STEAL) */
 	char *name;
 	pthread_attr_t attr;
 	struct work_pool_params params;
 	uint32_t n_threads;
+	uint32_t n_queues;
+	uint32_t spawning;		/* work_pool_grow() in progress */
 };
 
 struct work_pool_entry;
@@ -66,6 +83,7 @@ struct work_pool_thread {
 
 	struct work_pool *pool;
 	struct work_pool_entry *work;
+	struct work_pool_queue *wpq;	/* own queue (STEAL), may be NULL */
 	pthread_t pt;
 	uint32_t worker_index;
 };
@@ -81,6 +99,8 @@ struct work_pool_entry {
 
 int work_pool_init(struct work_pool *, const char *, struct work_pool_params *);
 int work_pool_submit(struct work_pool *, struct work_pool_entry *);
+int work_pool_submit_shared(struct work_pool *, struct work_pool_entry *);
+int work_pool_submit_batch(struct work_pool *, struct poolq_head_s *);
 int work_pool_shutdown(struct work_pool *);
 
 #endif				/* WORK_POOL_H */
@@ -44,6 +44,7 @@
 #include <sys/cdefs.h>
 #include <misc/stdio.h>
 #include <stdbool.h>
+#include <string.h>
 #if !defined(_WIN32)
 #include <netinet/in.h>
 #endif
@@ -152,6 +153,7 @@ typedef struct xdr_uio {
 #define XDR_FLAG_CKSUM		0x0001
 #define XDR_FLAG_FREE		0x0002
 #define XDR_FLAG_VIO		0x0004
+#define XDR_FLAG_ZEROCOPY	0x0008	/* decode opaques by reference */
 
 /*
  * The XDR handle.
@@ -280,15 +282,45 @@ xdr_putlong(XDR *xdrs, const long *lp)
 #define XDR_GETLONG(xdrs, lp) xdr_getlong(xdrs, lp)
 #define XDR_PUTLONG(xdrs, lp) xdr_putlong(xdrs, lp)
 
-#define XDR_GETBYTES(xdrs, addr, len)   \
-	(*(xdrs)->x_ops->x_getbytes)(xdrs, addr, len)
-#define xdr_getbytes(xdrs, addr, len)			\
-	(*(xdrs)->x_ops->x_getbytes)(xdrs, addr, len)
+/*
+ * Like xdr_getlong() and xdr_putlong(), copy directly when the bytes fit
+ * the current buffer.  len may be a wire (untrusted) count, so compare
+ * against the room left rather than forming x_data + len.
+ */
+static inline bool
+xdr_getbytes(XDR *xdrs, char *addr, u_int len)
+{
+	if (xdrs->x_flags & XDR_FLAG_VIO) {
+		uint8_t *tail = xdrs->x_v.vio_tail;
 
-#define XDR_PUTBYTES(xdrs, addr, len)			\
-	(*(xdrs)->x_ops->x_putbytes)(xdrs, addr, len)
-#define xdr_putbytes(xdrs, addr, len)			\
-	(*(xdrs)->x_ops->x_putbytes)(xdrs, addr, len)
+		if (tail >= xdrs->x_data
+		 && len <= (size_t)(tail - xdrs->x_data)) {
+			memmove(addr, xdrs->x_data, len);
+			xdrs->x_data += len;
+			return (true);
+		}
+	}
+	return (*xdrs->x_ops->x_getbytes)(xdrs, addr, len);
+}
+
+static inline bool
+xdr_putbytes(XDR *xdrs, const char *addr, u_int len)
+{
+	if (xdrs->x_flags & XDR_FLAG_VIO) {
+		uint8_t *wrap = xdrs->x_v.vio_wrap;
+
+		if (wrap >= xdrs->x_data
+		 && len <= (size_t)(wrap - xdrs->x_data)) {
+			memmove(xdrs->x_data, addr, len);
+			xdrs->x_data += len;
+			return (true);
+		}
+	}
+	return (*xdrs->x_ops->x_putbytes)(xdrs, addr, len);
+}
+
+#define XDR_GETBYTES(xdrs, addr, len) xdr_getbytes(xdrs, addr, len)
+#define XDR_PUTBYTES(xdrs, addr, len) xdr_putbytes(xdrs, addr, len)
 
 #define XDR_GETBUFS(xdrs, uio, len, flags)		\
 	(*(xdrs)->x_ops->x_getbufs)(xdrs, uio, len, flags)
@@ -463,6 +495,54 @@ xdr_putint32(XDR *xdrs, int32_t *ip)
 #define XDR_GETINT32(xdrs, int32p) xdr_getint32(xdrs, int32p)
 #define XDR_PUTINT32(xdrs, int32p) xdr_putint32(xdrs, int32p)
 
+/* one bounds check for both halves, most significant first */
+static inline bool
+xdr_getuint64(XDR *xdrs, uint64_t *ip)
+{
+	uint32_t hi, lo;
+
+	if (xdrs->x_flags & XDR_FLAG_VIO) {
+		uint8_t *future = xdrs->x_data + sizeof(uint64_t);
+
+		if (future <= xdrs->x_v.vio_tail) {
+			*ip = ((uint64_t) ntohl(((uint32_t *) xdrs->x_data)[0])
+				<< 32)
+			    | ntohl(((uint32_t *) xdrs->x_data)[1]);
+			xdrs->x_data = future;
+			return (true);
+		}
+	}
+	/* straddles a buffer boundary */
+	if (!xdr_getuint32(xdrs, &hi)
+	 || !xdr_getuint32(xdrs, &lo))
+		return (false);
+	*ip = ((uint64_t) hi << 32) | lo;
+	return (true);
+}
+
+static inline bool
+xdr_putuint64(XDR *xdrs, uint64_t *ip)
+{
+	uint32_t hi = (uint32_t)(*ip >> 32);
+	uint32_t lo = (uint32_t)*ip;
+
+	if (xdrs->x_flags & XDR_FLAG_VIO) {
+		uint8_t *future = xdrs->x_data + sizeof(uint64_t);
+
+		if (future <= xdrs->x_v.vio_wrap) {
+			((uint32_t *) xdrs->x_data)[0] = htonl(hi);
+			((uint32_t *) xdrs->x_data)[1] = htonl(lo);
+			xdrs->x_data = future;
+			return (true);
+		}
+	}
+	return (xdr_putuint32(xdrs, &hi)
+		&& xdr_putuint32(xdrs, &lo));
+}
+
+#define XDR_GETUINT64(xdrs, uint64p) xdr_getuint64(xdrs, uint64p)
+#define XDR_PUTUINT64(xdrs, uint64p) xdr_putuint64(xdrs, uint64p)
+
 static inline bool
 xdr_getuint16(XDR *xdrs, uint16_t *ip)
 {
@@ -614,6 +694,7 @@ xdr_putbool(XDR *xdrs, bool_t boolv)
  */
 __BEGIN_DECLS
 extern XDR xdr_free_null_stream;
+extern XDR xdr_free_zerocopy_stream;
 
 extern bool xdr_void(void);
 extern bool xdr_int(XDR *, int *);
@@ -638,6 +719,11 @@ extern bool xdr_union(XDR *, enum_t *, char *, const struct xdr_discrim *,
 extern bool xdr_char(XDR *, char *);
 extern bool xdr_u_char(XDR *, u_char *);
 extern bool xdr_vector(XDR *, char *, u_int, u_int, xdrproc_t);
+extern bool xdr_array_u32(XDR *, uint32_t **, u_int *, u_int);
+extern bool xdr_array_u64(XDR *, uint64_t **, u_int *, u_int);
+extern bool xdr_vector_u32(XDR *, uint32_t *, u_int);
+extern bool xdr_vector_u64(XDR *, uint64_t *, u_int);
+extern bool xdr_ioq_refer(XDR *, char **, u_int);
 extern bool xdr_float(XDR *, float *);
 extern bool xdr_double(XDR *, double *);
 extern bool xdr_quadruple(XDR *, long double *);
@@ -664,6 +750,16 @@ xdr_nfree(xdrproc_t proc, void *objp)
 	return (*proc) (&xdr_free_null_stream, objp);
 }
 
+/*
+ * Free a data structure decoded with XDR_FLAG_ZEROCOPY.
+ * Opaques referring to the receive buffers are cleared, not freed.
+ */
+static inline bool
+xdr_nfree_zerocopy(xdrproc_t proc, void *objp)
+{
+	return (*proc) (&xdr_free_zerocopy_stream, objp);
+}
+
 /*
  * Common opaque bytes objects used by many rpc protocols;
  * declared here due to commonality.
@@ -68,6 +68,7 @@ inline_xdr_free(xdrproc_t proc, void *objp)
 	XDR x;
 
 	x.x_op = XDR_FREE;
+	x.x_flags = XDR_FLAG_NONE;
 	(*proc) (&x, objp);
 }
 
@@ -431,6 +432,21 @@ xdr_opaque_decode(XDR *xdrs, char *cp, u_int cnt)
 	if (cnt == 0)
 		return (true);
 
+	/*
+	 * data and padding in the current buffer: one bounds check
+	 */
+	if (xdrs->x_flags & XDR_FLAG_VIO) {
+		size_t len = RNDUP((size_t)cnt);
+		uint8_t *tail = xdrs->x_v.vio_tail;
+
+		if (tail >= xdrs->x_data
+		 && len <= (size_t)(tail - xdrs->x_data)) {
+			memcpy(cp, xdrs->x_data, cnt);
+			xdrs->x_data += len;
+			return (true);
+		}
+	}
+
 	/*
 	 * XDR_INLINE is just as likely to do a function call,
 	 * so don't bother with it here.
@@ -478,6 +494,22 @@ xdr_opaque_encode(XDR *xdrs, const char *cp, u_int cnt)
 	if (cnt == 0)
 		return (true);
 
+	/*
+	 * data and zeroed padding in the current buffer
+	 */
+	if (xdrs->x_flags & XDR_FLAG_VIO) {
+		size_t len = RNDUP((size_t)cnt);
+		uint8_t *wrap = xdrs->x_v.vio_wrap;
+
+		if (wrap >= xdrs->x_data
+		 && len <= (size_t)(wrap - xdrs->x_data)) {
+			memcpy(xdrs->x_data, cp, cnt);
+			memset(xdrs->x_data + cnt, 0, len - cnt);
+			xdrs->x_data += len;
+			return (true);
+		}
+	}
+
 	/*
 	 * XDR_INLINE is just as likely to do a function call,
 	 * so don't bother with it here.
@@ -567,10 +599,35 @@ xdr_opaques(XDR *xdrs, char *sp, u_int *sizep, u_int maxsize)
 	return (false);
 }
 
+/*
+ * decode opaque data by reference (XDR_FLAG_ZEROCOPY)
+ * *cpp is left pointing into the stream buffer, without allocating or
+ * copying.  Data straddling xdr_ioq buffers is gathered into a buffer
+ * owned by the stream.  Either way, it is valid until the stream is
+ * destroyed, or longer with xdr_ioq_uv_hold().
+ */
+static inline bool
+xdr_opaque_refer(XDR *xdrs, char **cpp, u_int cnt)
+{
+	if (xdrs->x_flags & XDR_FLAG_VIO) {
+		size_t len = RNDUP((size_t)cnt);
+		uint8_t *tail = xdrs->x_v.vio_tail;
+
+		if (tail >= xdrs->x_data
+		 && len <= (size_t)(tail - xdrs->x_data)) {
+			*cpp = (char *)xdrs->x_data;
+			xdrs->x_data += len;
+			return (true);
+		}
+	}
+	return (xdr_ioq_refer(xdrs, cpp, cnt));
+}
+
 /*
  * XDR counted bytes
  * *cpp is a pointer to the bytes, *sizep is the count.
- * If *cpp is NULL maxsize bytes are allocated
+ * If *cpp is NULL maxsize bytes are allocated, or with XDR_FLAG_ZEROCOPY
+ * *cpp refers to the stream buffer.
  */
 static inline bool
 xdr_bytes_decode(XDR *xdrs, char **cpp, u_int *sizep, u_int maxsize)
@@ -602,6 +659,8 @@ xdr_bytes_decode(XDR *xdrs, char **cpp, u_int *sizep, u_int maxsize)
 	 */
 	if (!size)
 		return (true);
+	if (!sp && (xdrs->x_flags & XDR_FLAG_ZEROCOPY))
+		return (xdr_opaque_refer(xdrs, cpp, size));
 	if (!sp)
 		sp = (char *)mem_alloc(size);
 
@@ -652,6 +711,11 @@ xdr_bytes_encode(XDR *xdrs, char **cpp, u_int *sizep, u_int maxsize)
 static inline bool
 xdr_bytes_free(XDR *xdrs, char **cpp, size_t size)
 {
+	if (xdrs->x_flags & XDR_FLAG_ZEROCOPY) {
+		/* decoded by reference, not allocated */
+		*cpp = NULL;
+		return (true);
+	}
 	if (*cpp) {
 		mem_free(*cpp, size);
 		*cpp = NULL;
@@ -885,23 +949,11 @@ xdr_string(XDR *xdrs, char **cpp, u_int maxsize)
 static inline bool
 inline_xdr_int64_t(XDR *xdrs, int64_t *llp)
 {
-	u_long ul[2];
-
 	switch (xdrs->x_op) {
 	case XDR_ENCODE:
-		ul[0] = (u_long) ((u_int64_t) *llp >> 32) & 0xffffffff;
-		ul[1] = (u_long) ((u_int64_t) *llp) & 0xffffffff;
-		if (XDR_PUTLONG(xdrs, (long *)&ul[0]) == false)
-			return (false);
-		return (XDR_PUTLONG(xdrs, (long *)&ul[1]));
+		return (XDR_PUTUINT64(xdrs, (uint64_t *)llp));
 	case XDR_DECODE:
-		if (XDR_GETLONG(xdrs, (long *)&ul[0]) == false)
-			return (false);
-		if (XDR_GETLONG(xdrs, (long *)&ul[1]) == false)
-			return (false);
-		*llp = (int64_t)
-		    (((u_int64_t) ul[0] << 32) | ((u_int64_t) ul[1]));
-		return (true);
+		return (XDR_GETUINT64(xdrs, (uint64_t *)llp));
 	case XDR_FREE:
 		return (true);
 	}
@@ -915,23 +967,11 @@ inline_xdr_int64_t(XDR *xdrs, int64_t *llp)
 static inline bool
 inline_xdr_u_int64_t(XDR *xdrs, u_int64_t *ullp)
 {
-	u_long ul[2];
-
 	switch (xdrs->x_op) {
 	case XDR_ENCODE:
-		ul[0] = (u_long) (*ullp >> 32) & 0xffffffff;
-		ul[1] = (u_long) (*ullp) & 0xffffffff;
-		if (XDR_PUTLONG(xdrs, (long *)&ul[0]) == false)
-			return (false);
-		return (XDR_PUTLONG(xdrs, (long *)&ul[1]));
+		return (XDR_PUTUINT64(xdrs, ullp));
 	case XDR_DECODE:
-		if (XDR_GETLONG(xdrs, (long *)&ul[0]) == false)
-			return (false);
-		if (XDR_GETLONG(xdrs, (long *)&ul[1]) == false)
-			return (false);
-		*ullp = (u_int64_t)
-		    (((u_int64_t) ul[0] << 32) | ((u_int64_t) ul[1]));
-		return (true);
+		return (XDR_GETUINT64(xdrs, ullp));
 	case XDR_FREE:
 		return (true);
 	}
@@ -87,8 +87,10 @@ struct xdr_ioq {
 
 	struct poolq_head *ioq_pool;
 	struct xdr_ioq_uv_head ioq_uv;	/* header/vectors */
+	struct poolq_head ioq_refer;	/* opaques gathered by xdr_ioq_refer() */
 
 	uint64_t id;
+	uint32_t zc_id;		/* last MSG_ZEROCOPY send (svc_ioq) */
 };
 
 #define _IOQ(p) (opr_containerof((p), struct xdr_ioq, ioq_s))
@@ -99,6 +101,7 @@ struct xdr_ioq {
 /* ioq_s.qflags */
 #define IOQ_FLAG_SEGMENT	0x0100
 #define IOQ_FLAG_WORKING	0x0200	/* (atomic) using ioq_wpe */
+#define IOQ_FLAG_RECORDS	0x0400	/* record marks included */
 /* uint32_t instructions */
 #define IOQ_FLAG_LOCKED		0x00010000
 #define IOQ_FLAG_UNLOCK		0x00020000
@@ -116,6 +119,7 @@ extern struct poolq_entry *xdr_ioq_uv_fetch_nothing(struct xdr_ioq *xioq,
 						     u_int count,
 						     u_int ioq_flags);
 extern void xdr_ioq_uv_release(struct xdr_ioq_uv *uv);
+extern struct xdr_ioq_uv *xdr_ioq_uv_hold(XDR *xdrs, const void *p);
 
 extern struct xdr_ioq *xdr_ioq_create(size_t min_bsize, size_t max_bsize,
 				      u_int uio_flags);
@@ -126,6 +130,17 @@ extern void xdr_ioq_setup(struct xdr_ioq *xioq);
 extern void xdr_ioq_destroy(struct xdr_ioq *xioq, size_t qsize);
 extern void xdr_ioq_destroy_pool(struct poolq_head *ioqh);
 
+struct xdr_ioq_pool_stats {
+	size_t size;		/* buffer size class */
+	uint64_t hits;		/* allocated from a cache */
+	uint64_t misses;	/* allocated by mem_alloc() */
+	uint64_t frees;		/* released by mem_free() (caches full) */
+	uint64_t cached;	/* currently held by caches */
+};
+
+extern u_int xdr_ioq_pool_stats(struct xdr_ioq_pool_stats *stats,
+				u_int count);
+
 extern const struct xdr_ops xdr_ioq_ops;
 
 #endif				/* XDR_IOQ_H */
@@ -37,7 +37,6 @@
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <stdint.h>
-#include <sys/poll.h>
 #include <sys/time.h>
 #include <sys/ioctl.h>
 #include <rpc/clnt.h>
@@ -54,17 +53,12 @@
 #include <unistd.h>
 #include <err.h>
 
-#ifdef IP_RECVERR
-#include <asm/types.h>
-#include <linux/errqueue.h>
-#include <sys/uio.h>
-#endif
-
 #include <rpc/types.h>
 #include <misc/portable.h>
 #include <reentrant.h>
 #include <rpc/rpc.h>
 #include <rpc/svc_rqst.h>
+#include <rpc/xdr_ioq.h>
 #include "rpc_com.h"
 #include "clnt_internal.h"
 #include "svc_internal.h"
@@ -72,7 +66,11 @@
 
 #define MAX_DEFAULT_FDS                 20000
 
+/* floor of the retransmit timer (usecs), until set by CLSET_RTT_MIN */
+#define CLNT_DG_RTO_MIN 100000
+
 static struct clnt_ops *clnt_dg_ops(void);
+static enum xprt_stat clnt_dg_rendezvous(SVCXPRT *);
 static bool time_not_ok(struct timeval *);
 static enum clnt_stat clnt_dg_call(CLIENT *, AUTH *, rpcproc_t, xdrproc_t,
 				   void *, xdrproc_t, void *, struct timeval);
@@ -147,6 +145,7 @@ clnt_dg_ncreatef(const int fd,	/* open file descriptor */
 	cu->cu_async = false;
 	cu->cu_connect = false;
 	cu->cu_connected = false;
+	cu->cu_rto_min = CLNT_DG_RTO_MIN;
 
 	/*
 	 * initialize call message
@@ -182,6 +181,18 @@ clnt_dg_ncreatef(const int fd,	/* open file descriptor */
 #endif
 	ioctl(fd, FIONBIO, (char *)(void *)&one);
 
+	/* replies are received (by xid) on the event channel */
+	rpc_dplx_rli(&su->su_dr);
+	if (!su->su_dr.call_xid)
+		su->su_dr.call_xid = call_msg.rm_xid;
+	if (!xprt->xp_dispatch.rendezvous_cb)
+		xprt->xp_dispatch.rendezvous_cb = clnt_dg_rendezvous;
+	if (!su->su_dr.ev_p)
+		svc_rqst_evchan_reg(__svc_params->ev_u.evchan.id, xprt,
+				    SVC_RQST_FLAG_LOCKED |
+				    SVC_RQST_FLAG_CHAN_AFFINITY);
+	rpc_dplx_rui(&su->su_dr);
+
 	clnt = &cx->cx_c;
 	clnt->cl_ops = clnt_dg_ops();
 
@@ -191,15 +202,120 @@ clnt_dg_ncreatef(const int fd,	/* open file descriptor */
 	return (clnt);
 }
 
+/*
+ * Replies are taken by svc_dg_rendezvous(), a call to this client's
+ * socket is not served.
+ */
 static enum xprt_stat
 clnt_dg_rendezvous(SVCXPRT *xprt)
 {
 	__warnx(TIRPC_DEBUG_FLAG_WARN,
-		"%s: %p fd %d unexpected rendezvous",
+		"%s: %p fd %d unexpected call",
 		__func__, xprt, xprt->xp_fd);
-	return SVC_STAT(xprt);
+	SVC_RELEASE(xprt, SVC_RELEASE_FLAG_NONE);
+	return (XPRT_IDLE);
 }
 
+/*
+ * Encode a call in its own datagram buffer, kept for retransmission.
+ *
+ * cu_outbuf holds the call header, only changed by clnt_dg_control(),
+ * so it is copied without cl_lock (a call racing CLSET_VERS or
+ * CLSET_PROG sends either value).
+ */
+static struct xdr_ioq_uv *
+clnt_dg_encode(struct cu_data *cu, rpc_ctx_t *ctx, rpcproc_t proc,
+	       xdrproc_t xargs, void *argsp, size_t *outlen)
+{
+	struct xdr_ioq_uv *uv = xdr_ioq_uv_create(cu->cu_sendsz,
+						  UIO_FLAG_FREE);
+	u_int32_t *buf = (u_int32_t *)uv->v.vio_head;
+	XDR xdrs[1];
+
+	memcpy(buf, cu->cu_outbuf, cu->cu_xdrpos);
+	buf[0] = htonl(ctx->xid);
+
+	xdrmem_create(xdrs, (char *)buf, cu->cu_sendsz, XDR_ENCODE);
+	XDR_SETPOS(xdrs, cu->cu_xdrpos);
+
+	if ((!XDR_PUTINT32(xdrs, (int32_t *) &proc))
+	    || (!AUTH_MARSHALL(ctx->cc_auth, xdrs))
+	    || (!AUTH_WRAP(ctx->cc_auth, xdrs, xargs, argsp))) {
+		xdr_ioq_uv_release(uv);
+		return (NULL);
+	}
+	*outlen = XDR_GETPOS(xdrs);
+	return (uv);
+}
+
+static inline uint32_t
+tv_to_us(const struct timeval *tv)
+{
+	uint64_t us = (uint64_t)tv->tv_sec * 1000000 + tv->tv_usec;
+
+	return (us < UINT32_MAX ? us : UINT32_MAX);
+}
+
+static inline uint32_t
+ts_to_us(const struct timespec *ts)
+{
+	return (ts->tv_sec * 1000000 + ts->tv_nsec / 1000);
+}
+
+/*
+ * The first retransmit interval of a call: cu_wait until a round trip
+ * has been sampled, then cu_rto, within [cu_rto_min, cu_wait].
+ */
+static uint32_t
+clnt_dg_rto(struct cu_data *cu)
+{
+	uint32_t max = tv_to_us(&cu->cu_wait);
+	uint32_t min = atomic_fetch_uint32_t(&cu->cu_rto_min);
+	uint32_t rto = atomic_fetch_uint32_t(&cu->cu_rto);
+
+	if (!rto || rto > max)
+		rto = max;
+	if (min > max)
+		min = max;
+	return (rto < min ? min : rto);
+}
+
+/*
+ * Jacobson/Karels: fold a round trip into the smoothed estimate and its
+ * mean deviation (gains 1/8 and 1/4), rto = srtt + 4 * rttvar.  Calls
+ * update these without a lock; a lost update only loses one sample.
+ */
+static void
+clnt_dg_rtt(struct cu_data *cu, uint32_t rtt)
+{
+	uint32_t srtt = atomic_fetch_uint32_t(&cu->cu_srtt);
+	uint32_t rttvar = atomic_fetch_uint32_t(&cu->cu_rttvar);
+	uint32_t delta;
+
+	if (!rtt)
+		rtt = 1;
+	if (!srtt) {
+		srtt = rtt;
+		rttvar = rtt / 2;
+	} else {
+		delta = (srtt > rtt) ? srtt - rtt : rtt - srtt;
+		rttvar = rttvar - rttvar / 4 + delta / 4;
+		srtt = srtt - srtt / 8 + rtt / 8;
+	}
+	atomic_store_uint32_t(&cu->cu_srtt, srtt);
+	atomic_store_uint32_t(&cu->cu_rttvar, rttvar);
+	atomic_store_uint32_t(&cu->cu_rto,
+			      (uint64_t)srtt + 4 * (uint64_t)rttvar
+			      < UINT32_MAX ? srtt + 4 * rttvar : UINT32_MAX);
+}
+
+/*
+ * Calls do not hold cl_lock.  Each is encoded into its own buffer,
+ * registered by xid, and waits for svc_dg_rendezvous() to deliver its
+ * reply.  Unanswered, it is retransmitted after clnt_dg_rto(), then at
+ * doubling intervals up to cu_wait.  Many calls may be outstanding on
+ * one socket.
+ */
 static enum clnt_stat
 clnt_dg_call(CLIENT *clnt,	/* client handle */
 	     AUTH *auth,	/* auth handle */
@@ -215,44 +331,44 @@ clnt_dg_call(CLIENT *clnt,	/* client handle */
 	struct cu_data *cu = CU_DATA(cx);
 	struct rpc_dplx_rec *rec = cx->cx_rec;
 	SVCXPRT *xprt = &rec->xprt;
-	XDR *xdrs;
+	struct xdr_ioq_uv *uv;
 	struct sockaddr *sa;
-	struct rpc_msg reply_msg;
-	XDR reply_xdrs;
 	struct timeval timeout;
-	struct pollfd fd;
-	int total_time, nextsend_time, tv = 0;
-	socklen_t __attribute__ ((unused)) inlen, salen;
-	size_t outlen = 0;
-	ssize_t recvlen = 0;
-	int nrefreshes = 2;	/* number of times to refresh cred */
-	int xp_fd = xprt->xp_fd;
-	u_int32_t xid, inval, outval;
-	bool ok;
-	bool slocked = true;
-	bool rlocked = false;
-	bool once = true;
-
-	/* Need lock for cu.
-	 */
-	mutex_lock(&clnt->cl_lock);
+	struct timespec deadline, ts, sent, now;
+	rpc_ctx_t *ctx;
+	socklen_t salen;
+	size_t outlen;
+	enum clnt_stat result;
+	u_int32_t xid;
+	uint32_t interval, sends;
+	int code;
 
 	if (cu->cu_total.tv_usec == -1)
 		timeout = utimeout;	/* use supplied timeout */
 	else
 		timeout = cu->cu_total;	/* use default timeout */
-	total_time = timeout.tv_sec * 1000 + timeout.tv_usec / 1000;
-	nextsend_time = cu->cu_wait.tv_sec * 1000 + cu->cu_wait.tv_usec / 1000;
+
+	if (cu->cu_async == true && xargs == NULL) {
+		/* replies are matched to their own calls, none is left
+		 * over to collect
+		 */
+		cx->cx_error.re_status = RPC_CANTRECV;
+		cx->cx_error.re_errno = 0;
+		return (RPC_CANTRECV);
+	}
 
 	if (cu->cu_connect && !cu->cu_connected) {
-		if (connect
-		    (xp_fd, (struct sockaddr *)&cu->cu_raddr,
-		     cu->cu_rlen) < 0) {
+		mutex_lock(&clnt->cl_lock);
+		if (!cu->cu_connected
+		    && connect(xprt->xp_fd, (struct sockaddr *)&cu->cu_raddr,
+			       cu->cu_rlen) < 0) {
 			cx->cx_error.re_errno = errno;
 			cx->cx_error.re_status = RPC_CANTSEND;
-			goto out;
+			mutex_unlock(&clnt->cl_lock);
+			return (RPC_CANTSEND);
 		}
 		cu->cu_connected = 1;
+		mutex_unlock(&clnt->cl_lock);
 	}
 	if (cu->cu_connected) {
 		sa = NULL;
@@ -262,217 +378,103 @@ clnt_dg_call(CLIENT *clnt,	/* client handle */
 		salen = cu->cu_rlen;
 	}
 
-	/* Clean up in case the last call ended in a longjmp(3) call. */
- call_again:
-	if (!slocked) {
-		slocked = true;
-		mutex_lock(&clnt->cl_lock);
+	ctx = rpc_ctx_alloc(clnt, timeout);
+	if (!ctx) {
+		cx->cx_error.re_status = RPC_TLIERROR;
+		return (RPC_TLIERROR);
 	}
-	xdrs = &(cu->cu_outxdrs);
-	if (cu->cu_async == true && xargs == NULL) {
-		mutex_unlock(&clnt->cl_lock);
-		slocked = false;
-		goto get_reply;
-	}
-	xdrs->x_op = XDR_ENCODE;
-	XDR_SETPOS(xdrs, cu->cu_xdrpos);
-	/*
-	 * the transaction is the first thing in the out buffer
-	 * XXX Yes, and it's in network byte order, so we should to
-	 * be careful when we increment it, shouldn't we.
-	 */
-	xid = ntohl(*(u_int32_t *) (void *)(cu->cu_outbuf));
-	xid++;
-	*(u_int32_t *) (void *)(cu->cu_outbuf) = htonl(xid);
+	ctx->cc_auth = auth;
+	ctx->cc_xdr.proc = xresults;
+	ctx->cc_xdr.where = resultsp;
+	ctx->error.re_status = RPC_SUCCESS;
 
-	if ((!XDR_PUTINT32(xdrs, (int32_t *) &proc))
-	    || (!AUTH_MARSHALL(auth, xdrs))
-	    || (!AUTH_WRAP(auth, xdrs, xargs, argsp))) {
-		cx->cx_error.re_status = RPC_CANTENCODEARGS;
-		goto out;
-	}
-	outlen = (size_t) XDR_GETPOS(xdrs);
-	mutex_unlock(&clnt->cl_lock);
-	slocked = false;
+	(void)clock_gettime(CLOCK_REALTIME, &deadline);
+	timespec_addms(&deadline,
+		       timeout.tv_sec * 1000 + timeout.tv_usec / 1000);
+	atomic_inc_uint64_t(&cu->cu_calls);
 
- send_again:
-	nextsend_time = cu->cu_wait.tv_sec * 1000 + cu->cu_wait.tv_usec / 1000;
-	if (sendto(xp_fd, cu->cu_outbuf, outlen, 0, sa, salen) != outlen) {
-		cx->cx_error.re_errno = errno;
-		cx->cx_error.re_status = RPC_CANTSEND;
+ call_again:
+	xid = ctx->xid;
+	uv = clnt_dg_encode(cu, ctx, proc, xargs, argsp, &outlen);
+	if (!uv) {
+		ctx->error.re_status = RPC_CANTENCODEARGS;
 		goto out;
 	}
+	interval = clnt_dg_rto(cu);
+	sends = 0;
+
+	for (;;) {
+		if (sends++) {
+			/* backoff, kept for following calls until the
+			 * next round trip sample (Karn)
+			 */
+			atomic_inc_uint64_t(&cu->cu_retransmits);
+			interval = (interval < tv_to_us(&cu->cu_wait) / 2)
+				 ? interval * 2 : tv_to_us(&cu->cu_wait);
+			if (interval > atomic_fetch_uint32_t(&cu->cu_rto))
+				atomic_store_uint32_t(&cu->cu_rto, interval);
+		}
+		(void)clock_gettime(CLOCK_MONOTONIC, &sent);
+		if (sendto(xprt->xp_fd, uv->v.vio_head, outlen, 0, sa, salen)
+		    != outlen) {
+			ctx->error.re_errno = errno;
+			ctx->error.re_status = RPC_CANTSEND;
+			break;
+		}
 
- get_reply:
-	/*
-	 * sub-optimal code appears here because we have
-	 * some clock time to spare while the packets are in flight.
-	 * (We assume that this is actually only executed once.)
-	 */
-	rpc_dplx_rli(rec);
-	rlocked = true;
-
-	if (!rec->ev_p) {
-		xprt->xp_dispatch.rendezvous_cb = clnt_dg_rendezvous;
-		svc_rqst_evchan_reg(__svc_params->ev_u.evchan.id, xprt,
-				    SVC_RQST_FLAG_LOCKED |
-				    SVC_RQST_FLAG_CHAN_AFFINITY);
-	}
-	reply_msg.RPCM_ack.ar_verf = _null_auth;
-	reply_msg.RPCM_ack.ar_results.where = NULL;
-	reply_msg.RPCM_ack.ar_results.proc = (xdrproc_t) xdr_void;
-
-	fd.fd = xp_fd;
-	fd.events = POLLIN;
-	fd.revents = 0;
-	while ((total_time > 0) || once) {
-		tv = total_time < nextsend_time ? total_time : nextsend_time;
-		once = false;
-		switch (poll(&fd, 1, tv)) {
-		case 0:
-			total_time -= tv;
-			rpc_dplx_rui(rec);
-			rlocked = false;
-			if (total_time <= 0) {
-				cx->cx_error.re_status = RPC_TIMEDOUT;
-				goto out;
+		/* the reply, or the next retransmit */
+		(void)clock_gettime(CLOCK_REALTIME, &ts);
+		ts.tv_sec += interval / 1000000;
+		ts.tv_nsec += (interval % 1000000) * 1000;
+		if (ts.tv_nsec >= 1000000000) {
+			ts.tv_sec++;
+			ts.tv_nsec -= 1000000000;
+		}
+		if (timespeccmp(&ts, &deadline, >))
+			ts = deadline;
+
+		do {
+			code = cond_timedwait(&ctx->we.cv, &ctx->we.mtx, &ts);
+			if (atomic_fetch_uint16_t(&ctx->flags)
+			    & RPC_CTX_FLAG_ACKSYNC)
+				break;
+		} while (code != ETIMEDOUT);
+
+		if (atomic_fetch_uint16_t(&ctx->flags)
+		    & RPC_CTX_FLAG_ACKSYNC) {
+			/* only an unambiguous round trip is sampled */
+			if (sends == 1 && ctx->xid == xid
+			    && ctx->error.re_status == RPC_SUCCESS) {
+				(void)clock_gettime(CLOCK_MONOTONIC, &now);
+				timespecsub(&now, &sent);
+				clnt_dg_rtt(cu, ts_to_us(&now));
 			}
-			goto send_again;
-		case -1:
-			if (errno == EINTR)
-				continue;
-			cx->cx_error.re_status = RPC_CANTRECV;
-			cx->cx_error.re_errno = errno;
-			goto out;
+			break;
 		}
-		break;
-	}
-#ifdef IP_RECVERR
-	if (fd.revents & POLLERR) {
-		struct msghdr msg;
-		struct cmsghdr *cmsg;
-		struct sock_extended_err *e;
-		struct sockaddr_in err_addr;
-		struct sockaddr_in *sin = (struct sockaddr_in *)&cu->cu_raddr;
-		struct iovec iov;
-		char *cbuf = (char *)alloca(outlen + 256);
-		int ret;
-
-		iov.iov_base = cbuf + 256;
-		iov.iov_len = outlen;
-		msg.msg_name = (void *)&err_addr;
-		msg.msg_namelen = sizeof(err_addr);
-		msg.msg_iov = &iov;
-		msg.msg_iovlen = 1;
-		msg.msg_flags = 0;
-		msg.msg_control = cbuf;
-		msg.msg_controllen = 256;
-		ret = recvmsg(xp_fd, &msg, MSG_ERRQUEUE);
-		if (ret >= 0 && memcmp(cbuf + 256, cu->cu_outbuf, ret) == 0
-		    && (msg.msg_flags & MSG_ERRQUEUE)
-		    && ((msg.msg_namelen == 0 && ret >= 12)
-			|| (msg.msg_namelen == sizeof(err_addr)
-			    && err_addr.sin_family == AF_INET
-			    && memcmp(&err_addr.sin_addr, &sin->sin_addr,
-				      sizeof(err_addr.sin_addr)) == 0
-			    && err_addr.sin_port == sin->sin_port)))
-			for (cmsg = CMSG_FIRSTHDR(&msg); cmsg;
-			     cmsg = CMSG_NXTHDR(&msg, cmsg))
-				if ((cmsg->cmsg_level == SOL_IP)
-				    && (cmsg->cmsg_type == IP_RECVERR)) {
-					e = (struct sock_extended_err *)
-					    CMSG_DATA(cmsg);
-					cx->cx_error.re_errno = e->ee_errno;
-					cx->cx_error.re_status = RPC_CANTRECV;
-				}
-	}
-#endif
 
-	/* We have some data now */
-	do {
-		recvlen =
-		    recvfrom(xp_fd, cu->cu_inbuf, cu->cu_recvsz, 0, NULL,
-			     NULL);
-	} while (recvlen < 0 && errno == EINTR);
-	if (recvlen < 0 && errno != EWOULDBLOCK) {
-		cx->cx_error.re_errno = errno;
-		cx->cx_error.re_status = RPC_CANTRECV;
-		goto out;
-	}
-
-	if (recvlen < sizeof(u_int32_t)) {
-		total_time -= tv;
-		rpc_dplx_rui(rec);
-		rlocked = false;
-		goto send_again;
-	}
-
-	if (cu->cu_async == true)
-		inlen = (socklen_t) recvlen;
-	else {
-		memcpy(&inval, cu->cu_inbuf, sizeof(u_int32_t));
-		memcpy(&outval, cu->cu_outbuf, sizeof(u_int32_t));
-		if (inval != outval) {
-			total_time -= tv;
-			rpc_dplx_rui(rec);
-			rlocked = false;
-			goto send_again;
+		(void)clock_gettime(CLOCK_REALTIME, &ts);
+		if (!timespeccmp(&ts, &deadline, <)) {
+			ctx->error.re_status = RPC_TIMEDOUT;
+			break;
 		}
-		inlen = (socklen_t) recvlen;
 	}
+	xdr_ioq_uv_release(uv);
 
-	/*
-	 * now decode and validate the response
-	 */
-
-	xdrmem_create(&reply_xdrs, cu->cu_inbuf, (u_int) recvlen, XDR_DECODE);
-	ok = xdr_replymsg(&reply_xdrs, &reply_msg);
-	/* XDR_DESTROY(&reply_xdrs); save a few cycles on noop destroy */
-	if (ok) {
-		if ((reply_msg.rm_reply.rp_stat == MSG_ACCEPTED)
-		    && (reply_msg.RPCM_ack.ar_stat == SUCCESS))
-			cx->cx_error.re_status = RPC_SUCCESS;
-		else
-			_seterr_reply(&reply_msg, &(cx->cx_error));
-
-		if (cx->cx_error.re_status == RPC_SUCCESS) {
-			if (!AUTH_VALIDATE
-			    (auth, &reply_msg.RPCM_ack.ar_verf)) {
-				cx->cx_error.re_status = RPC_AUTHERROR;
-				cx->cx_error.re_why = AUTH_INVALIDRESP;
-			} else
-			    if (!AUTH_UNWRAP
-				(auth, &reply_xdrs, xresults, resultsp)) {
-				if (cx->cx_error.re_status == RPC_SUCCESS)
-					cx->cx_error.re_status =
-					    RPC_CANTDECODERES;
-			}
-		}
-		/* end successful completion */
-		/*
-		 * If unsuccesful AND error is an authentication error
-		 * then refresh credentials and try again, else break
-		 */
-		else if (cx->cx_error.re_status == RPC_AUTHERROR)
-			/* maybe our credentials need to be refreshed ... */
-			if (nrefreshes > 0 && AUTH_REFRESH(auth, &reply_msg)) {
-				nrefreshes--;
-				rpc_dplx_rui(rec);
-				rlocked = false;
-				goto call_again;
-			}
-		/* end of unsuccessful completion */
-	} /* end of valid reply message */
-	else
-		cx->cx_error.re_status = RPC_CANTDECODERES;
+	if (ctx->xid != xid) {
+		/* credentials refreshed, registered under a new xid */
+		atomic_clear_uint16_t_bits(&ctx->flags, RPC_CTX_FLAG_ACKSYNC);
+		goto call_again;
+	}
 
-out:
-	if (slocked)
-		mutex_unlock(&clnt->cl_lock);
-	if (rlocked)
-		rpc_dplx_rui(rec);
+ out:
+	result = ctx->error.re_status;
+	cx->cx_error = ctx->error;
+	rpc_ctx_release(ctx);
 
-	return (cx->cx_error.re_status);
+	__warnx(TIRPC_DEBUG_FLAG_CLNT_DG,
+		"%s: fd %d xid %" PRIu32 " result=%d",
+		__func__, xprt->xp_fd, xid, result);
+	return (result);
 }
 
 static void
@@ -486,18 +488,11 @@ clnt_dg_geterr(CLIENT *clnt, struct rpc_err *errp)
 static bool
 clnt_dg_freeres(CLIENT *clnt, xdrproc_t xdr_res, void *res_ptr)
 {
-	struct cx_data *cx = CX_DATA(clnt);
-	struct cu_data *cu = CU_DATA(cx);
-	XDR *xdrs;
-
 	/* XXX guard against illegal invocation from libc (will fix) */
 	if (!xdr_res)
 		return (0);
 
-	xdrs = &(cu->cu_outxdrs);	/* XXX outxdrs? */
-	xdrs->x_op = XDR_FREE;
-
-	return ((*xdr_res)(xdrs, res_ptr));
+	return (xdr_free(xdr_res, res_ptr));
 }
 
 static bool
@@ -598,19 +593,17 @@ clnt_dg_control(CLIENT *clnt, u_int request, void *info)
 		break;
 	case CLGET_XID:
 		/*
-		 * use the knowledge that xid is the
-		 * first element in the call structure *.
-		 * This will get the xid of the PREVIOUS call
+		 * This will get the xid of the PREVIOUS call,
+		 * on any client sharing this socket
 		 */
-		*(u_int32_t *) info =
-		    ntohl(*(u_int32_t *) (void *)cu->cu_outbuf);
+		*(u_int32_t *) info = atomic_fetch_uint32_t(&rec->call_xid);
 		break;
 
 	case CLSET_XID:
 		/* This will set the xid of the NEXT call */
-		*(u_int32_t *) (void *)cu->cu_outbuf =
-		    htonl(*(u_int32_t *) info - 1);
-		/* decrement by 1 as clnt_dg_call() increments once */
+		atomic_store_uint32_t(&rec->call_xid,
+				      *(u_int32_t *) info - 1);
+		/* decrement by 1 as rpc_ctx_insert() increments once */
 		break;
 
 	case CLGET_VERS:
@@ -652,6 +645,27 @@ clnt_dg_control(CLIENT *clnt, u_int request, void *info)
 	case CLSET_CONNECT:
 		cu->cu_connect = *(int *)info;
 		break;
+	case CLGET_RTT:
+		((struct clnt_rtt *)info)->srtt =
+			atomic_fetch_uint32_t(&cu->cu_srtt);
+		((struct clnt_rtt *)info)->rttvar =
+			atomic_fetch_uint32_t(&cu->cu_rttvar);
+		((struct clnt_rtt *)info)->rto = clnt_dg_rto(cu);
+		((struct clnt_rtt *)info)->rto_min =
+			atomic_fetch_uint32_t(&cu->cu_rto_min);
+		((struct clnt_rtt *)info)->calls =
+			atomic_fetch_uint64_t(&cu->cu_calls);
+		((struct clnt_rtt *)info)->retransmits =
+			atomic_fetch_uint64_t(&cu->cu_retransmits);
+		break;
+	case CLSET_RTT_MIN:
+		if (time_not_ok((struct timeval *)info)) {
+			rslt = false;
+			goto unlock;
+		}
+		atomic_store_uint32_t(&cu->cu_rto_min,
+				      tv_to_us((struct timeval *)info));
+		break;
 	default:
 		break;
 	}
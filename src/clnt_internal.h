@@ -37,6 +37,7 @@
 #ifndef _CLNT_INTERNAL_H
 #define _CLNT_INTERNAL_H
 
+#include <rpc/pool_queue.h>
 #include "rpc_dplx_internal.h"
 
 #define MCALL_MSG_SIZE 24
@@ -47,16 +48,24 @@ struct cu_data {
 	XDR cu_outxdrs;
 	struct sockaddr_storage cu_raddr;	/* remote address */
 	int cu_rlen;
-	struct timeval cu_wait;	/* retransmit interval */
+	struct timeval cu_wait;	/* longest retransmit interval */
 	struct timeval cu_total;	/* total time for the call */
-	u_int cu_xdrpos;
+	u_int cu_xdrpos;	/* call header length */
 	u_int cu_sendsz;	/* send size */
 	u_int cu_recvsz;	/* recv size */
 	int cu_async;
 	int cu_connect;		/* Use connect(). */
 	int cu_connected;	/* Have done connect(). */
-	/* formerly, buffers were tacked onto the end */
-	char *cu_inbuf;
+	/* retransmit timer (usecs), estimated from round trips */
+	uint32_t cu_srtt;	/* smoothed round trip, 0 until sampled */
+	uint32_t cu_rttvar;	/* its mean deviation */
+	uint32_t cu_rto;	/* first interval of the next call */
+	uint32_t cu_rto_min;	/* floor of cu_rto */
+	uint64_t cu_calls;
+	uint64_t cu_retransmits;
+	/* call header, copied into each call's own buffer;
+	 * replies are received by the shared svc_dg transport
+	 */
 	char *cu_outbuf;
 };
 
@@ -68,6 +77,16 @@ struct ct_data {
 	} ct_u;
 	u_int ct_mpos;		/* pos after marshal */
 	int ct_rlen;
+	uint32_t ct_sendsz;	/* first call buffer, follows recent calls */
+	struct {
+		struct poolq_head q;	/* encoded calls, qmutex */
+		struct work_pool_entry wpe;	/* deadline */
+		struct timespec deadline;
+		cond_t cv;
+		uint32_t calls;		/* corked when not 0 */
+		uint32_t usecs;
+		bool running;
+	} ct_cork;
 };
 
 #ifdef USE_RPC_RDMA
@@ -87,6 +106,8 @@ struct cx_data {
 	struct rpc_client cx_c;		/**< Transport Independent handle */
 	struct rpc_dplx_rec *cx_rec;	/* unified sync */
 	struct rpc_err cx_error;
+	struct poolq_head cx_ctxq;	/* idle call contexts */
+	struct clnt_ctx_stats cx_ctxs;	/* protected by cx_ctxq.qmutex */
 
 	union {
 		struct cu_data cu;
@@ -101,6 +122,10 @@ struct cx_data {
 #define CT_DATA(cx) (&(cx)->c_u.ct)
 #define CM_DATA(cx) (&(cx)->c_u.cm)
 
+/* rpc_ctx.c */
+void rpc_ctx_pool_destroy(struct cx_data *);
+void rpc_ctx_pool_stats(struct cx_data *, struct clnt_ctx_stats *);
+
 /* compartmentalize a bit */
 static inline struct cx_data *
 alloc_cx_data(enum CX_TYPE type, uint32_t sendsz, uint32_t recvsz)
@@ -109,15 +134,19 @@ alloc_cx_data(enum CX_TYPE type, uint32_t sendsz, uint32_t recvsz)
 
 	mutex_init(&cx->cx_c.cl_lock, NULL);
 	cx->cx_c.cl_refcnt = 1;
+	poolq_head_setup(&cx->cx_ctxq);
 
 	cx->cx_c.cl_type = type;
 	switch (type) {
 	case CX_DG_DATA:
 		cx->c_u.cu.cu_recvsz = recvsz;
 		cx->c_u.cu.cu_sendsz = sendsz;
-		cx->c_u.cu.cu_inbuf = mem_alloc(recvsz);
 		cx->c_u.cu.cu_outbuf = mem_alloc(sendsz);
+		break;
 	case CX_VC_DATA:
+		poolq_head_setup(&cx->c_u.ct.ct_cork.q);
+		cond_init(&cx->c_u.ct.ct_cork.cv, 0, NULL);
+		break;
 	case CX_MSK_DATA:
 		break;
 	default:
@@ -134,6 +163,8 @@ static inline void
 free_cx_data(struct cx_data *cx)
 {
 	mutex_destroy(&cx->cx_c.cl_lock);
+	rpc_ctx_pool_destroy(cx);
+	poolq_head_destroy(&cx->cx_ctxq);
 
 	/* note seemingly pointers to constant ""? */
 	if (cx->cx_c.cl_netid && cx->cx_c.cl_netid[0])
@@ -143,9 +174,12 @@ free_cx_data(struct cx_data *cx)
 
 	switch (cx->cx_c.cl_type) {
 	case CX_DG_DATA:
-		mem_free(cx->c_u.cu.cu_inbuf, cx->c_u.cu.cu_recvsz);
 		mem_free(cx->c_u.cu.cu_outbuf, cx->c_u.cu.cu_sendsz);
+		break;
 	case CX_VC_DATA:
+		poolq_head_destroy(&cx->c_u.ct.ct_cork.q);
+		cond_destroy(&cx->c_u.ct.ct_cork.cv);
+		break;
 	case CX_MSK_DATA:
 		break;
 	default:
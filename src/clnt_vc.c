@@ -75,6 +75,9 @@
 
 static struct clnt_ops *clnt_vc_ops(void);
 
+/* first call buffer, a power of 2 up to RPC_MAXDATA_DEFAULT */
+#define CLNT_VC_SENDSZ_MIN 512
+
 #include "clnt_internal.h"
 #include "svc_internal.h"
 
@@ -171,6 +174,7 @@ clnt_vc_ncreatef(const int fd,	/* open file descriptor */
 	cx = alloc_cx_data(CX_VC_DATA, xd->sx_dr.sendsz, xd->sx_dr.recvsz);
 	cx->cx_rec = &xd->sx_dr;
 	cs = CT_DATA(cx);
+	cs->ct_sendsz = CLNT_VC_SENDSZ_MIN;
 
 	if (sizeof(struct sockaddr_storage) < raddr->len) {
 		__warnx(TIRPC_DEBUG_FLAG_ERROR,
@@ -254,18 +258,219 @@ clnt_vc_process(struct svc_req *req)
 	return SVC_STAT(xprt);
 }
 
+/*
+ * Size the first buffer of the next call after this one.  Grows at once
+ * to fit, and shrinks by half per smaller call, so one large call does
+ * not leave the small ones after it at full size.
+ */
+static inline void
+clnt_vc_sendsz(struct ct_data *cs, uint32_t len)
+{
+	uint32_t size = atomic_fetch_uint32_t(&cs->ct_sendsz);
+	uint32_t want = CLNT_VC_SENDSZ_MIN;
+
+	while (want < len && want < RPC_MAXDATA_DEFAULT)
+		want <<= 1;
+
+	if (want > size)
+		atomic_store_uint32_t(&cs->ct_sendsz, want);
+	else if (want < size)
+		atomic_store_uint32_t(&cs->ct_sendsz, size >> 1);
+}
+
+/*
+ * ct_cork.q.qmutex held
+ */
+static inline void
+clnt_vc_cork_flush(struct cx_data *cx)
+{
+	struct ct_data *cs = CT_DATA(cx);
+
+	svc_ioq_write_batch(&cx->cx_rec->xprt, &cs->ct_cork.q);
+	cond_broadcast(&cs->ct_cork.cv);
+}
+
+/*
+ * Writes the batch at its deadline, while any is held.  CLNT_DESTROY
+ * waits for it.
+ */
+static void
+clnt_vc_cork_task(struct work_pool_entry *wpe)
+{
+	struct cx_data *cx = opr_containerof(wpe, struct cx_data,
+					     c_u.ct.ct_cork.wpe);
+	struct ct_data *cs = CT_DATA(cx);
+	struct timespec ts;
+
+	mutex_lock(&cs->ct_cork.q.qmutex);
+	while (cs->ct_cork.q.qcount) {
+		/* not CLOCK_REALTIME_FAST, deadlines are in usecs */
+		(void)clock_gettime(CLOCK_REALTIME, &ts);
+		if (!timespeccmp(&ts, &cs->ct_cork.deadline, <)) {
+			clnt_vc_cork_flush(cx);
+			break;
+		}
+		/* batch may be written (and another begun) while waiting */
+		ts = cs->ct_cork.deadline;
+		(void)cond_timedwait(&cs->ct_cork.cv, &cs->ct_cork.q.qmutex,
+				     &ts);
+	}
+	cs->ct_cork.running = false;
+	cond_broadcast(&cs->ct_cork.cv);
+	mutex_unlock(&cs->ct_cork.q.qmutex);
+}
+
+/*
+ * Queue an encoded call, or hold it while corked.
+ */
+static void
+clnt_vc_write(CLIENT *clnt, struct xdr_ioq *xioq, bool flush)
+{
+	struct cx_data *cx = CX_DATA(clnt);
+	struct ct_data *cs = CT_DATA(cx);
+	struct timespec ts;
+
+	if (likely(!cs->ct_cork.calls)) {
+		svc_ioq_write_submit(&cx->cx_rec->xprt, xioq);
+		return;
+	}
+
+	mutex_lock(&cs->ct_cork.q.qmutex);
+	if (!cs->ct_cork.calls) {
+		/* uncorked meanwhile */
+		mutex_unlock(&cs->ct_cork.q.qmutex);
+		svc_ioq_write_submit(&cx->cx_rec->xprt, xioq);
+		return;
+	}
+	TAILQ_INSERT_TAIL(&cs->ct_cork.q.qh, &xioq->ioq_s, q);
+	(cs->ct_cork.q.qcount)++;
+
+	if (flush || cs->ct_cork.q.qcount >= cs->ct_cork.calls) {
+		clnt_vc_cork_flush(cx);
+	} else if (cs->ct_cork.q.qcount == 1 && cs->ct_cork.usecs) {
+		(void)clock_gettime(CLOCK_REALTIME, &cs->ct_cork.deadline);
+		ts.tv_sec = cs->ct_cork.usecs / 1000000;
+		ts.tv_nsec = (cs->ct_cork.usecs % 1000000) * 1000;
+		timespecadd(&cs->ct_cork.deadline, &ts);
+
+		if (cs->ct_cork.running) {
+			/* maybe sooner than it waits for */
+			cond_broadcast(&cs->ct_cork.cv);
+		} else {
+			cs->ct_cork.running = true;
+			cs->ct_cork.wpe.fun = clnt_vc_cork_task;
+			work_pool_submit(&svc_work_pool, &cs->ct_cork.wpe);
+		}
+	}
+	mutex_unlock(&cs->ct_cork.q.qmutex);
+}
+
+/*
+ * Needs neither rli nor cl_lock.  When destroying, also waits for the
+ * deadline task.
+ */
+static void
+clnt_vc_cork(CLIENT *clnt, struct clnt_cork *cork, bool destroy)
+{
+	struct ct_data *cs = CT_DATA(CX_DATA(clnt));
+
+	mutex_lock(&cs->ct_cork.q.qmutex);
+	if (cork) {
+		cs->ct_cork.calls = cork->calls;
+		cs->ct_cork.usecs = cork->usecs;
+	} else
+		cs->ct_cork.calls = 0;
+
+	if (!cs->ct_cork.calls || cs->ct_cork.q.qcount >= cs->ct_cork.calls)
+		clnt_vc_cork_flush(CX_DATA(clnt));
+
+	while (destroy && cs->ct_cork.running)
+		cond_wait(&cs->ct_cork.cv, &cs->ct_cork.q.qmutex);
+	mutex_unlock(&cs->ct_cork.q.qmutex);
+}
+
+/*
+ * Encode and queue the call for ctx->xid, and make sure replies are
+ * received.
+ */
 static enum clnt_stat
-clnt_vc_call(CLIENT *clnt, AUTH *auth, rpcproc_t proc,
-	     xdrproc_t xdr_args, void *args_ptr,
-	     xdrproc_t xdr_results, void *results_ptr,
-	     struct timeval timeout)
+clnt_vc_send(CLIENT *clnt, rpc_ctx_t *ctx, rpcproc_t proc,
+	     xdrproc_t xdr_args, void *args_ptr)
 {
 	struct cx_data *cx = CX_DATA(clnt);
 	struct ct_data *cs = CT_DATA(cx);
 	struct rpc_dplx_rec *rec = cx->cx_rec;
 	SVCXPRT *xprt = &rec->xprt;
+	AUTH *auth = ctx->cc_auth;
 	struct xdr_ioq *xioq;
 	XDR *xdrs;
+	int32_t *buf;
+
+	/* XXX Until gss_get_mic and gss_wrap can be replaced with
+	 * iov equivalents, replies with RPCSEC_GSS security must be
+	 * encoded in a contiguous buffer.
+	 *
+	 * Buffers come from the xdr_ioq pool, the first one sized by
+	 * recent calls.  Any further segment is full size.
+	 */
+	xioq = xdr_ioq_create(atomic_fetch_uint32_t(&cs->ct_sendsz),
+			      __svc_params->ioq.send_max + RPC_MAXDATA_DEFAULT,
+			      (auth->ah_cred.oa_flavor == RPCSEC_GSS)
+			      ? UIO_FLAG_REALLOC | UIO_FLAG_FREE
+			      : UIO_FLAG_FREE);
+	xioq->ioq_uv.min_bsize = RPC_MAXDATA_DEFAULT;
+	/* room for the record mark, if written in a batch */
+	xdr_ioq_reset(xioq, BYTES_PER_XDR_UNIT);
+
+	xdrs = xioq->xdrs;
+	ctx->error.re_status = RPC_SUCCESS;
+
+	/* ct_mcallc is read-only here, only clnt_vc_control() changes
+	 * it, so it is copied without cl_lock (a call racing CLSET_VERS
+	 * or CLSET_PROG sends either value).  The xid and procedure are
+	 * stored around it; the first buffer always has room.
+	 */
+	buf = XDR_INLINE(xdrs, cs->ct_mpos + BYTES_PER_XDR_UNIT);
+	if (!buf)
+		goto cantencode;
+	memcpy(buf, cs->ct_u.ct_mcallc, cs->ct_mpos);
+	buf[0] = htonl(ctx->xid);
+	buf[cs->ct_mpos / BYTES_PER_XDR_UNIT] = htonl(proc);
+
+	if ((!AUTH_MARSHALL(auth, xdrs))
+	    || (!AUTH_WRAP(auth, xdrs, xdr_args, args_ptr)))
+		goto cantencode;
+	clnt_vc_sendsz(cs, XDR_GETPOS(xdrs));
+
+	xdrs->x_lib[1] = (void *)xprt;
+	clnt_vc_write(clnt, xioq,
+		      !(atomic_fetch_uint16_t(&ctx->flags)
+			& RPC_CTX_FLAG_ASYNC));
+
+	/* reply */
+	if (!rec->ev_p) {
+		xprt->xp_dispatch.process_cb = clnt_vc_process;
+		svc_rqst_evchan_reg(__svc_params->ev_u.evchan.id, xprt,
+				    SVC_RQST_FLAG_CHAN_AFFINITY);
+	}
+	return (RPC_SUCCESS);
+
+ cantencode:
+	__warnx(TIRPC_DEBUG_FLAG_CLNT_VC,
+		"%s: fd %d failed @ %s:%d",
+		__func__, xprt->xp_fd, __func__, __LINE__);
+	XDR_DESTROY(xdrs);
+	return (RPC_CANTENCODEARGS);
+}
+
+static enum clnt_stat
+clnt_vc_call(CLIENT *clnt, AUTH *auth, rpcproc_t proc,
+	     xdrproc_t xdr_args, void *args_ptr,
+	     xdrproc_t xdr_results, void *results_ptr,
+	     struct timeval timeout)
+{
+	struct cx_data *cx = CX_DATA(clnt);
+	SVCXPRT *xprt = &cx->cx_rec->xprt;
 	rpc_ctx_t *ctx;
 	enum clnt_stat result;
 	int code;
@@ -294,54 +499,16 @@ clnt_vc_call(CLIENT *clnt, AUTH *auth, rpcproc_t proc,
 	ctx->cc_xdr.where = results_ptr;
 
  call_again:
-	/* XXX Until gss_get_mic and gss_wrap can be replaced with
-	 * iov equivalents, replies with RPCSEC_GSS security must be
-	 * encoded in a contiguous buffer.
-	 *
-	 * Nb, we should probably use getpagesize() on Unix.  Need
-	 * an equivalent for Windows.
-	 */
-	xioq = xdr_ioq_create(RPC_MAXDATA_DEFAULT,
-			      __svc_params->ioq.send_max + RPC_MAXDATA_DEFAULT,
-			      (auth->ah_cred.oa_flavor == RPCSEC_GSS)
-			      ? UIO_FLAG_REALLOC | UIO_FLAG_FREE
-			      : UIO_FLAG_FREE);
-
-	xdrs = xioq->xdrs;
-	ctx->error.re_status = RPC_SUCCESS;
-
-	/* Need lock for ct_mcallc.
-	 */
-	mutex_lock(&clnt->cl_lock);
-	cs->ct_u.ct_mcalli = ntohl(ctx->xid);
-
-	if ((!XDR_PUTBYTES(xdrs, cs->ct_u.ct_mcallc, cs->ct_mpos))
-	    || (!XDR_PUTINT32(xdrs, (int32_t *) &proc))
-	    || (!AUTH_MARSHALL(auth, xdrs))
-	    || (!AUTH_WRAP(auth, xdrs, xdr_args, args_ptr))) {
-		/* error case */
-		mutex_unlock(&clnt->cl_lock);
-		__warnx(TIRPC_DEBUG_FLAG_CLNT_VC,
-			"%s: fd %d failed @ %s:%d",
-			__func__, xprt->xp_fd, __func__, __LINE__);
+	result = clnt_vc_send(clnt, ctx, proc, xdr_args, args_ptr);
+	if (result != RPC_SUCCESS) {
 		rpc_ctx_release(ctx);
-		return (RPC_CANTENCODEARGS);
+		return (result);
 	}
-	mutex_unlock(&clnt->cl_lock);
 
-	xdrs->x_lib[1] = (void *)xprt;
-	svc_ioq_write_submit(xprt, xioq);
-
-	/* reply */
-	if (!rec->ev_p) {
-		xprt->xp_dispatch.process_cb = clnt_vc_process;
-		svc_rqst_evchan_reg(__svc_params->ev_u.evchan.id, xprt,
-				    SVC_RQST_FLAG_CHAN_AFFINITY);
-	}
 	code = rpc_ctx_wait_reply(ctx);
 
 	if (ctx->refreshes > 0) {
-		ctx->flags = RPC_CTX_FLAG_NONE;
+		atomic_clear_uint16_t_bits(&ctx->flags, RPC_CTX_FLAG_ACKSYNC);
 		goto call_again;
 	}
 	if (code == ETIMEDOUT) {
@@ -360,6 +527,54 @@ clnt_vc_call(CLIENT *clnt, AUTH *auth, rpcproc_t proc,
 	return (result);
 }
 
+/*
+ * As clnt_vc_call(), but the reply (or timeout) is delivered to cb
+ * instead of a waiting thread.
+ */
+static enum clnt_stat
+clnt_vc_call_async(CLIENT *clnt, AUTH *auth, rpcproc_t proc,
+		   xdrproc_t xdr_args, void *args_ptr,
+		   xdrproc_t xdr_results, void *results_ptr,
+		   struct timeval timeout, clnt_call_cb_t cb, void *cb_arg)
+{
+	struct cx_data *cx = CX_DATA(clnt);
+	SVCXPRT *xprt = &cx->cx_rec->xprt;
+	rpc_ctx_t *ctx;
+	enum clnt_stat result;
+
+	/* released after cb */
+	if (!CLNT_REF(clnt, CLNT_REF_FLAG_NONE))
+		return (RPC_CANTSEND);
+
+	ctx = rpc_ctx_alloc(clnt, timeout);
+	if (!ctx) {
+		CLNT_RELEASE(clnt, CLNT_RELEASE_FLAG_NONE);
+		return (RPC_TLIERROR);
+	}
+
+	ctx->cc_auth = auth;
+	ctx->cc_xdr.proc = xdr_results;
+	ctx->cc_xdr.where = results_ptr;
+	rpc_ctx_async(ctx, cb, cb_arg);
+
+	result = clnt_vc_send(clnt, ctx, proc, xdr_args, args_ptr);
+	if (result != RPC_SUCCESS) {
+		/* never sent, no callback */
+		rpc_ctx_release(ctx);
+		CLNT_RELEASE(clnt, CLNT_RELEASE_FLAG_NONE);
+		return (result);
+	}
+	__warnx(TIRPC_DEBUG_FLAG_CLNT_VC,
+		"%s: fd %d xid %" PRIu32,
+		__func__, xprt->xp_fd, ctx->xid);
+
+	rpc_ctx_async_start(ctx);
+
+	/* ctx may be completed from here */
+	mutex_unlock(&ctx->we.mtx);
+	return (RPC_SUCCESS);
+}
+
 static void
 clnt_vc_geterr(CLIENT *clnt, struct rpc_err *errp)
 {
@@ -396,6 +611,19 @@ clnt_vc_control(CLIENT *clnt, u_int request, void *info)
 	struct netbuf *addr;
 	bool rslt = true;
 
+	switch (request) {
+	case CLSET_CORK:
+		if (!info)
+			return (false);
+		clnt_vc_cork(clnt, (struct clnt_cork *)info, false);
+		return (true);
+	case CLSET_UNCORK:
+		clnt_vc_cork(clnt, NULL, false);
+		return (true);
+	default:
+		break;
+	}
+
 	/* always take recv lock first if taking together */
 	rpc_dplx_rli(rec);
 	mutex_lock(&clnt->cl_lock);
@@ -432,6 +660,9 @@ clnt_vc_control(CLIENT *clnt, u_int request, void *info)
 	case CLGET_FD:
 		*(int *)info = rec->xprt.xp_fd;
 		break;
+	case CLGET_CTX_STATS:
+		rpc_ctx_pool_stats(cx, (struct clnt_ctx_stats *)info);
+		break;
 	case CLGET_SVC_ADDR:
 		/* The caller should not free this memory area */
 		addr = (struct netbuf *)info;
@@ -443,19 +674,14 @@ clnt_vc_control(CLIENT *clnt, u_int request, void *info)
 		rslt = false;
 		goto unlock;
 	case CLGET_XID:
-		/*
-		 * use the knowledge that xid is the
-		 * first element in the call structure
-		 * This will get the xid of the PREVIOUS call
-		 */
-		*(u_int32_t *) info =
-		    ntohl(*(u_int32_t *) (void *)&cs->ct_u.ct_mcalli);
+		/* This will get the xid of the PREVIOUS call */
+		*(u_int32_t *) info = atomic_fetch_uint32_t(&rec->call_xid);
 		break;
 	case CLSET_XID:
 		/* This will set the xid of the NEXT call */
-		*(u_int32_t *) (void *)&cs->ct_u.ct_mcalli =
-		    htonl(*((u_int32_t *) info) + 1);
-		/* increment by 1 as clnt_vc_call() decrements once */
+		atomic_store_uint32_t(&rec->call_xid,
+				      *((u_int32_t *) info) - 1);
+		/* decrement by 1 as rpc_ctx_insert() increments once */
 		break;
 	case CLGET_VERS:
 		/*
@@ -566,6 +792,9 @@ clnt_vc_destroy(CLIENT *clnt)
 {
 	uint32_t cl_refcnt;
 
+	/* held calls are written, while the reference is ours */
+	clnt_vc_cork(clnt, NULL, true);
+
 	mutex_lock(&clnt->cl_lock);
 	if (clnt->cl_flags & CLNT_FLAG_DESTROYED) {
 		mutex_unlock(&clnt->cl_lock);
@@ -610,6 +839,7 @@ clnt_vc_ops(void)
 		ops.cl_release = clnt_vc_release;
 		ops.cl_destroy = clnt_vc_destroy;
 		ops.cl_control = clnt_vc_control;
+		ops.cl_call_async = clnt_vc_call_async;
 	}
 	mutex_unlock(&ops_lock);
 	thr_sigsetmask(SIG_SETMASK, &(mask), NULL);
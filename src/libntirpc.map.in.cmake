@@ -154,7 +154,9 @@ NTIRPC_${NTIRPC_VERSION} {
     svc_raw_ncreate;
     svc_reg;
     svc_register;
+    svc_reuseport_ncreate;
     svc_rqst_new_evchan;
+    svc_rqst_new_evchan_cpu;
     svc_rqst_evchan_reg;
     svc_rqst_evchan_unreg;
     svc_rqst_shutdown;
@@ -200,6 +202,8 @@ NTIRPC_${NTIRPC_VERSION} {
 
     # x*
     xdr_array;
+    xdr_array_u32;
+    xdr_array_u64;
     xdr_authunix_parms;
     xdr_bool;
     xdr_call_decode;
@@ -211,12 +215,17 @@ NTIRPC_${NTIRPC_VERSION} {
     xdr_enum;
     xdr_float;
     xdr_free_null_stream;
+    xdr_free_zerocopy_stream;
     xdr_hyper;
     xdr_int;
     xdr_int8_t;
     xdr_int16_t;
     xdr_int32_t;
     xdr_int64_t;
+    xdr_ioq_pool_stats;
+    xdr_ioq_refer;
+    xdr_ioq_uv_hold;
+    xdr_ioq_uv_release;
     xdr_long;
     xdr_longlong_t;
     xdr_naccepted_reply;
@@ -269,6 +278,8 @@ NTIRPC_${NTIRPC_VERSION} {
     xdr_uint64_t;
     xdr_union;
     xdr_vector;
+    xdr_vector_u32;
+    xdr_vector_u64;
     xdr_void;
     xdr_wrapstring;
     xdrmem_ncreate;
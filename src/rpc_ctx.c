@@ -32,6 +32,7 @@
 #include <err.h>
 #endif
 #include <errno.h>
+#include <sched.h>
 #include <rpc/types.h>
 #include <reentrant.h>
 #include <misc/portable.h>
@@ -44,9 +45,303 @@
 #include "clnt_internal.h"
 #include "rpc_dplx_internal.h"
 #include "rpc_ctx.h"
+#include "svc_internal.h"
 
 #define tv_to_ms(tv) (1000 * ((tv)->tv_sec) + (tv)->tv_usec/1000)
 
+/*
+ * Async call timeouts, ordered by deadline.  The event channels wait no
+ * longer than the earliest one (rpc_ctx_expire_tick), and whichever
+ * comes first takes the timed out calls.  A task completes them, and
+ * exits when none remain.
+ */
+static struct rpc_ctx_expire_s {
+	TAILQ_HEAD(rpc_ctx_expire_q, rpc_ctx_s) q;
+	struct rpc_ctx_expire_q expired;	/* for rpc_ctx_expire_task */
+	mutex_t mtx;
+	struct work_pool_entry wpe;
+	int64_t due;		/* (atomic) first deadline in ms, 0 when none */
+	bool running;		/* rpc_ctx_expire_task submitted */
+} rpc_ctx_expire = {
+	.q = TAILQ_HEAD_INITIALIZER(rpc_ctx_expire.q),
+	.expired = TAILQ_HEAD_INITIALIZER(rpc_ctx_expire.expired),
+	.mtx = MUTEX_INITIALIZER,
+};
+
+/*
+ * Outstanding calls are found by xid in rec->calls.slot, an xid-indexed
+ * ring.  Slots are updated with compare and swap.  A reply takes its
+ * call out of the ring (the owner's removal then fails), while checking
+ * the xid with the low pointer bit set, so the owner cannot free it.
+ */
+#define RPC_CTX_SLOT_BUSY	((uintptr_t)1)
+#define RPC_CTX_PROBES		8
+
+static inline void **
+rpc_ctx_slot(struct rpc_dplx_rec *rec, uint32_t xid)
+{
+	return (&rec->calls.slot[xid & rec->calls.mask]);
+}
+
+/*
+ * Register ctx under a new xid.  Xids are sequential, so a slot is only
+ * held by a call outstanding for a full turn of the ring; skip that xid.
+ * If there are many, spill to call_replies.
+ */
+static bool
+rpc_ctx_insert(struct rpc_dplx_rec *rec, rpc_ctx_t *ctx)
+{
+	struct opr_rbtree_node *nv;
+	int probes;
+
+	if (unlikely(!atomic_fetch_voidptr((void **)&rec->calls.slot))) {
+		void **slot = mem_zalloc(RPC_DPLX_CALL_SLOTS * sizeof(void *));
+
+		rpc_dplx_rli(rec);
+		if (!rec->calls.slot) {
+			rec->calls.mask = RPC_DPLX_CALL_SLOTS - 1;
+			atomic_store_voidptr((void **)&rec->calls.slot, slot);
+			slot = NULL;
+		}
+		rpc_dplx_rui(rec);
+		if (slot)
+			mem_free(slot, RPC_DPLX_CALL_SLOTS * sizeof(void *));
+	}
+
+	for (probes = 0; probes < RPC_CTX_PROBES; probes++) {
+		ctx->xid = atomic_inc_uint32_t(&rec->call_xid);
+		if (atomic_cas_voidptr(rpc_ctx_slot(rec, ctx->xid), NULL, ctx))
+			return (true);
+	}
+
+	rpc_dplx_rli(rec);
+	nv = opr_rbtree_insert(&rec->call_replies, &ctx->node_k);
+	if (!nv) {
+		atomic_set_uint16_t_bits(&ctx->flags, RPC_CTX_FLAG_SPILLED);
+		rec->calls.spilled++;
+	}
+	rpc_dplx_rui(rec);
+	return (!nv);
+}
+
+/*
+ * Unregister ctx.  Returns false when a reply (or the timer) took it.
+ */
+static bool
+rpc_ctx_remove(struct rpc_dplx_rec *rec, rpc_ctx_t *ctx)
+{
+	void *busy = (void *)((uintptr_t)ctx | RPC_CTX_SLOT_BUSY);
+	void **slot;
+	void *v;
+	bool removed = false;
+
+	if (atomic_fetch_uint16_t(&ctx->flags) & RPC_CTX_FLAG_SPILLED) {
+		rpc_dplx_rli(rec);
+		if (atomic_postclear_uint16_t_bits(&ctx->flags,
+						   RPC_CTX_FLAG_SPILLED)
+		    & RPC_CTX_FLAG_SPILLED) {
+			opr_rbtree_remove(&rec->call_replies, &ctx->node_k);
+			rec->calls.spilled--;
+			removed = true;
+		}
+		rpc_dplx_rui(rec);
+		return (removed);
+	}
+
+	slot = rpc_ctx_slot(rec, ctx->xid);
+	for (;;) {
+		if (atomic_cas_voidptr(slot, ctx, NULL))
+			return (true);
+		v = atomic_fetch_voidptr(slot);
+		if (v != ctx && v != busy)
+			return (false);
+		/* a reply is checking its xid, only a few instructions */
+		sched_yield();
+	}
+}
+
+/*
+ * The call was sent to addr (NULL when not known).
+ */
+static inline bool
+rpc_ctx_peer(rpc_ctx_t *ctx, const struct sockaddr *addr)
+{
+	const struct sockaddr *raddr;
+
+	if (!addr)
+		return (true);
+
+	raddr = (const struct sockaddr *)
+		&CX_DATA(ctx->ctx_u.clnt.clnt)->c_u.cu.cu_raddr;
+	if (raddr->sa_family != addr->sa_family)
+		return (false);
+
+	switch (addr->sa_family) {
+	case AF_INET:
+	{
+		const struct sockaddr_in *a = (const struct sockaddr_in *)addr;
+		const struct sockaddr_in *r = (const struct sockaddr_in *)raddr;
+
+		return (a->sin_port == r->sin_port
+			&& a->sin_addr.s_addr == r->sin_addr.s_addr);
+	}
+	case AF_INET6:
+	{
+		const struct sockaddr_in6 *a =
+			(const struct sockaddr_in6 *)addr;
+		const struct sockaddr_in6 *r =
+			(const struct sockaddr_in6 *)raddr;
+
+		return (a->sin6_port == r->sin6_port
+			&& !memcmp(&a->sin6_addr, &r->sin6_addr,
+				   sizeof(a->sin6_addr)));
+	}
+	default:
+		return (false);
+	}
+}
+
+/*
+ * Take the call for xid (sent to addr, when given) out of the table,
+ * or NULL.
+ */
+static rpc_ctx_t *
+rpc_ctx_take(struct rpc_dplx_rec *rec, uint32_t xid,
+	     const struct sockaddr *addr)
+{
+	struct opr_rbtree_node *nv;
+	rpc_ctx_t ctx_k, *ctx;
+	void **slot;
+	void *v;
+
+	if (!atomic_fetch_voidptr((void **)&rec->calls.slot))
+		return (NULL);
+
+	slot = rpc_ctx_slot(rec, xid);
+	while ((v = atomic_fetch_voidptr(slot))) {
+		if ((uintptr_t)v & RPC_CTX_SLOT_BUSY) {
+			sched_yield();
+			continue;
+		}
+		if (!atomic_cas_voidptr(slot, v,
+				(void *)((uintptr_t)v | RPC_CTX_SLOT_BUSY)))
+			continue;
+
+		ctx = (rpc_ctx_t *)v;
+		if (ctx->xid == xid && rpc_ctx_peer(ctx, addr)) {
+			atomic_store_voidptr(slot, NULL);
+			return (ctx);
+		}
+		/* same slot, another call */
+		atomic_store_voidptr(slot, v);
+		break;
+	}
+
+	if (!atomic_fetch_uint32_t(&rec->calls.spilled))
+		return (NULL);
+
+	rpc_dplx_rli(rec);
+	ctx_k.xid = xid;
+	nv = opr_rbtree_lookup(&rec->call_replies, &ctx_k.node_k);
+	if (nv && rpc_ctx_peer(opr_containerof(nv, rpc_ctx_t, node_k), addr)) {
+		ctx = opr_containerof(nv, rpc_ctx_t, node_k);
+		opr_rbtree_remove(&rec->call_replies, &ctx->node_k);
+		atomic_clear_uint16_t_bits(&ctx->flags, RPC_CTX_FLAG_SPILLED);
+		rec->calls.spilled--;
+	} else
+		ctx = NULL;
+	rpc_dplx_rui(rec);
+	return (ctx);
+}
+
+/*
+ * Contexts are pooled per client with their wait entry initialized, so
+ * a steady stream of calls allocates nothing.  Pooled memory is never
+ * handed to another type, so a reader pinning a stale slot still sees
+ * an rpc_ctx_t.
+ */
+static rpc_ctx_t *
+rpc_ctx_get(struct cx_data *cx)
+{
+	struct poolq_entry *have;
+	rpc_ctx_t *ctx;
+
+	pthread_mutex_lock(&cx->cx_ctxq.qmutex);
+	have = TAILQ_FIRST(&cx->cx_ctxq.qh);
+	if (have) {
+		TAILQ_REMOVE(&cx->cx_ctxq.qh, have, q);
+		cx->cx_ctxq.qcount--;
+		cx->cx_ctxs.hits++;
+	} else
+		cx->cx_ctxs.allocs++;
+	cx->cx_ctxs.busy++;
+	pthread_mutex_unlock(&cx->cx_ctxq.qmutex);
+
+	if (have)
+		return (opr_containerof(have, rpc_ctx_t, ctxq));
+
+	ctx = mem_alloc(sizeof(rpc_ctx_t));
+	mutex_init(&ctx->we.mtx, NULL);
+	cond_init(&ctx->we.cv, 0, NULL);
+	return (ctx);
+}
+
+static void
+rpc_ctx_destroy(rpc_ctx_t *ctx)
+{
+	mutex_destroy(&ctx->we.mtx);
+	cond_destroy(&ctx->we.cv);
+	mem_free(ctx, sizeof(*ctx));
+}
+
+static void
+rpc_ctx_free(rpc_ctx_t *ctx)
+{
+	struct cx_data *cx = CX_DATA(ctx->ctx_u.clnt.clnt);
+	bool keep;
+
+	mutex_unlock(&ctx->we.mtx);
+
+	pthread_mutex_lock(&cx->cx_ctxq.qmutex);
+	cx->cx_ctxs.busy--;
+	keep = cx->cx_ctxq.qcount < RPC_CTX_POOL_MAX;
+	if (keep) {
+		/* LIFO, the last one is still warm */
+		TAILQ_INSERT_HEAD(&cx->cx_ctxq.qh, &ctx->ctxq, q);
+		cx->cx_ctxq.qcount++;
+	} else
+		cx->cx_ctxs.frees++;
+	pthread_mutex_unlock(&cx->cx_ctxq.qmutex);
+
+	if (!keep)
+		rpc_ctx_destroy(ctx);
+}
+
+/*
+ * Called from free_cx_data(); every call has released its context,
+ * async calls holding a client reference until then.
+ */
+void
+rpc_ctx_pool_destroy(struct cx_data *cx)
+{
+	struct poolq_entry *have;
+
+	while ((have = TAILQ_FIRST(&cx->cx_ctxq.qh))) {
+		TAILQ_REMOVE(&cx->cx_ctxq.qh, have, q);
+		cx->cx_ctxq.qcount--;
+		rpc_ctx_destroy(opr_containerof(have, rpc_ctx_t, ctxq));
+	}
+}
+
+void
+rpc_ctx_pool_stats(struct cx_data *cx, struct clnt_ctx_stats *stats)
+{
+	pthread_mutex_lock(&cx->cx_ctxq.qmutex);
+	*stats = cx->cx_ctxs;
+	stats->idle = cx->cx_ctxq.qcount;
+	pthread_mutex_unlock(&cx->cx_ctxq.qmutex);
+}
+
 int
 call_xid_cmpf(const struct opr_rbtree_node *lhs,
 	      const struct opr_rbtree_node *rhs)
@@ -73,15 +368,12 @@ rpc_ctx_alloc(CLIENT *clnt, struct timeval timeout)
 {
 	struct cx_data *cx = CX_DATA(clnt);
 	struct rpc_dplx_rec *rec = cx->cx_rec;
-	rpc_ctx_t *ctx = mem_alloc(sizeof(rpc_ctx_t));
-	struct opr_rbtree_node *nv;
+	rpc_ctx_t *ctx = rpc_ctx_get(cx);
 
 	rpc_msg_init(&ctx->cc_msg);
 
 	/* protects this */
-	mutex_init(&ctx->we.mtx, NULL);
 	mutex_lock(&ctx->we.mtx);
-	cond_init(&ctx->we.cv, 0, NULL);
 	ctx->flags = RPC_CTX_FLAG_NONE;
 	ctx->refcount = 1;
 	ctx->refreshes = 2;
@@ -93,21 +385,259 @@ rpc_ctx_alloc(CLIENT *clnt, struct timeval timeout)
 	ctx->ctx_u.clnt.timeout.tv_nsec = 0;
 	timespec_addms(&ctx->ctx_u.clnt.timeout, tv_to_ms(&timeout));
 
-	/* this lock protects both xid and rbtree */
-	rpc_dplx_rli(rec);
-	ctx->xid = ++(rec->call_xid);
-	nv = opr_rbtree_insert(&rec->call_replies, &ctx->node_k);
-	rpc_dplx_rui(rec);
-	if (nv) {
+	if (!rpc_ctx_insert(rec, ctx)) {
 		__warnx(TIRPC_DEBUG_FLAG_ERROR,
 			"%s: %p fd %d call ctx insert failed xid %" PRIu32,
 			__func__, &rec->xprt, rec->xprt.xp_fd, ctx->xid);
-		rpc_ctx_release(ctx);
+		rpc_ctx_free(ctx);
 		return (NULL);
 	}
 	return (ctx);
 }
 
+/*
+ * Claim an async call for the timer; lost if the reply got there first.
+ *
+ * rpc_ctx_expire.mtx held
+ */
+static bool
+rpc_ctx_claim(rpc_ctx_t *ctx)
+{
+	struct rpc_dplx_rec *rec = CX_DATA(ctx->ctx_u.clnt.clnt)->cx_rec;
+
+	if (!rpc_ctx_remove(rec, ctx))
+		return (false);
+
+	atomic_set_uint16_t_bits(&ctx->flags, RPC_CTX_FLAG_COMPLETE);
+	return (true);
+}
+
+/*
+ * Deliver a claimed async call, then release it and the client
+ * reference taken by the caller.
+ */
+static void
+rpc_ctx_complete(rpc_ctx_t *ctx)
+{
+	CLIENT *clnt = ctx->ctx_u.clnt.clnt;
+
+	mutex_lock(&rpc_ctx_expire.mtx);
+	if (atomic_fetch_uint16_t(&ctx->flags) & RPC_CTX_FLAG_EXPIRE) {
+		TAILQ_REMOVE(&rpc_ctx_expire.q, ctx, expq);
+		atomic_clear_uint16_t_bits(&ctx->flags, RPC_CTX_FLAG_EXPIRE);
+	}
+	mutex_unlock(&rpc_ctx_expire.mtx);
+
+	/* the caller holds this until the call is submitted */
+	mutex_lock(&ctx->we.mtx);
+
+	__warnx(TIRPC_DEBUG_FLAG_RPC_CTX,
+		"%s: %p xid %" PRIu32 " status %d",
+		__func__, clnt, ctx->xid, ctx->error.re_status);
+
+	ctx->ctx_u.clnt.cb(clnt, &ctx->error, ctx->ctx_u.clnt.cb_arg);
+	rpc_ctx_release(ctx);
+	CLNT_RELEASE(clnt, CLNT_RELEASE_FLAG_NONE);
+}
+
+/*
+ * Take timed out calls (or all, for NULL now) from the queue.
+ *
+ * rpc_ctx_expire.mtx held; returns the next to time out
+ */
+static rpc_ctx_t *
+rpc_ctx_expire_take(struct timespec *now, struct rpc_ctx_expire_q *expired)
+{
+	rpc_ctx_t *ctx;
+
+	while ((ctx = TAILQ_FIRST(&rpc_ctx_expire.q))) {
+		if (now && timespeccmp(&ctx->ctx_u.clnt.deadline, now, >))
+			break;
+		TAILQ_REMOVE(&rpc_ctx_expire.q, ctx, expq);
+		atomic_clear_uint16_t_bits(&ctx->flags, RPC_CTX_FLAG_EXPIRE);
+		if (rpc_ctx_claim(ctx))
+			TAILQ_INSERT_TAIL(expired, ctx, expq);
+	}
+	return (ctx);
+}
+
+static void
+rpc_ctx_expire_done(struct rpc_ctx_expire_q *expired)
+{
+	rpc_ctx_t *ctx;
+
+	while ((ctx = TAILQ_FIRST(expired))) {
+		TAILQ_REMOVE(expired, ctx, expq);
+		ctx->error.re_status = RPC_TIMEDOUT;
+		rpc_ctx_complete(ctx);
+	}
+}
+
+static void
+rpc_ctx_expire_task(struct work_pool_entry *wpe)
+{
+	struct rpc_ctx_expire_q expired = TAILQ_HEAD_INITIALIZER(expired);
+
+	mutex_lock(&rpc_ctx_expire.mtx);
+	while (!TAILQ_EMPTY(&rpc_ctx_expire.expired)) {
+		TAILQ_CONCAT(&expired, &rpc_ctx_expire.expired, expq);
+		mutex_unlock(&rpc_ctx_expire.mtx);
+		rpc_ctx_expire_done(&expired);
+		mutex_lock(&rpc_ctx_expire.mtx);
+	}
+	rpc_ctx_expire.running = false;
+	mutex_unlock(&rpc_ctx_expire.mtx);
+}
+
+static inline int64_t
+rpc_ctx_expire_ms(struct timespec *ts)
+{
+	return ((int64_t)ts->tv_sec * 1000 + ts->tv_nsec / 1000000);
+}
+
+/*
+ * rpc_ctx_expire.mtx held
+ */
+static inline void
+rpc_ctx_expire_set_due(rpc_ctx_t *first)
+{
+	/* rounded up, so the first has timed out at due */
+	atomic_store_int64_t(&rpc_ctx_expire.due, first
+			     ? rpc_ctx_expire_ms(&first->ctx_u.clnt.deadline)
+			       + 1 : 0);
+}
+
+/*
+ * not locked
+ *
+ * Called by each event channel before waiting.  Takes the calls that
+ * timed out (whichever channel comes first), and returns milliseconds
+ * until the next deadline, or -1 for none.
+ */
+int
+rpc_ctx_expire_tick(void)
+{
+	struct timespec ts;
+	int64_t due = atomic_fetch_int64_t(&rpc_ctx_expire.due);
+	int64_t now;
+
+	if (!due)
+		return (-1);
+
+	(void)clock_gettime(CLOCK_MONOTONIC_FAST, &ts);
+	now = rpc_ctx_expire_ms(&ts);
+	if (now >= due && !mutex_trylock(&rpc_ctx_expire.mtx)) {
+		rpc_ctx_expire_set_due(rpc_ctx_expire_take(&ts,
+						&rpc_ctx_expire.expired));
+
+		if (!TAILQ_EMPTY(&rpc_ctx_expire.expired)
+		 && !rpc_ctx_expire.running) {
+			rpc_ctx_expire.running = true;
+			rpc_ctx_expire.wpe.fun = rpc_ctx_expire_task;
+			work_pool_submit(&svc_work_pool, &rpc_ctx_expire.wpe);
+		}
+		due = rpc_ctx_expire.due;
+		mutex_unlock(&rpc_ctx_expire.mtx);
+
+		if (!due)
+			return (-1);
+	}
+
+	/* another channel may be expiring, then look again soon */
+	return ((int)MAX(1, MIN(due - now, INT32_MAX)));
+}
+
+/*
+ * RPC_CTX_FLAG_LOCKED
+ *
+ * Make the call async before it is sent.  Refreshes are not retried.
+ */
+void
+rpc_ctx_async(rpc_ctx_t *ctx, clnt_call_cb_t cb, void *cb_arg)
+{
+	ctx->ctx_u.clnt.cb = cb;
+	ctx->ctx_u.clnt.cb_arg = cb_arg;
+	ctx->refreshes = 0;
+	atomic_set_uint16_t_bits(&ctx->flags, RPC_CTX_FLAG_ASYNC);
+}
+
+/*
+ * RPC_CTX_FLAG_LOCKED
+ *
+ * After the call is sent, queue its timeout.  Either the reply or the
+ * timeout completes it, once the caller drops ctx->we.mtx.  The caller's
+ * client reference is released after the callback.
+ */
+void
+rpc_ctx_async_start(rpc_ctx_t *ctx)
+{
+	rpc_ctx_t *prev;
+
+	(void)clock_gettime(CLOCK_MONOTONIC_FAST, &ctx->ctx_u.clnt.deadline);
+	timespecadd(&ctx->ctx_u.clnt.deadline, &ctx->ctx_u.clnt.timeout);
+
+	mutex_lock(&rpc_ctx_expire.mtx);
+	if (atomic_fetch_uint16_t(&ctx->flags) & RPC_CTX_FLAG_COMPLETE) {
+		/* already replied */
+		mutex_unlock(&rpc_ctx_expire.mtx);
+		return;
+	}
+	atomic_set_uint16_t_bits(&ctx->flags, RPC_CTX_FLAG_EXPIRE);
+
+	/* timeouts are mostly alike, so this rarely walks */
+	prev = TAILQ_LAST(&rpc_ctx_expire.q, rpc_ctx_expire_q);
+	while (prev && timespeccmp(&prev->ctx_u.clnt.deadline,
+				   &ctx->ctx_u.clnt.deadline, >))
+		prev = TAILQ_PREV(prev, rpc_ctx_expire_q, expq);
+
+	if (prev) {
+		TAILQ_INSERT_AFTER(&rpc_ctx_expire.q, prev, ctx, expq);
+		mutex_unlock(&rpc_ctx_expire.mtx);
+		return;
+	}
+	TAILQ_INSERT_HEAD(&rpc_ctx_expire.q, ctx, expq);
+	rpc_ctx_expire_set_due(ctx);
+	mutex_unlock(&rpc_ctx_expire.mtx);
+
+	/* the channels may be waiting longer */
+	svc_rqst_xprt_wakeup(&CX_DATA(ctx->ctx_u.clnt.clnt)->cx_rec->xprt);
+}
+
+/*
+ * Time out all remaining async calls now, while their transports remain.
+ */
+void
+rpc_ctx_shutdown(void)
+{
+	struct rpc_ctx_expire_q expired = TAILQ_HEAD_INITIALIZER(expired);
+
+	mutex_lock(&rpc_ctx_expire.mtx);
+	(void)rpc_ctx_expire_take(NULL, &expired);
+	rpc_ctx_expire_set_due(NULL);
+	mutex_unlock(&rpc_ctx_expire.mtx);
+
+	rpc_ctx_expire_done(&expired);
+}
+
+/*
+ * Hand a call taken by its reply (or error) to the callback, or signal
+ * the waiting caller.
+ */
+static void
+rpc_ctx_xfer_done(rpc_ctx_t *ctx)
+{
+	if (atomic_fetch_uint16_t(&ctx->flags) & RPC_CTX_FLAG_ASYNC) {
+		rpc_ctx_complete(ctx);
+		return;
+	}
+
+	/* signal the specific ctx  */
+	mutex_lock(&ctx->we.mtx);
+	atomic_set_uint16_t_bits(&ctx->flags, RPC_CTX_FLAG_ACKSYNC);
+	cond_signal(&ctx->we.cv);
+	mutex_unlock(&ctx->we.mtx);
+}
+
 /* unlocked
  */
 enum xprt_stat
@@ -116,22 +646,19 @@ rpc_ctx_xfer_replymsg(struct svc_req *req)
 	XDR *xdrs = req->rq_xdrs;
 	SVCXPRT *xprt = req->rq_xprt;
 	struct rpc_dplx_rec *rec = REC_XPRT(xprt);
-	rpc_ctx_t ctx_k, *ctx;
-	struct opr_rbtree_node *nv;
+	rpc_ctx_t *ctx;
 
-	rpc_dplx_rli(rec);
-	ctx_k.xid = req->rq_msg.rm_xid;
-	nv = opr_rbtree_lookup(&rec->call_replies, &ctx_k.node_k);
-	rpc_dplx_rui(rec);
-	if (!nv) {
+	/* taken here, the owner (or timer) will not remove it */
+	ctx = rpc_ctx_take(rec, req->rq_msg.rm_xid, NULL);
+	if (!ctx) {
 		__warnx(TIRPC_DEBUG_FLAG_ERROR,
 			"%s: %p fd %d call ctx lookup failed xid %" PRIu32,
-			__func__, &rec->xprt, rec->xprt.xp_fd, ctx_k.xid);
+			__func__, &rec->xprt, rec->xprt.xp_fd,
+			req->rq_msg.rm_xid);
 		return SVC_STAT(xprt);
 	}
-
-	ctx = opr_containerof(nv, rpc_ctx_t, node_k);
-	atomic_set_uint16_t_bits(&ctx->flags, RPC_CTX_FLAG_ACKSYNC);
+	if (atomic_fetch_uint16_t(&ctx->flags) & RPC_CTX_FLAG_ASYNC)
+		atomic_set_uint16_t_bits(&ctx->flags, RPC_CTX_FLAG_COMPLETE);
 
 	_seterr_reply(&req->rq_msg, &(ctx->error));
 	if (ctx->error.re_status == RPC_SUCCESS) {
@@ -150,12 +677,7 @@ rpc_ctx_xfer_replymsg(struct svc_req *req)
 	} else if (ctx->refreshes-- > 0
 		   && AUTH_REFRESH(ctx->cc_auth, &(ctx->cc_msg))) {
 		/* maybe our credentials need to be refreshed ... */
-		rpc_dplx_rli(rec);
-		opr_rbtree_remove(&rec->call_replies, &ctx->node_k);
-		ctx->xid = ++(rec->call_xid);
-		nv = opr_rbtree_insert(&rec->call_replies, &ctx->node_k);
-		rpc_dplx_rui(rec);
-		if (nv) {
+		if (!rpc_ctx_insert(rec, ctx)) {
 			__warnx(TIRPC_DEBUG_FLAG_ERROR,
 				"%s: %p fd %d call ctx insert failed xid %" PRIu32,
 				__func__, xprt, xprt->xp_fd, ctx->xid);
@@ -164,18 +686,41 @@ rpc_ctx_xfer_replymsg(struct svc_req *req)
 		}
 	}
 
-	/* signal the specific ctx  */
-	mutex_lock(&ctx->we.mtx);
-	cond_signal(&ctx->we.cv);
-	mutex_unlock(&ctx->we.mtx);
-
 	__warnx(TIRPC_DEBUG_FLAG_RPC_CTX,
 		"%s: %p fd %d call ctx acknowledged xid %" PRIu32,
 		__func__, xprt, xprt->xp_fd, ctx->xid);
 
+	rpc_ctx_xfer_done(ctx);
 	return SVC_STAT(xprt);
 }
 
+/*
+ * The call for xid failed in the transport, such as an ICMP error for
+ * a datagram sent to addr.  Unknown (or already answered) xids, and
+ * calls to another peer, are ignored.
+ */
+void
+rpc_ctx_xfer_error(SVCXPRT *xprt, uint32_t xid, const struct sockaddr *addr,
+		   int code)
+{
+	rpc_ctx_t *ctx = rpc_ctx_take(REC_XPRT(xprt), xid, addr);
+
+	if (!ctx)
+		return;
+	if (atomic_fetch_uint16_t(&ctx->flags) & RPC_CTX_FLAG_ASYNC)
+		atomic_set_uint16_t_bits(&ctx->flags, RPC_CTX_FLAG_COMPLETE);
+
+	ctx->error.re_status = RPC_CANTRECV;
+	ctx->error.re_errno = code;
+	ctx->refreshes = 0;
+
+	__warnx(TIRPC_DEBUG_FLAG_RPC_CTX,
+		"%s: %p fd %d call ctx failed xid %" PRIu32 " errno %d",
+		__func__, xprt, xprt->xp_fd, xid, code);
+
+	rpc_ctx_xfer_done(ctx);
+}
+
 /* RPC_CTX_FLAG_LOCKED
  */
 int
@@ -223,11 +768,16 @@ rpc_ctx_release(rpc_ctx_t *ctx)
 	if (atomic_dec_uint32_t(&ctx->refcount))
 		return;
 
-	rpc_dplx_rli(cx->cx_rec);
-	opr_rbtree_remove(&cx->cx_rec->call_replies, &ctx->node_k);
-	rpc_dplx_rui(cx->cx_rec);
-	mutex_unlock(&ctx->we.mtx);
-	mutex_destroy(&ctx->we.mtx);
-	cond_destroy(&ctx->we.cv);
-	mem_free(ctx, sizeof(*ctx));
+	/* claimed async calls were removed with the claim */
+	if (!(atomic_fetch_uint16_t(&ctx->flags) & RPC_CTX_FLAG_COMPLETE)
+	    && !rpc_ctx_remove(cx->cx_rec, ctx)) {
+		/* taken by a late reply, wait for its signal */
+		while (!(atomic_fetch_uint16_t(&ctx->flags)
+			 & RPC_CTX_FLAG_ACKSYNC))
+			cond_wait(&ctx->we.cv, &ctx->we.mtx);
+
+		/* which may have refreshed it under a new xid */
+		(void)rpc_ctx_remove(cx->cx_rec, ctx);
+	}
+	rpc_ctx_free(ctx);
 }
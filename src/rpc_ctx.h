@@ -29,10 +29,18 @@
 #include <misc/rbtree_x.h>
 #include <misc/wait_queue.h>
 #include <rpc/clnt.h>
+#include <rpc/pool_queue.h>
 #include <rpc/svc.h>
 
 #define RPC_CTX_FLAG_NONE     0x0000
 #define RPC_CTX_FLAG_ACKSYNC  0x0008
+#define RPC_CTX_FLAG_ASYNC    0x0010
+#define RPC_CTX_FLAG_COMPLETE 0x0020	/* async, claimed by reply or timer */
+#define RPC_CTX_FLAG_EXPIRE   0x0040	/* async, on the timeout queue */
+#define RPC_CTX_FLAG_SPILLED  0x0080	/* in call_replies, not the ring */
+
+/* idle call contexts kept per client */
+#define RPC_CTX_POOL_MAX 1024
 
 /*
  * RPC context.  Intended to enable efficient multiplexing of calls
@@ -40,12 +48,17 @@
  */
 typedef struct rpc_ctx_s {
 	struct opr_rbtree_node node_k;
+	struct poolq_entry ctxq;	/* cx_ctxq, while idle */
+	TAILQ_ENTRY(rpc_ctx_s) expq;
 	struct wait_entry we;
 	struct rpc_err error;
 	union {
 		struct {
 			struct rpc_client *clnt;
 			struct timespec timeout;
+			struct timespec deadline;	/* async */
+			clnt_call_cb_t cb;
+			void *cb_arg;
 		} clnt;
 		struct {
 			/* nothing */
@@ -68,6 +81,11 @@ int call_xid_cmpf(const struct opr_rbtree_node *lhs,
 rpc_ctx_t *rpc_ctx_alloc(CLIENT *, struct timeval);
 int rpc_ctx_wait_reply(rpc_ctx_t *);
 enum xprt_stat rpc_ctx_xfer_replymsg(struct svc_req *);
+void rpc_ctx_xfer_error(SVCXPRT *, uint32_t, const struct sockaddr *, int);
 void rpc_ctx_release(rpc_ctx_t *);
+void rpc_ctx_async(rpc_ctx_t *, clnt_call_cb_t, void *);
+void rpc_ctx_async_start(rpc_ctx_t *);
+int rpc_ctx_expire_tick(void);
+void rpc_ctx_shutdown(void);
 
 #endif				/* TIRPC_RPC_CTX_H */
@@ -35,7 +35,8 @@
 /* Svc event strategy */
 enum svc_event_type {
 	SVC_EVENT_FDSET /* trad. using select and poll (currently unhooked) */ ,
-	SVC_EVENT_EPOLL		/* Linux epoll interface */
+	SVC_EVENT_EPOLL,	/* Linux epoll interface */
+	SVC_EVENT_URING		/* Linux io_uring interface */
 };
 
 typedef struct rpc_dplx_lock {
@@ -50,12 +51,46 @@ typedef struct rpc_dplx_lock {
 struct rpc_dplx_rec {
 	struct svc_xprt xprt;		/**< Transport Independent handle */
 	struct xdr_ioq ioq;
+	struct {
+		void **slot;		/* outstanding calls, by xid & mask */
+		uint32_t mask;
+		uint32_t spilled;	/* in call_replies instead */
+	} calls;
 	struct opr_rbtree call_replies;
-	struct opr_rbtree_node fd_node;
 	struct {
 		rpc_dplx_lock_t lock;
 		struct timespec ts;
 	} recv;
+	struct {
+		TAILQ_ENTRY(rpc_dplx_rec) q;	/* svc_rqst idle wheel slot */
+		time_t expires;		/* slot time, 0 when not queued */
+	} idle;
+	struct {
+		struct poolq_head_s pending;	/* xdr_ioq awaiting completion */
+		mutex_t mtx;
+		uint32_t min;		/* MSG_ZEROCOPY reply bytes, 0 disables */
+		uint32_t next;		/* next completion id */
+		uint32_t done;		/* completed before this id */
+		struct timespec linger;	/* destroy stops waiting, or 0 */
+	} zc;
+	struct {
+		struct poolq_head_s q;	/* replies, first is being written */
+		mutex_t mtx;
+		struct work_pool_entry wpe;	/* output event, or ready queue */
+		struct iovec *iov;	/* unwritten remainder of first */
+		uint32_t *hdr;		/* its record marks (with iov) */
+		u_int iovsz;		/* allocated bytes */
+		u_int iw;		/* next iov */
+		u_int ix;		/* iov count */
+		u_int nhdr;
+		uint32_t count;		/* queued replies */
+		uint32_t max_count;
+		uint32_t bytes;		/* queued reply bytes */
+		int32_t deficit;	/* bytes remaining this turn */
+		uint64_t waits;		/* socket was full */
+		uint64_t throttles;	/* input waited */
+		uint16_t flags;
+	} out;
 
 	/*
 	 * union of event processor types
@@ -64,7 +99,17 @@ struct rpc_dplx_rec {
 #if defined(TIRPC_EPOLL)
 		struct {
 			struct epoll_event event;
+			int out_fd;		/* dup() for output events */
 		} epoll;
+#endif
+#if defined(TIRPC_URING)
+		struct {
+			void *buf;		/* prepared buffer (or msghdr) */
+			uint32_t len;
+			int32_t res;		/* completion result */
+			uint8_t prep;		/* prepared IORING_OP_* */
+			uint8_t op;		/* in flight, then completed */
+		} uring;
 #endif
 	} ev_u;
 	void *ev_p;			/* struct svc_rqst_rec (internal) */
@@ -78,10 +123,21 @@ struct rpc_dplx_rec {
 };
 #define REC_XPRT(p) (opr_containerof((p), struct rpc_dplx_rec, xprt))
 
+/* calls.slot */
+#define RPC_DPLX_CALL_SLOTS         1024
+
 #define RPC_DPLX_FLAG_NONE          0x0000
 #define RPC_DPLX_FLAG_LOCKED        0x0001
 #define RPC_DPLX_FLAG_UNLOCK        0x0002
 
+/* out.flags */
+#define RPC_DPLX_OUT_ARMED          0x0001	/* waiting for output event */
+#define RPC_DPLX_OUT_WORKING        0x0002	/* out.wpe submitted */
+#define RPC_DPLX_OUT_ZEROCOPY       0x0004	/* first sent MSG_ZEROCOPY */
+#define RPC_DPLX_OUT_ZEROCOPIED     0x0008	/* ... and buffers are pinned */
+#define RPC_DPLX_OUT_THROTTLED      0x0010	/* recv waits for output */
+#define RPC_DPLX_OUT_LINGER         0x0020	/* close after zerocopy drains */
+
 #ifndef HAVE_STRLCAT
 extern size_t strlcat(char *, const char *, size_t);
 #endif
@@ -108,11 +164,33 @@ static inline void
 rpc_dplx_rec_init(struct rpc_dplx_rec *rec)
 {
 	rpc_dplx_lock_init(&rec->recv.lock);
+	TAILQ_INIT(&rec->zc.pending);
+	mutex_init(&rec->zc.mtx, NULL);
+	TAILQ_INIT(&rec->out.q);
+	mutex_init(&rec->out.mtx, NULL);
 }
 
 static inline void
 rpc_dplx_rec_destroy(struct rpc_dplx_rec *rec)
 {
+	struct poolq_entry *have;
+
+	/* MSG_ZEROCOPY buffers still pending (after svc_ioq_zerocopy_drain)
+	 * may yet be sent by the kernel, never re-use them.
+	 */
+	mutex_destroy(&rec->zc.mtx);
+
+	/* output that was still waiting for the socket */
+	while ((have = TAILQ_FIRST(&rec->out.q))) {
+		TAILQ_REMOVE(&rec->out.q, have, q);
+		XDR_DESTROY(_IOQ(have)->xdrs);
+	}
+	if (rec->out.iov)
+		mem_free(rec->out.iov, rec->out.iovsz);
+	mutex_destroy(&rec->out.mtx);
+
+	if (rec->calls.slot)
+		mem_free(rec->calls.slot, RPC_DPLX_CALL_SLOTS * sizeof(void *));
 	rpc_dplx_lock_destroy(&rec->recv.lock);
 }
 
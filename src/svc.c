@@ -79,6 +79,7 @@
 #include "rpc_rdma.h"
 #endif
 #include "svc_ioq.h"
+#include "rpc_ctx.h"
 
 #define SVC_VERSQUIET 0x0001	/* keep quiet about vers mismatch */
 #define version_keepquiet(xp) ((u_long)(xp)->xp_p3 & SVC_VERSQUIET)
@@ -128,6 +129,9 @@ svc_work_pool_init()
 	struct work_pool_params params = {
 		.thrd_max = __svc_params->ioq.thrd_max,
 		.thrd_min = SVC_WORK_POOL_THRD_MIN,
+		.flags = (__svc_params->flags & SVC_FLAG_WORK_STEAL)
+			? WORK_POOL_FLAG_STEAL
+			: WORK_POOL_FLAG_NONE,
 	};
 
 	return work_pool_init(&svc_work_pool, "svc_work_pool", &params);
@@ -159,8 +163,16 @@ svc_init(svc_init_params *params)
 
 	/* svc_vc */
 	__svc_params->xprt_u.vc.nconns = 0;
+	__svc_params->xprt_u.vc.recv_max =
+	    (params->vc_recv_max) ? params->vc_recv_max : 16;
 	mutex_init(&__svc_params->xprt_u.vc.mtx, NULL);
 
+	/* svc_dg */
+	__svc_params->xprt_u.dg.recv_max =
+	    (params->dg_recv_max) ? params->dg_recv_max : 1;
+	__svc_params->xprt_u.dg.pool_max =
+	    (params->dg_pool_max) ? params->dg_pool_max : 256;
+
 #if defined(HAVE_BLKIN)
 	if (params->flags & SVC_INIT_BLKIN) {
 		int r = blkin_init();
@@ -176,6 +188,8 @@ svc_init(svc_init_params *params)
 	if (params->flags & SVC_INIT_EPOLL) {
 		__svc_params->ev_type = SVC_EVENT_EPOLL;
 		__svc_params->ev_u.evchan.max_events = params->max_events;
+		__svc_params->ev_u.evchan.max_inline =
+			(params->max_inline) ? params->max_inline : 1;
 	}
 #else
 	/* XXX formerly select/fd_set case, now placeholder for new
@@ -187,11 +201,20 @@ svc_init(svc_init_params *params)
 	if (params->flags & SVC_INIT_NOREG_XPRTS)
 		__svc_params->flags |= SVC_FLAG_NOREG_XPRTS;
 
+	/* per-worker queues with work stealing */
+	if (params->flags & SVC_INIT_WORK_STEAL)
+		__svc_params->flags |= SVC_FLAG_WORK_STEAL;
+
 	if (params->ioq_send_max)
 		__svc_params->ioq.send_max = params->ioq_send_max;
 	else
 		__svc_params->ioq.send_max = RPC_MAXDATA_DEFAULT;
 
+	if (params->ioq_queue_max)
+		__svc_params->ioq.queue_max = params->ioq_queue_max;
+	else
+		__svc_params->ioq.queue_max = 16 * 1024 * 1024;
+
 	if (params->ioq_thrd_max)
 		__svc_params->ioq.thrd_max = params->ioq_thrd_max;
 	else
@@ -808,6 +831,9 @@ svc_shutdown(u_long flags)
 	rpc_rdma_internals_fini();
 #endif
 
+	/* time out pending async calls */
+	rpc_ctx_shutdown();
+
 	/* dispose all xprts and support */
 	svc_xprt_shutdown();
 
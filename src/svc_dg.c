@@ -55,6 +55,12 @@
 #include <netconfig.h>
 #include <err.h>
 
+#ifdef IP_RECVERR
+#include <asm/types.h>
+#include <linux/errqueue.h>
+#include <sys/uio.h>
+#endif
+
 #include "rpc_com.h"
 #include "rpc_ctx.h"
 #include "svc_internal.h"
@@ -67,6 +73,25 @@
 #define MAX(a, b) (((a) > (b)) ? (a) : (b))
 #endif
 
+/* replies received in one pass, before another task may recv */
+#define SVC_DG_REPLIES_MAX 64
+
+/* most datagrams per recvmmsg() (dg_recv_max) */
+#define SVC_DG_RECV_MAX 64
+
+/*
+ * Replies to a batch of calls, sent together by sendmmsg() after the
+ * batch is dispatched.  Each holds a reference to its transport.
+ */
+struct svc_dg_sendq {
+	SVCXPRT *xprt;		/* rendezvous */
+	u_int n;
+	struct mmsghdr mmsg[SVC_DG_RECV_MAX];
+	SVCXPRT *held[SVC_DG_RECV_MAX];
+};
+
+static __thread struct svc_dg_sendq *svc_dg_sendq_self;
+
 static void svc_dg_rendezvous_ops(SVCXPRT *);
 static void svc_dg_override_ops(SVCXPRT *, SVCXPRT *);
 
@@ -84,6 +109,27 @@ static int svc_dg_store_pktinfo(struct msghdr *, SVCXPRT *);
 static void
 svc_dg_xprt_free(struct svc_dg_xprt *su)
 {
+	struct poolq_entry *have;
+
+#if defined(TIRPC_URING)
+	if (su->su_next)
+		svc_dg_xprt_free(su->su_next);
+#endif
+	if (su->su_ring) {
+		u_int i;
+
+		for (i = 0; i < su->su_ring_max; i++)
+			if (su->su_ring[i])
+				svc_dg_xprt_free(su->su_ring[i]);
+		mem_free(su->su_ring,
+			 su->su_ring_max * sizeof(struct svc_dg_xprt *));
+	}
+	while ((have = TAILQ_FIRST(&su->su_pool.qh))) {
+		TAILQ_REMOVE(&su->su_pool.qh, have, q);
+		svc_dg_xprt_free(DG_DR(opr_containerof(have, struct rpc_dplx_rec,
+						       ioq.ioq_s)));
+	}
+	poolq_head_destroy(&su->su_pool);
 	XDR_DESTROY(su->su_dr.ioq.xdrs);
 	rpc_dplx_rec_destroy(&su->su_dr);
 	mutex_destroy(&su->su_dr.xprt.xp_lock);
@@ -95,17 +141,30 @@ svc_dg_xprt_free(struct svc_dg_xprt *su)
 	mem_free(su, sizeof(struct svc_dg_xprt) + su->su_dr.maxrec);
 }
 
-static struct svc_dg_xprt *
-svc_dg_xprt_zalloc(size_t iosz)
+/*
+ * Only the header is cleared, the buffer (iosz) that follows is always
+ * written before it is read.
+ */
+static void
+svc_dg_xprt_init(struct svc_dg_xprt *su)
 {
-	struct svc_dg_xprt *su = mem_zalloc(sizeof(struct svc_dg_xprt) + iosz);
+	memset(su, 0, sizeof(struct svc_dg_xprt));
 
 	/* Init SVCXPRT locks, etc */
 	mutex_init(&su->su_dr.xprt.xp_lock, NULL);
 	rpc_dplx_rec_init(&su->su_dr);
 	xdr_ioq_setup(&su->su_dr.ioq);
+	poolq_head_setup(&su->su_pool);
 
 	su->su_dr.xprt.xp_refs = 1;
+}
+
+static struct svc_dg_xprt *
+svc_dg_xprt_alloc(size_t iosz)
+{
+	struct svc_dg_xprt *su = mem_alloc(sizeof(struct svc_dg_xprt) + iosz);
+
+	svc_dg_xprt_init(su);
 	return (su);
 }
 
@@ -116,7 +175,7 @@ svc_dg_xprt_setup(SVCXPRT **sxpp)
 		svc_dg_xprt_free(su_data(*sxpp));
 		*sxpp = NULL;
 	} else {
-		struct svc_dg_xprt *su = svc_dg_xprt_zalloc(0);
+		struct svc_dg_xprt *su = svc_dg_xprt_alloc(0);
 
 		*sxpp = &su->su_dr.xprt;
 	}
@@ -200,6 +259,9 @@ svc_dg_ncreatef(const int fd, const u_int sendsz, const u_int recvsz,
 	/* duplex streams are not used by the rendezvous transport */
 	xdrmem_create(su->su_dr.ioq.xdrs, NULL, 0, XDR_ENCODE);
 
+	/* clnt_dg calls on this socket, usually found in rec->calls */
+	opr_rbtree_init(&rec->call_replies, call_xid_cmpf);
+
 	svc_dg_rendezvous_ops(xprt);
 
 	/* Enable reception of IP*_PKTINFO control msgs */
@@ -231,16 +293,30 @@ svc_dg_stat(SVCXPRT *xprt)
 	return SVC_STAT(xprt->xp_parent);
 }
 
-static enum xprt_stat
-svc_dg_rendezvous(SVCXPRT *xprt)
+/*
+ * Ready (again) for recvmsg()
+ */
+static inline void
+svc_dg_rendezvous_reset(struct svc_dg_xprt *su)
+{
+	struct msghdr *mesgp = &su->su_msghdr;
+
+	((struct sockaddr *)mesgp->msg_name)->sa_family = (sa_family_t) 0xffff;
+	mesgp->msg_namelen = sizeof(struct sockaddr_storage);
+	mesgp->msg_control = su->su_cmsg;
+	mesgp->msg_controllen = sizeof(su->su_cmsg);
+}
+
+/*
+ * Set up a request transport of this socket, ready for recvmsg()
+ */
+static void
+svc_dg_rendezvous_prep(SVCXPRT *xprt, struct svc_dg_xprt *su)
 {
 	struct svc_dg_xprt *req_su = su_data(xprt);
-	struct svc_dg_xprt *su = svc_dg_xprt_zalloc(req_su->su_dr.maxrec);
 	SVCXPRT *newxprt = &su->su_dr.xprt;
 	struct sockaddr *sp = (struct sockaddr *)&newxprt->xp_remote.ss;
-	struct msghdr *mesgp;
-	struct iovec iov;
-	ssize_t rlen;
+	struct msghdr *mesgp = &su->su_msghdr;
 
 	newxprt->xp_fd = xprt->xp_fd;
 	newxprt->xp_flags = SVC_XPRT_FLAG_INITIAL | SVC_XPRT_FLAG_INITIALIZED;
@@ -250,40 +326,228 @@ svc_dg_rendezvous(SVCXPRT *xprt)
 	su->su_dr.maxrec = req_su->su_dr.maxrec;
 	svc_dg_override_ops(newxprt, xprt);
 
- again:
-	iov.iov_base = &su[1];
-	iov.iov_len = su->su_dr.maxrec;
-	mesgp = &su->su_msghdr;
-	memset(mesgp, 0, sizeof(*mesgp));
-	mesgp->msg_iov = &iov;
+	su->su_iov.iov_base = &su[1];
+	su->su_iov.iov_len = su->su_dr.maxrec;
+	mesgp->msg_iov = &su->su_iov;
 	mesgp->msg_iovlen = 1;
 	mesgp->msg_name = sp;
-	sp->sa_family = (sa_family_t) 0xffff;
-	mesgp->msg_namelen = sizeof(struct sockaddr_storage);
-	mesgp->msg_control = su->su_cmsg;
-	mesgp->msg_controllen = sizeof(su->su_cmsg);
+	svc_dg_rendezvous_reset(su);
+}
 
-	rlen = recvmsg(newxprt->xp_fd, mesgp, 0);
+/*
+ * Keep a request transport (ready for recvmsg()) in su_pool, unless it
+ * is full or the socket is going away.  Returns false if not kept.
+ */
+static bool
+svc_dg_rendezvous_put(SVCXPRT *xprt, struct svc_dg_xprt *su)
+{
+	struct svc_dg_xprt *req_su = su_data(xprt);
+	bool keep;
 
-	if (sp->sa_family == (sa_family_t) 0xffff) {
-		svc_dg_xprt_free(su);
-		return (XPRT_DIED);
+	if (xprt->xp_flags & SVC_XPRT_FLAG_DESTROYED)
+		return (false);
+
+	pthread_mutex_lock(&req_su->su_pool.qmutex);
+	keep = (u_int)req_su->su_pool.qcount
+	       < __svc_params->xprt_u.dg.pool_max;
+	if (keep) {
+		/* LIFO, the last one is still warm */
+		TAILQ_INSERT_HEAD(&req_su->su_pool.qh, &su->su_dr.ioq.ioq_s,
+				  q);
+		req_su->su_pool.qcount++;
+	}
+	pthread_mutex_unlock(&req_su->su_pool.qmutex);
+	return (keep);
+}
+
+/*
+ * The next request transport, from su_pool or allocated
+ */
+static struct svc_dg_xprt *
+svc_dg_rendezvous_su(SVCXPRT *xprt)
+{
+	struct svc_dg_xprt *req_su = su_data(xprt);
+	struct poolq_entry *have;
+	struct svc_dg_xprt *su;
+
+	pthread_mutex_lock(&req_su->su_pool.qmutex);
+	have = TAILQ_FIRST(&req_su->su_pool.qh);
+	if (have) {
+		TAILQ_REMOVE(&req_su->su_pool.qh, have, q);
+		req_su->su_pool.qcount--;
+	}
+	pthread_mutex_unlock(&req_su->su_pool.qmutex);
+
+	if (have) {
+		su = DG_DR(opr_containerof(have, struct rpc_dplx_rec,
+					   ioq.ioq_s));
+		svc_dg_rendezvous_reset(su);
+		return (su);
 	}
 
-	if (rlen == -1 && errno == EINTR)
-		goto again;
-	if (rlen == -1 || (rlen < (ssize_t) (4 * sizeof(u_int32_t)))) {
+	su = svc_dg_xprt_alloc(req_su->su_dr.maxrec);
+	svc_dg_rendezvous_prep(xprt, su);
+	return (su);
+}
+
+/*
+ * A released request transport is set up again (as if new), and kept
+ * for another datagram.  Called before its parent reference is released.
+ */
+static void
+svc_dg_xprt_recycle(SVCXPRT *xprt, struct svc_dg_xprt *su)
+{
+	size_t iosz = su->su_dr.maxrec;
+
+	if (xprt->xp_flags & SVC_XPRT_FLAG_DESTROYED) {
 		svc_dg_xprt_free(su);
-		return (XPRT_DIED);
+		return;
 	}
 
-	if (unlikely(svc_rqst_rearm_events(xprt))) {
-		__warnx(TIRPC_DEBUG_FLAG_ERROR,
-			"%s: %p fd %d svc_rqst_rearm_events failed (will set dead)",
+	XDR_DESTROY(su->su_dr.ioq.xdrs);
+	rpc_dplx_rec_destroy(&su->su_dr);
+	mutex_destroy(&su->su_dr.xprt.xp_lock);
+	poolq_head_destroy(&su->su_pool);
+#if defined(HAVE_BLKIN)
+	if (su->su_dr.xprt.blkin.svc_name)
+		mem_free(su->su_dr.xprt.blkin.svc_name, 2*INET6_ADDRSTRLEN);
+#endif
+
+	svc_dg_xprt_init(su);
+	su->su_dr.maxrec = iosz;
+	svc_dg_rendezvous_prep(xprt, su);
+
+	if (!svc_dg_rendezvous_put(xprt, su))
+		svc_dg_xprt_free(su);
+}
+
+/*
+ * A reply to a clnt_dg call on this socket.  Calls are registered with
+ * the shared (rendezvous) transport, and found there by xid.
+ */
+static void
+svc_dg_replymsg(SVCXPRT *xprt, struct svc_dg_xprt *su, ssize_t rlen)
+{
+	XDR *xdrs = su->su_dr.ioq.xdrs;
+	struct svc_req req;
+
+	xdrmem_create(xdrs, su->su_iov.iov_base, rlen, XDR_DECODE);
+	req.rq_xprt = xprt;
+	req.rq_xdrs = xdrs;
+	rpc_msg_init(&req.rq_msg);
+
+	if (!xdr_dplx_decode(xdrs, &req.rq_msg)) {
+		__warnx(TIRPC_DEBUG_FLAG_WARN,
+			"%s: %p fd %d reply decode failed",
 			__func__, xprt, xprt->xp_fd);
+		return;
+	}
+	(void)rpc_ctx_xfer_replymsg(&req);
+}
+
+#ifdef IP_RECVERR
+/*
+ * Drain the socket error queue (IP_RECVERR, set by clnt_dg).  Each error
+ * returns the start of the datagram that failed, so its call fails now
+ * instead of timing out.
+ */
+static void
+svc_dg_recverr(SVCXPRT *xprt)
+{
+	uint64_t cbuf[32];
+	struct sockaddr_storage ss;
+	struct sock_extended_err *e;
+	struct cmsghdr *cmsg;
+	struct msghdr msg;
+	struct iovec iov;
+	ssize_t rlen;
+	uint32_t xid;
+
+	for (;;) {
+		memset(&msg, 0, sizeof(msg));
+		iov.iov_base = &xid;
+		iov.iov_len = sizeof(xid);
+		msg.msg_name = &ss;
+		msg.msg_namelen = sizeof(ss);
+		msg.msg_iov = &iov;
+		msg.msg_iovlen = 1;
+		msg.msg_control = cbuf;
+		msg.msg_controllen = sizeof(cbuf);
+
+		rlen = recvmsg(xprt->xp_fd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT);
+		if (rlen < 0)
+			break;
+		if (rlen < (ssize_t) sizeof(xid))
+			continue;
+
+		for (cmsg = CMSG_FIRSTHDR(&msg); cmsg;
+		     cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+			if (cmsg->cmsg_level != SOL_IP
+			    || cmsg->cmsg_type != IP_RECVERR)
+				continue;
+			e = (struct sock_extended_err *)CMSG_DATA(cmsg);
+			__warnx(TIRPC_DEBUG_FLAG_SVC_DG,
+				"%s: %p fd %d xid %" PRIu32 " errno %d",
+				__func__, xprt, xprt->xp_fd, ntohl(xid),
+				e->ee_errno);
+			/* msg_name is the destination of the failed call */
+			rpc_ctx_xfer_error(xprt, ntohl(xid),
+					   msg.msg_namelen
+					   ? (struct sockaddr *)&ss : NULL,
+					   e->ee_errno);
+		}
+	}
+}
+#endif
+
+/*
+ * Nothing (more) to receive, a failed recv, or a runt.  The socket
+ * remains usable, keep receiving.  su (if any) is not kept.
+ */
+static enum xprt_stat
+svc_dg_rendezvous_idle(SVCXPRT *xprt, struct svc_dg_xprt *su, int code,
+		       bool uring, bool first)
+{
+#if defined(TIRPC_URING)
+	struct svc_dg_xprt *req_su = su_data(xprt);
+#endif
+
+#ifdef IP_RECVERR
+	/* an error, or an event (EPOLLERR) with nothing to read */
+	if (code && (first || (code != EAGAIN && code != EWOULDBLOCK)))
+		svc_dg_recverr(xprt);
+#endif
+#if defined(TIRPC_URING)
+	if (uring) {
+		/* try again with the same transport */
+		svc_dg_rendezvous_reset(su);
+		req_su->su_next = su;
+		(void)svc_rqst_uring_prep(xprt, IORING_OP_RECVMSG,
+					  &su->su_msghdr, 0);
+		if (unlikely(svc_rqst_rearm_events(xprt)))
+			return (XPRT_DIED);
+		return (XPRT_IDLE);
+	}
+#endif
+	if (su && !svc_dg_rendezvous_put(xprt, su))
 		svc_dg_xprt_free(su);
+
+	if (code == EAGAIN || code == EWOULDBLOCK) {
+		if (unlikely(svc_rqst_rearm_drained(xprt)))
+			return (XPRT_DIED);
+	} else if (unlikely(svc_rqst_rearm_events(xprt)))
 		return (XPRT_DIED);
-	}
+	return (XPRT_IDLE);
+}
+
+/*
+ * A received call becomes a request transport
+ */
+static void
+svc_dg_rendezvous_clone(SVCXPRT *xprt, struct svc_dg_xprt *su, size_t rlen)
+{
+	SVCXPRT *newxprt = &su->su_dr.xprt;
+	struct msghdr *mesgp = &su->su_msghdr;
 
 	__rpc_address_setup(&newxprt->xp_local);
 	__rpc_address_setup(&newxprt->xp_remote);
@@ -302,14 +566,251 @@ svc_dg_rendezvous(SVCXPRT *xprt)
 	__rpc_set_blkin_endpoint(newxprt, "svc_dg");
 #endif
 
-	xdrmem_create(su->su_dr.ioq.xdrs, iov.iov_base, iov.iov_len,
+	/* the buffer is re-used, only rlen bytes are this datagram */
+	xdrmem_create(su->su_dr.ioq.xdrs, su->su_iov.iov_base, rlen,
 		      XDR_DECODE);
 
 	SVC_REF(xprt, SVC_REF_FLAG_NONE);
 	newxprt->xp_parent = xprt;
+}
+
+/*
+ * Send the replies of a batch, and release their transports
+ */
+static void
+svc_dg_sendq_flush(struct svc_dg_sendq *sq)
+{
+	SVCXPRT *xprt = sq->xprt;
+	u_int i = 0;
+	int sent;
+
+	while (i < sq->n) {
+		sent = sendmmsg(xprt->xp_fd, &sq->mmsg[i], sq->n - i, 0);
+		if (sent > 0) {
+			i += sent;
+			continue;
+		}
+		if (sent < 0 && errno == EINTR)
+			continue;
+		__warnx(TIRPC_DEBUG_FLAG_ERROR,
+			"%s: %p fd %d sendmmsg failed (%d)",
+			__func__, xprt, xprt->xp_fd, errno);
+		i++;	/* skip the failed reply */
+	}
+
+	for (i = 0; i < sq->n; i++)
+		SVC_RELEASE(sq->held[i], SVC_RELEASE_FLAG_NONE);
+	sq->n = 0;
+}
+
+/*
+ * Batched receive (dg_recv_max > 1): up to dg_recv_max datagrams per
+ * recvmmsg(), into transports kept ready in su_ring.  Only the task
+ * that took the event receives, so su_ring needs no lock.  Calls are
+ * dispatched in turn after re-arming, and replies made meanwhile are
+ * sent together.
+ */
+static enum xprt_stat
+svc_dg_rendezvous_batch(SVCXPRT *xprt)
+{
+	struct svc_dg_xprt *req_su = su_data(xprt);
+	struct svc_dg_xprt *calls[SVC_DG_RECV_MAX];
+	u_int lens[SVC_DG_RECV_MAX];
+	struct mmsghdr mmsg[SVC_DG_RECV_MAX];
+	struct svc_dg_sendq sq, *prev;
+	struct svc_dg_xprt *su;
+	u_int max = req_su->su_ring_max;
+	u_int ncalls = 0;
+	u_int i;
+	int n;
+
+	if (unlikely(!req_su->su_ring)) {
+		max = MIN(__svc_params->xprt_u.dg.recv_max, SVC_DG_RECV_MAX);
+		req_su->su_ring = mem_zalloc(max * sizeof(*req_su->su_ring));
+		req_su->su_ring_max = max;
+	}
+
+	for (i = 0; i < max; i++) {
+		su = req_su->su_ring[i];
+		if (!su)
+			su = req_su->su_ring[i] = svc_dg_rendezvous_su(xprt);
+		else
+			svc_dg_rendezvous_reset(su);
+		mmsg[i].msg_hdr = su->su_msghdr;
+		mmsg[i].msg_len = 0;
+	}
+
+	do {
+		n = recvmmsg(xprt->xp_fd, mmsg, max, MSG_DONTWAIT, NULL);
+	} while (n < 0 && errno == EINTR);
+	if (n <= 0)
+		return (svc_dg_rendezvous_idle(xprt, NULL, n ? errno : EAGAIN,
+					       false, true));
+
+	for (i = 0; i < n; i++) {
+		su = req_su->su_ring[i];
+		su->su_msghdr = mmsg[i].msg_hdr;
+
+		/* runts, and (as in svc_dg_rendezvous) a missing address,
+		 * leave the transport in place for the next batch
+		 */
+		if (mmsg[i].msg_len < 4 * sizeof(u_int32_t)
+		    || ((struct sockaddr *)&su->su_dr.xprt.xp_remote.ss)
+			->sa_family == (sa_family_t) 0xffff)
+			continue;
+
+		if (((uint32_t *)su->su_iov.iov_base)[1] == htonl(REPLY)) {
+			svc_dg_replymsg(xprt, su, mmsg[i].msg_len);
+			continue;
+		}
+		req_su->su_ring[i] = NULL;
+		lens[ncalls] = mmsg[i].msg_len;
+		calls[ncalls++] = su;
+	}
+
+	if (unlikely((u_int)n < max ? svc_rqst_rearm_drained(xprt)
+			     : svc_rqst_rearm_events(xprt))) {
+		__warnx(TIRPC_DEBUG_FLAG_ERROR,
+			"%s: %p fd %d svc_rqst_rearm_events failed (will set dead)",
+			__func__, xprt, xprt->xp_fd);
+		for (i = 0; i < ncalls; i++)
+			svc_dg_xprt_free(calls[i]);
+		return (XPRT_DIED);
+	}
+
+	sq.xprt = xprt;
+	sq.n = 0;
+	prev = svc_dg_sendq_self;
+	svc_dg_sendq_self = &sq;
+
+	for (i = 0; i < ncalls; i++) {
+		svc_dg_rendezvous_clone(xprt, calls[i], lens[i]);
+		(void)xprt->xp_dispatch.rendezvous_cb(&calls[i]->su_dr.xprt);
+	}
+
+	svc_dg_sendq_self = prev;
+	svc_dg_sendq_flush(&sq);
+	return (XPRT_IDLE);
+}
+
+/*
+ * A datagram (or error) was received into su.  Returns XPRT_MOREREQS
+ * after a reply, with su reset to receive another.
+ */
+static enum xprt_stat
+svc_dg_rendezvous_recvd(SVCXPRT *xprt, struct svc_dg_xprt *su, ssize_t rlen,
+			bool uring, u_int *replies)
+{
+	SVCXPRT *newxprt = &su->su_dr.xprt;
+#if defined(TIRPC_URING)
+	struct svc_dg_xprt *req_su = su_data(xprt);
+#endif
+
+	if (rlen < 0)
+		return (svc_dg_rendezvous_idle(xprt, su, errno, uring,
+					       !*replies));
+	if (rlen < (ssize_t) (4 * sizeof(u_int32_t)))
+		return (svc_dg_rendezvous_idle(xprt, su, 0, uring, false));
+
+	if (((struct sockaddr *)&newxprt->xp_remote.ss)->sa_family
+	    == (sa_family_t) 0xffff) {
+		svc_dg_xprt_free(su);
+		return (XPRT_DIED);
+	}
+
+	/* replies to clnt_dg calls are handled here, several per pass,
+	 * reusing the same buffer
+	 */
+	if (((uint32_t *)su->su_iov.iov_base)[1] == htonl(REPLY)) {
+		svc_dg_replymsg(xprt, su, rlen);
+		if (uring || ++(*replies) >= SVC_DG_REPLIES_MAX)
+			return (svc_dg_rendezvous_idle(xprt, su, 0, uring,
+						       false));
+		svc_dg_rendezvous_reset(su);
+		return (XPRT_MOREREQS);
+	}
+
+#if defined(TIRPC_URING)
+	if (uring) {
+		/* next datagram completes in the ring */
+		req_su->su_next = svc_dg_rendezvous_su(xprt);
+		(void)svc_rqst_uring_prep(xprt, IORING_OP_RECVMSG,
+					  &req_su->su_next->su_msghdr, 0);
+	}
+#endif
+	if (unlikely(svc_rqst_rearm_events(xprt))) {
+		__warnx(TIRPC_DEBUG_FLAG_ERROR,
+			"%s: %p fd %d svc_rqst_rearm_events failed (will set dead)",
+			__func__, xprt, xprt->xp_fd);
+		svc_dg_xprt_free(su);
+		return (XPRT_DIED);
+	}
+
+	svc_dg_rendezvous_clone(xprt, su, rlen);
 	return (xprt->xp_dispatch.rendezvous_cb(newxprt));
 }
 
+static enum xprt_stat
+svc_dg_rendezvous(SVCXPRT *xprt)
+{
+	struct svc_dg_xprt *su = NULL;
+	enum xprt_stat stat;
+	ssize_t rlen;
+	u_int replies = 0;
+	int flags = 0;
+	bool uring = false;
+#if defined(TIRPC_URING)
+	struct svc_dg_xprt *req_su = su_data(xprt);
+	uint8_t op;
+	int32_t res;
+
+	uring = svc_rqst_uring_done(xprt, &op, &res);
+	if (uring) {
+		su = req_su->su_next;
+		req_su->su_next = NULL;
+	}
+	if (uring && op == IORING_OP_RECVMSG) {
+		if (unlikely(res == -EINTR || res == -EAGAIN)) {
+			/* try again with the same transport */
+			req_su->su_next = su;
+			(void)svc_rqst_uring_prep(xprt, IORING_OP_RECVMSG,
+						  &su->su_msghdr, 0);
+			if (unlikely(svc_rqst_rearm_events(xprt)))
+				return (XPRT_DIED);
+			return (XPRT_IDLE);
+		}
+		rlen = res;
+		if (rlen < 0)
+			errno = -res;
+		return (svc_dg_rendezvous_recvd(xprt, su, rlen, uring,
+						&replies));
+	}
+	if (uring) {
+		/* prepared recvmsg was not submitted, may be nothing */
+		flags = MSG_DONTWAIT;
+	}
+#endif
+
+	/* io_uring receives one datagram per completion */
+	if (!uring && __svc_params->xprt_u.dg.recv_max > 1)
+		return (svc_dg_rendezvous_batch(xprt));
+
+	if (!su)
+		su = svc_dg_rendezvous_su(xprt);
+
+	for (;;) {
+		rlen = recvmsg(xprt->xp_fd, &su->su_msghdr, flags);
+		if (rlen == -1 && errno == EINTR)
+			continue;
+
+		stat = svc_dg_rendezvous_recvd(xprt, su, rlen, uring,
+					       &replies);
+		if (stat != XPRT_MOREREQS)
+			return (stat);
+		flags = MSG_DONTWAIT;
+	}
+}
+
 static enum xprt_stat
 svc_dg_recv(SVCXPRT *xprt)
 {
@@ -361,6 +862,7 @@ svc_dg_reply(struct svc_req *req)
 	XDR *xdrs = rec->ioq.xdrs;
 	struct svc_dg_xprt *su = DG_DR(rec);
 	struct msghdr *msg = &su->su_msghdr;
+	struct svc_dg_sendq *sq = svc_dg_sendq_self;
 	struct iovec iov;
 	size_t slen;
 
@@ -397,6 +899,16 @@ svc_dg_reply(struct svc_req *req)
 	msg->msg_namelen = xprt->xp_remote.nb.len;
 	/* cmsg already set in svc_dg_rendezvous */
 
+	if (sq && sq->xprt == xprt->xp_parent && sq->n < SVC_DG_RECV_MAX) {
+		/* sent with the rest of its batch */
+		su->su_iov = iov;
+		msg->msg_iov = &su->su_iov;
+		sq->mmsg[sq->n].msg_hdr = *msg;
+		SVC_REF(xprt, SVC_REF_FLAG_NONE);
+		sq->held[sq->n++] = xprt;
+		return (XPRT_IDLE);
+	}
+
 	if (sendmsg(xprt->xp_fd, msg, 0) != (ssize_t) slen) {
 		__warnx(TIRPC_DEBUG_FLAG_ERROR,
 			"%s: %p fd %d sendmsg failed (will set dead)",
@@ -427,8 +939,13 @@ svc_dg_destroy_task(struct work_pool_entry *wpe)
 	if (rec->xprt.xp_netid)
 		mem_free(rec->xprt.xp_netid, 0);
 
-	if (rec->xprt.xp_parent)
-		SVC_RELEASE(rec->xprt.xp_parent, SVC_RELEASE_FLAG_NONE);
+	if (rec->xprt.xp_parent) {
+		SVCXPRT *parent = rec->xprt.xp_parent;
+
+		svc_dg_xprt_recycle(parent, DG_DR(rec));
+		SVC_RELEASE(parent, SVC_RELEASE_FLAG_NONE);
+		return;
+	}
 
 	svc_dg_xprt_free(DG_DR(rec));
 }
@@ -52,6 +52,7 @@
 
 #include "rpc_com.h"
 #include <rpc/svc.h>
+#include <rpc/svc_rqst.h>
 
 extern int __svc_vc_setflag(SVCXPRT *, int);
 
@@ -305,3 +306,91 @@ svc_tli_ncreate(int fd,	/* Connection end point */
 	}
 	return (NULL);
 }
+
+/*
+ * Each listener binds the same address with SO_REUSEPORT, and runs on a
+ * new event channel (with its cpu hint), so accepts and receives proceed
+ * in parallel.  The channels have SVC_RQST_FLAG_CHAN_AFFINITY: accepted
+ * connections are registered on the channel of their listener.
+ */
+u_int
+svc_reuseport_ncreate(const struct svc_reuseport *rp, SVCXPRT **xprts)
+{
+#if defined(SO_REUSEPORT)
+	struct sockaddr_storage ss;
+	socklen_t slen = rp->addrlen;
+	SVCXPRT *xprt;
+	uint32_t chan;
+	u_int n;
+	int one = 1;
+	int fd;
+
+	if (rp->addrlen > sizeof(ss) || !rp->rendezvous_cb
+	 || (rp->type != SOCK_STREAM && rp->type != SOCK_DGRAM)) {
+		__warnx(TIRPC_DEBUG_FLAG_ERROR,
+			"%s: invalid parameters", __func__);
+		return (0);
+	}
+	memcpy(&ss, rp->addr, rp->addrlen);
+
+	for (n = 0; n < rp->count; n++) {
+		fd = socket(ss.ss_family, rp->type, 0);
+		if (fd < 0) {
+			__warnx(TIRPC_DEBUG_FLAG_ERROR,
+				"%s: socket failed (%d)", __func__, errno);
+			break;
+		}
+		if (setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &one,
+			       sizeof(one)) < 0
+		 || bind(fd, (struct sockaddr *)&ss, slen) < 0
+		 || (rp->type == SOCK_STREAM
+		  && listen(fd, rp->backlog ? rp->backlog : SOMAXCONN) < 0)) {
+			__warnx(TIRPC_DEBUG_FLAG_ERROR,
+				"%s: fd %d listener %u failed (%d)",
+				__func__, fd, n, errno);
+			close(fd);
+			break;
+		}
+		if (!n) {
+			/* the others bind the port chosen here */
+			slen = sizeof(ss);
+			if (getsockname(fd, (struct sockaddr *)&ss, &slen) < 0) {
+				close(fd);
+				break;
+			}
+		}
+
+		if (rp->type == SOCK_STREAM)
+			xprt = svc_vc_ncreatef(fd, rp->sendsz, rp->recvsz,
+					       SVC_CREATE_FLAG_CLOSE
+					     | SVC_CREATE_FLAG_XPRT_NOREG);
+		else
+			xprt = svc_dg_ncreatef(fd, rp->sendsz, rp->recvsz,
+					       SVC_CREATE_FLAG_CLOSE
+					     | SVC_CREATE_FLAG_XPRT_NOREG);
+		if (!xprt) {
+			close(fd);
+			break;
+		}
+		xprt->xp_dispatch.rendezvous_cb = rp->rendezvous_cb;
+
+		if (svc_rqst_new_evchan_cpu(&chan, NULL, rp->chan_flags
+					    | SVC_RQST_FLAG_CHAN_AFFINITY,
+					    rp->cpus ? rp->cpus[n] : -1)
+		 || svc_rqst_evchan_reg(chan, xprt,
+					SVC_RQST_FLAG_XPRT_UREG)) {
+			__warnx(TIRPC_DEBUG_FLAG_ERROR,
+				"%s: fd %d listener %u not registered",
+				__func__, fd, n);
+			SVC_DESTROY(xprt);
+			break;
+		}
+		xprts[n] = xprt;
+	}
+	return (n);
+#else
+	__warnx(TIRPC_DEBUG_FLAG_ERROR,
+		"%s: SO_REUSEPORT not supported", __func__);
+	return (0);
+#endif
+}
@@ -29,6 +29,9 @@
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <misc/os_epoll.h>
+#if defined(TIRPC_URING)
+#include <linux/io_uring.h>
+#endif
 #include <rpc/rpc_msg.h>
 
 #include "rpc_dplx_internal.h"
@@ -48,6 +51,7 @@ struct svc_params {
 		struct {
 			uint32_t id;
 			uint32_t max_events;
+			uint32_t max_inline;
 		} evchan;
 		struct {
 			fd_set set;	/* select/fd_set (currently unhooked) */
@@ -57,11 +61,16 @@ struct svc_params {
 	svc_xprt_fun_t disconnect_cb;
 	svc_xprt_xdr_fun_t request_cb;
 
-	union {
+	struct {
 		struct {
 			mutex_t mtx;
 			u_int nconns;
+			u_int recv_max;	/* requests per event (fairness) */
 		} vc;
+		struct {
+			u_int recv_max;	/* datagrams per event, 1: recvmsg() */
+			u_int pool_max;	/* idle request xprts per socket */
+		} dg;
 	} xprt_u;
 
 	struct {
@@ -73,6 +82,7 @@ struct svc_params {
 
 	struct {
 		u_int send_max;
+		u_int queue_max;	/* reply bytes queued per transport */
 		u_int thrd_max;
 	} ioq;
 
@@ -142,6 +152,13 @@ struct svc_dg_xprt {
 	struct rpc_dplx_rec su_dr;	/* SVCXPRT indexed by fd */
 	struct msghdr su_msghdr;	/* msghdr received from clnt */
 	unsigned char su_cmsg[SVC_CMSG_SIZE];	/* cmsghdr received from clnt */
+	struct iovec su_iov;		/* received datagram */
+#if defined(TIRPC_URING)
+	struct svc_dg_xprt *su_next;	/* rendezvous IORING_OP_RECVMSG */
+#endif
+	struct svc_dg_xprt **su_ring;	/* rendezvous recvmmsg() buffers */
+	u_int su_ring_max;
+	struct poolq_head su_pool;	/* rendezvous idle request xprts */
 };
 #define DG_DR(p) (opr_containerof((p), struct svc_dg_xprt, su_dr))
 #define su_data(xprt) (DG_DR(REC_XPRT(xprt)))
@@ -156,6 +173,12 @@ struct svc_dg_xprt {
 struct svc_vc_xprt {
 	struct rpc_dplx_rec sx_dr;	/* SVCXPRT indexed by fd */
 	int32_t sx_fbtbc;		/* fragment bytes to be consumed */
+	struct {
+		char *base;		/* read-ahead buffer */
+		u_int head;		/* consumed */
+		u_int tail;		/* received */
+		bool direct;		/* receiving into fragment */
+	} sx_ra;
 };
 #define VC_DR(p) (opr_containerof((p), struct svc_vc_xprt, sx_dr))
 
@@ -192,7 +215,15 @@ svc_override_ops(struct xp_ops *ops, SVCXPRT *rendezvous)
 }
 
 int svc_rqst_rearm_events(SVCXPRT *);
+int svc_rqst_rearm_drained(SVCXPRT *);
+int svc_rqst_rearm_buffered(SVCXPRT *);
+int svc_rqst_rearm_output(SVCXPRT *);
+#if defined(TIRPC_URING)
+bool svc_rqst_uring_prep(SVCXPRT *, uint8_t, void *, uint32_t);
+bool svc_rqst_uring_done(SVCXPRT *, uint8_t *, int32_t *);
+#endif
 int svc_rqst_xprt_register(SVCXPRT *, SVCXPRT *);
 void svc_rqst_xprt_unregister(SVCXPRT *);
+void svc_rqst_xprt_wakeup(SVCXPRT *);
 
 #endif				/* TIRPC_SVC_INTERNAL_H */
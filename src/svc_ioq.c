@@ -34,6 +34,9 @@
 #include <sys/uio.h>
 #include <netinet/in.h>
 #include <netinet/tcp.h>
+#if defined(MSG_ZEROCOPY)
+#include <linux/errqueue.h>
+#endif
 
 #include <assert.h>
 #include <err.h>
@@ -65,230 +68,753 @@
 #include <misc/opr.h>
 #include "svc_ioq.h"
 
-/* Queue per interface, determined per transport socket.
+/* Output scheduler.
  *
- * Ideally, these would be some variant of weighted fair queuing.  Currently,
- * assuming supplied by underlying OS.
+ * Each transport has its own output queue (rec->out.q), written in order
+ * by its owner: the thread queuing the first reply, or later the event
+ * (or scheduler) task that continues it.  Replies to different transports
+ * are written in parallel.
  *
- * The assigned thread should have affinity for the interface.  Therefore, the
- * first thread arriving for each interface is used for all subsequent work,
- * until the interface is idle.  This assumes that the output interface is
- * closely associated with the input interface.
- *
- * Note that this is a static fixed size list of interfaces.  In most cases,
- * many of these entries will be unused.
- *
- * For efficiency, a mask is applied to the ifindex, possibly causing overlap of
- * multiple interfaces.  The size is selected to be larger than expected number
- * of concurrently active interfaces.  Size must be a power of 2 for mask.
+ * An owner writes a quantum per turn (deficit round robin).  Transports
+ * with more output rotate through the ready queue, served by at most
+ * SVC_IOQ_SCHED_TASKS writer tasks, so that one large or busy transport
+ * does not monopolize the writer.
  */
-#define IOQ_IF_SIZE (16)
-#define IOQ_IF_MASK (IOQ_IF_SIZE - 1)
-struct poolq_head ioq_ifqh[IOQ_IF_SIZE];
+#define SVC_IOQ_QUANTUM (64 * 1024)
+
+static struct svc_ioq_sched {
+	struct poolq_head_s ready;	/* transports, by out.wpe.pqe */
+	mutex_t mtx;
+	u_int tasks;		/* writer tasks running */
+	u_int max_tasks;
+} svc_ioq_sched;
 
 void
 svc_ioq_init(void)
 {
-	struct poolq_head *ifph = &ioq_ifqh[0];
-	int i = 0;
+	long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
 
-	for (; i < IOQ_IF_SIZE; ifph++, i++) {
-		ifph->qcount = 0;
-		TAILQ_INIT(&ifph->qh);
-		mutex_init(&ifph->qmutex, NULL);
-	}
+	TAILQ_INIT(&svc_ioq_sched.ready);
+	mutex_init(&svc_ioq_sched.mtx, NULL);
+	svc_ioq_sched.max_tasks = (ncpu > 0) ? ncpu : 1;
 }
 
 #define LAST_FRAG ((u_int32_t)(1 << 31))
 #define MAXALLOCA (256)
 
+#if defined(MSG_ZEROCOPY)
+/* milliseconds to wait for completions on destroy */
+#define SVC_IOQ_ZEROCOPY_DRAIN_MS 1000
+
+/*
+ * Release replies sent with MSG_ZEROCOPY, as their completions arrive
+ * on the socket error queue (signalled by EPOLLERR until drained).
+ *
+ * TCP completes in order, so each notification covers every earlier id.
+ */
+void
+svc_ioq_zerocopy_reap(SVCXPRT *xprt)
+{
+	struct rpc_dplx_rec *rec = REC_XPRT(xprt);
+	struct poolq_head_s done;
+	struct poolq_entry *have;
+	struct sock_extended_err *serr;
+	struct cmsghdr *cm;
+	struct msghdr msg;
+	char control[CMSG_SPACE(sizeof(*serr)) + 64];
+
+	TAILQ_INIT(&done);
+	mutex_lock(&rec->zc.mtx);
+
+	for (;;) {
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_control = control;
+		msg.msg_controllen = sizeof(control);
+
+		if (recvmsg(xprt->xp_fd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0)
+			break;
+
+		cm = CMSG_FIRSTHDR(&msg);
+		if (!cm)
+			continue;
+
+		serr = (struct sock_extended_err *)CMSG_DATA(cm);
+		if (serr->ee_origin != SO_EE_ORIGIN_ZEROCOPY
+		 || serr->ee_errno != 0)
+			continue;
+
+		__warnx(TIRPC_DEBUG_FLAG_SVC_VC,
+			"%s: %p fd %d completed %" PRIu32 "..%" PRIu32 "%s",
+			__func__, xprt, xprt->xp_fd, serr->ee_info,
+			serr->ee_data,
+			(serr->ee_code & SO_EE_CODE_ZEROCOPY_COPIED)
+			? " (copied)" : "");
+
+		if ((int32_t)(serr->ee_data + 1 - rec->zc.done) > 0)
+			rec->zc.done = serr->ee_data + 1;
+	}
+
+	/* may have completed before being held */
+	while ((have = TAILQ_FIRST(&rec->zc.pending))
+	    && (int32_t)(_IOQ(have)->zc_id - rec->zc.done) < 0) {
+		TAILQ_REMOVE(&rec->zc.pending, have, q);
+		TAILQ_INSERT_TAIL(&done, have, q);
+	}
+	mutex_unlock(&rec->zc.mtx);
+
+	while ((have = TAILQ_FIRST(&done))) {
+		TAILQ_REMOVE(&done, have, q);
+		XDR_DESTROY(_IOQ(have)->xdrs);
+	}
+}
+
+/*
+ * The transport is being destroyed, and its socket shut down.  Reap
+ * completions without waiting; false while some are outstanding, for
+ * the caller to try again later.  After SVC_IOQ_ZEROCOPY_DRAIN_MS,
+ * buffers that are still pinned are leaked:  the kernel may yet send
+ * from them, so they must never return to the buffer pool.
+ */
+bool
+svc_ioq_zerocopy_drain(SVCXPRT *xprt)
+{
+	struct rpc_dplx_rec *rec = REC_XPRT(xprt);
+	struct poolq_entry *have;
+	struct timespec now;
+	uint32_t leaked = 0;
+
+	svc_ioq_zerocopy_reap(xprt);
+	if (TAILQ_EMPTY(&rec->zc.pending))
+		return (true);
+
+	(void)clock_gettime(CLOCK_MONOTONIC_FAST, &now);
+	if (!rec->zc.linger.tv_sec) {
+		rec->zc.linger = now;
+		timespec_addms(&rec->zc.linger, SVC_IOQ_ZEROCOPY_DRAIN_MS);
+		return (false);
+	}
+	if (timespeccmp(&now, &rec->zc.linger, <))
+		return (false);
+
+	mutex_lock(&rec->zc.mtx);
+	while ((have = TAILQ_FIRST(&rec->zc.pending))) {
+		TAILQ_REMOVE(&rec->zc.pending, have, q);
+		leaked++;
+	}
+	mutex_unlock(&rec->zc.mtx);
+
+	__warnx(TIRPC_DEBUG_FLAG_WARN,
+		"%s: %p fd %d %" PRIu32 " replies not completed, leaked",
+		__func__, xprt, xprt->xp_fd, leaked);
+	return (true);
+}
+
+/*
+ * Hold the buffers until the last MSG_ZEROCOPY send (zc_id) is done.
+ */
 static inline void
-svc_ioq_flushv(SVCXPRT *xprt, struct xdr_ioq *xioq)
+svc_ioq_zerocopy_hold(SVCXPRT *xprt, struct xdr_ioq *xioq)
+{
+	struct rpc_dplx_rec *rec = REC_XPRT(xprt);
+
+	mutex_lock(&rec->zc.mtx);
+	TAILQ_INSERT_TAIL(&rec->zc.pending, &xioq->ioq_s, q);
+	mutex_unlock(&rec->zc.mtx);
+
+	svc_ioq_zerocopy_reap(xprt);
+}
+#endif /* MSG_ZEROCOPY */
+
+static inline uint32_t
+svc_ioq_length(struct xdr_ioq *xioq)
+{
+	struct poolq_entry *have;
+	uint32_t bytes = 0;
+
+	TAILQ_FOREACH(have, &(xioq->ioq_uv.uvqh.qh), q) {
+		bytes += ioquv_length(IOQ_(have));
+	}
+	return (bytes);
+}
+
+static inline bool
+svc_ioq_is_mark(struct iovec *iov, uint32_t *hdr, u_int nhdr)
+{
+	return ((char *)iov->iov_base >= (char *)hdr
+		&& (char *)iov->iov_base < (char *)(hdr + nhdr));
+}
+
+/*
+ * Build a single vector, with a record mark before each fragment.
+ * Fragments are limited to __svc_maxiov (including the record mark).
+ * A batch (IOQ_FLAG_RECORDS) already carries its record marks.
+ *
+ * Returns the iov count.
+ */
+static u_int
+svc_ioq_iov(struct xdr_ioq *xioq, struct iovec *iov, uint32_t *hdr,
+	    u_int *nhdr, uint32_t *bytes)
 {
-	struct iovec *iov, *tiov, *wiov;
 	struct poolq_entry *have;
 	struct xdr_ioq_uv *data;
+	uint32_t fbytes = 0;
+	u_int fiov = 0;
+	u_int ix = 0;
+	u_int nh = 0;
+	u_int len;
+
+	if (xioq->ioq_s.qflags & IOQ_FLAG_RECORDS) {
+		TAILQ_FOREACH(have, &(xioq->ioq_uv.uvqh.qh), q) {
+			data = IOQ_(have);
+			iov[ix].iov_base = data->v.vio_head;
+			iov[ix++].iov_len = ioquv_length(data);
+			*bytes += ioquv_length(data);
+		}
+		*nhdr = 0;
+		return (ix);
+	}
+
+	TAILQ_FOREACH(have, &(xioq->ioq_uv.uvqh.qh), q) {
+		data = IOQ_(have);
+		len = ioquv_length(data);
+
+		/* check for fragment value overflow */
+		/* never happens, see ganesha FSAL_MAXIOSIZE */
+		if (!nh || fiov >= __svc_maxiov || fbytes + len >= LAST_FRAG) {
+			if (nh)
+				hdr[nh - 1] = htonl(fbytes);
+			iov[ix].iov_base = &hdr[nh++];
+			iov[ix++].iov_len = sizeof(uint32_t);
+			*bytes += sizeof(uint32_t);
+			fbytes = 0;
+			fiov = 1;
+		}
+		iov[ix].iov_base = data->v.vio_head;
+		iov[ix++].iov_len = len;
+		*bytes += len;
+		fbytes += len;
+		fiov++;
+	}
+	if (nh)
+		hdr[nh - 1] = htonl(fbytes | LAST_FRAG);
+
+	*nhdr = nh;
+	return (ix);
+}
+
+/*
+ * Never blocks.  Advances *iw past the written iov (partial iov adjusted).
+ *
+ * Returns 0 when all written, EAGAIN when the socket is full, otherwise
+ * the error.
+ */
+static int
+svc_ioq_sendv(SVCXPRT *xprt, struct xdr_ioq *xioq, struct iovec *iov,
+	      uint32_t *hdr, u_int nhdr, u_int *iw, u_int ix)
+{
+	struct msghdr msg;
+	struct iovec *tiov;
 	ssize_t result;
-	u_int32_t frag_header;
-	u_int32_t fbytes;
-	u_int32_t remaining = 0;
-	u_int32_t vsize = (xioq->ioq_uv.uvqh.qcount + 1) * sizeof(struct iovec);
-	int iw = 0;
-	int ix = 1;
+	u_int n;
+	int flags;
+#if defined(MSG_ZEROCOPY)
+	struct rpc_dplx_rec *rec = REC_XPRT(xprt);
+	u_int k;
+#endif
+
+	memset(&msg, 0, sizeof(msg));
+
+	while (*iw < ix) {
+		tiov = &iov[*iw];
+		n = MIN(ix - *iw, (u_int)__svc_maxiov);
+		flags = MSG_DONTWAIT | MSG_NOSIGNAL;
+
+#if defined(MSG_ZEROCOPY)
+		if (rec->out.flags & RPC_DPLX_OUT_ZEROCOPY) {
+			if (svc_ioq_is_mark(tiov, hdr, nhdr)) {
+				/* record mark is not pinned, always copied */
+				n = 1;
+				flags |= MSG_MORE;
+			} else {
+				/* data, up to the next record mark */
+				for (k = 1; k < n; k++) {
+					if (svc_ioq_is_mark(&tiov[k], hdr,
+							    nhdr))
+						break;
+				}
+				n = k;
+				flags |= MSG_ZEROCOPY;
+
+				/* id is taken first, completion may be
+				 * reaped before sendmsg() returns.
+				 */
+				xioq->zc_id = rec->zc.next++;
+			}
+		}
+#endif
+		msg.msg_iov = tiov;
+		msg.msg_iovlen = n;
+
+		result = sendmsg(xprt->xp_fd, &msg, flags);
+		if (result < 0) {
+			int code = errno;
+
+#if defined(MSG_ZEROCOPY)
+			if (flags & MSG_ZEROCOPY) {
+				rec->zc.next--;
+				if (code == ENOBUFS) {
+					/* over the locked memory limit */
+					atomic_clear_uint16_t_bits(
+						&rec->out.flags,
+						RPC_DPLX_OUT_ZEROCOPY);
+					continue;
+				}
+			}
+#endif
+			if (code == EINTR)
+				continue;
+			if (code == EWOULDBLOCK)
+				return (EAGAIN);
+			return (code);
+		}
+#if defined(MSG_ZEROCOPY)
+		if (flags & MSG_ZEROCOPY)
+			atomic_set_uint16_t_bits(&rec->out.flags,
+						 RPC_DPLX_OUT_ZEROCOPIED);
+#endif
+
+		for (; *iw < ix; (*iw)++) {
+			tiov = &iov[*iw];
+			if (tiov->iov_len > result) {
+				tiov->iov_len -= result;
+				tiov->iov_base += result;
+				break;
+			}
+			result -= tiov->iov_len;
+		}
+	}
+	return (0);
+}
+
+/*
+ * Keep the unwritten remainder (and its record marks) for the next
+ * output event.
+ */
+static void
+svc_ioq_park(struct rpc_dplx_rec *rec, struct iovec *iov, u_int ix,
+	     uint32_t *hdr, u_int nhdr)
+{
+	u_int iovsz = ix * sizeof(struct iovec) + nhdr * sizeof(uint32_t);
+	struct iovec *piov = mem_alloc(iovsz);
+	uint32_t *phdr = (uint32_t *)(piov + ix);
+	u_int i;
+
+	memcpy(phdr, hdr, nhdr * sizeof(uint32_t));
+	for (i = 0; i < ix; i++) {
+		piov[i] = iov[i];
+		if (svc_ioq_is_mark(&iov[i], hdr, nhdr))
+			piov[i].iov_base = (char *)phdr
+				+ ((char *)iov[i].iov_base - (char *)hdr);
+	}
+
+	rec->out.iov = piov;
+	rec->out.hdr = phdr;
+	rec->out.iovsz = iovsz;
+	rec->out.iw = 0;
+	rec->out.ix = ix;
+	rec->out.nhdr = nhdr;
+}
+
+/*
+ * Returns 0 when written, EAGAIN when the remainder was parked.
+ */
+static int
+svc_ioq_flushv(SVCXPRT *xprt, struct xdr_ioq *xioq)
+{
+	struct rpc_dplx_rec *rec = REC_XPRT(xprt);
+	struct iovec *iov;
+	uint32_t *hdr;
+	uint32_t bytes = 0;
+	u_int qcount = xioq->ioq_uv.uvqh.qcount;
+	u_int vsize = qcount * (2 * sizeof(struct iovec) + sizeof(uint32_t));
+	u_int nhdr;
+	u_int iw = 0;
+	u_int ix;
+	int code;
 
 	if (unlikely(vsize > MAXALLOCA)) {
 		iov = mem_alloc(vsize);
 	} else {
 		iov = alloca(vsize);
 	}
-	wiov = iov; /* position at initial fragment header */
+	hdr = (uint32_t *)(iov + 2 * qcount);
 
-	/* update the most recent data length, just in case */
-	xdr_tail_update(xioq->xdrs);
+	ix = svc_ioq_iov(xioq, iov, hdr, &nhdr, &bytes);
 
-	/* build list after initial fragment header (ix = 1 above) */
-	TAILQ_FOREACH(have, &(xioq->ioq_uv.uvqh.qh), q) {
-		data = IOQ_(have);
-		tiov = iov + ix;
-		tiov->iov_base = data->v.vio_head;
-		tiov->iov_len = ioquv_length(data);
-		remaining += tiov->iov_len;
-		ix++;
+#if defined(MSG_ZEROCOPY)
+	/* large replies only, page pinning has its own overhead */
+	if (rec->zc.min && bytes >= rec->zc.min)
+		atomic_set_uint16_t_bits(&rec->out.flags,
+					 RPC_DPLX_OUT_ZEROCOPY);
+#endif
+
+	code = svc_ioq_sendv(xprt, xioq, iov, hdr, nhdr, &iw, ix);
+	if (code == EAGAIN)
+		svc_ioq_park(rec, &iov[iw], ix - iw, hdr, nhdr);
+
+	if (unlikely(vsize > MAXALLOCA)) {
+		mem_free(iov, vsize);
 	}
+	return (code);
+}
 
-	while (remaining > 0) {
-		if (iw == 0) {
-			/* new fragment header, determine last iov */
-			fbytes = 0;
-			for (tiov = &wiov[++iw];
-			     (tiov < &iov[ix]) && (iw < __svc_maxiov);
-			     ++tiov, ++iw) {
-				fbytes += tiov->iov_len;
-
-				/* check for fragment value overflow */
-				/* never happens, see ganesha FSAL_MAXIOSIZE */
-				if (unlikely(fbytes >= LAST_FRAG)) {
-					fbytes -= tiov->iov_len;
-					break;
-				}
-			} /* for */
+static void svc_ioq_schedule(SVCXPRT *);
+static void svc_ioq_resume(struct work_pool_entry *);
 
-			/* fragment length doesn't include fragment header */
-			if (&wiov[iw] < &iov[ix]) {
-				frag_header = htonl((u_int32_t) (fbytes));
-			} else {
-				frag_header = htonl((u_int32_t) (fbytes | LAST_FRAG));
-			}
-			wiov->iov_base = &(frag_header);
-			wiov->iov_len = sizeof(u_int32_t);
+/*
+ * One turn of the owner of rec->out.q: a quantum (plus any deficit).
+ * When more remains, the transport rotates to the tail of the ready
+ * queue.  When the socket is full, the owner is the next output event,
+ * and this thread moves on.
+ */
+static void
+svc_ioq_turn(SVCXPRT *xprt)
+{
+	struct rpc_dplx_rec *rec = REC_XPRT(xprt);
+	struct poolq_entry *have;
+	struct xdr_ioq *xioq;
+	struct pollfd pfd;
+	uint32_t bytes;
+	uint16_t flags;
+	bool resume;
+	int code;
+
+	rec->out.deficit += SVC_IOQ_QUANTUM;
+
+	mutex_lock(&rec->out.mtx);
+	have = TAILQ_FIRST(&rec->out.q);
+	mutex_unlock(&rec->out.mtx);
+
+	while (have) {
+		if (unlikely(xprt->xp_flags & SVC_XPRT_FLAG_DESTROYED)) {
+			/* queue released with the transport */
+			return;
+		}
+		if (rec->out.deficit <= 0) {
+			/* next turn */
+			svc_ioq_schedule(xprt);
+			return;
+		}
+		xioq = _IOQ(have);
 
-			/* writev return includes fragment header */
-			remaining += sizeof(u_int32_t);
-			fbytes += sizeof(u_int32_t);
+		if (rec->out.iov) {
+			/* remainder, after output event */
+			code = svc_ioq_sendv(xprt, xioq, rec->out.iov,
+					     rec->out.hdr, rec->out.nhdr,
+					     &rec->out.iw, rec->out.ix);
+		} else {
+			code = svc_ioq_flushv(xprt, xioq);
 		}
 
-		/* blocking write */
-		result = writev(xprt->xp_fd, wiov, iw);
-		remaining -= result;
+		if (code == EAGAIN) {
+			__warnx(TIRPC_DEBUG_FLAG_SVC_VC,
+				"%s: %p fd %d output full, %" PRIu32
+				" bytes queued",
+				__func__, xprt, xprt->xp_fd, rec->out.bytes);
 
-		if (result == fbytes) {
-			wiov += iw - 1;
-			iw = 0;
+			/* no credit while waiting */
+			rec->out.deficit = 0;
+			rec->out.waits++;
+
+			rec->out.wpe.fun = svc_ioq_resume;
+			if (!svc_rqst_rearm_output(xprt))
+				return;
+
+			/* not on an event channel, wait here */
+			pfd.fd = xprt->xp_fd;
+			pfd.events = POLLOUT;
+			(void)poll(&pfd, 1, -1);
 			continue;
 		}
-		if (unlikely(result < 0)) {
+		if (unlikely(code)) {
 			__warnx(TIRPC_DEBUG_FLAG_ERROR,
-				"%s() writev failed (%d)\n",
-				__func__, errno);
+				"%s() sendmsg failed (%d)\n",
+				__func__, code);
 			SVC_DESTROY(xprt);
-			break;
+			return;
 		}
-		fbytes -= result;
 
-		/* rare? writev underrun? (assume never overrun) */
-		for (tiov = wiov; iw > 0; ++tiov, --iw) {
-			if (tiov->iov_len > result) {
-				tiov->iov_len -= result;
-				tiov->iov_base += result;
-				wiov = tiov;
-				break;
-			} else {
-				result -= tiov->iov_len;
-			}
-		} /* for */
-	} /* while */
+		if (rec->out.iov) {
+			mem_free(rec->out.iov, rec->out.iovsz);
+			rec->out.iov = NULL;
+		}
+		flags = atomic_postclear_uint16_t_bits(&rec->out.flags,
+						       RPC_DPLX_OUT_ZEROCOPY
+						     | RPC_DPLX_OUT_ZEROCOPIED);
+		bytes = svc_ioq_length(xioq);
+		rec->out.deficit -= bytes;
+
+		mutex_lock(&rec->out.mtx);
+		TAILQ_REMOVE(&rec->out.q, have, q);
+		rec->out.count--;
+		rec->out.bytes -= bytes;
+		resume = (rec->out.flags & RPC_DPLX_OUT_THROTTLED)
+			&& rec->out.bytes < __svc_params->ioq.queue_max / 2;
+		if (resume)
+			atomic_clear_uint16_t_bits(&rec->out.flags,
+						   RPC_DPLX_OUT_THROTTLED);
+		have = TAILQ_FIRST(&rec->out.q);
+		if (!have)
+			rec->out.deficit = 0;
+		mutex_unlock(&rec->out.mtx);
+
+#if defined(MSG_ZEROCOPY)
+		if (flags & RPC_DPLX_OUT_ZEROCOPIED)
+			svc_ioq_zerocopy_hold(xprt, xioq);
+		else
+#endif
+		XDR_DESTROY(xioq->xdrs);
 
-	if (unlikely(vsize > MAXALLOCA)) {
-		mem_free(iov, vsize);
+		if (resume) {
+			/* input waited in svc_ioq_throttle() */
+			(void)svc_rqst_rearm_buffered(xprt);
+		}
 	}
 }
 
+/*
+ * Writer task, until no transports are ready.
+ */
 static void
-svc_ioq_write(SVCXPRT *xprt, struct xdr_ioq *xioq, struct poolq_head *ifph)
+svc_ioq_sched_task(struct work_pool_entry *wpe)
 {
+	struct rpc_dplx_rec *rec;
 	struct poolq_entry *have;
 
 	for (;;) {
-		/* do i/o unlocked */
-		if (svc_work_pool.params.thrd_max
-		 && !(xprt->xp_flags & SVC_XPRT_FLAG_DESTROYED)) {
-			/* all systems are go! */
-			svc_ioq_flushv(xprt, xioq);
+		mutex_lock(&svc_ioq_sched.mtx);
+		have = TAILQ_FIRST(&svc_ioq_sched.ready);
+		if (!have) {
+			svc_ioq_sched.tasks--;
+			mutex_unlock(&svc_ioq_sched.mtx);
+			break;
 		}
-		SVC_RELEASE(xprt, SVC_RELEASE_FLAG_NONE);
-		XDR_DESTROY(xioq->xdrs);
+		TAILQ_REMOVE(&svc_ioq_sched.ready, have, q);
+		mutex_unlock(&svc_ioq_sched.mtx);
 
-		mutex_lock(&ifph->qmutex);
-		if (--(ifph->qcount) == 0)
-			break;
+		rec = opr_containerof(have, struct rpc_dplx_rec, out.wpe.pqe);
+		svc_ioq_turn(&rec->xprt);
+		SVC_RELEASE(&rec->xprt, SVC_RELEASE_FLAG_NONE);
+	}
+	mem_free(wpe, sizeof(*wpe));
+}
+
+/*
+ * The owner continues at the tail of the ready queue (with a transport
+ * reference).
+ */
+static void
+svc_ioq_schedule(SVCXPRT *xprt)
+{
+	struct rpc_dplx_rec *rec = REC_XPRT(xprt);
+	struct work_pool_entry *wpe = NULL;
 
-		have = TAILQ_FIRST(&ifph->qh);
-		TAILQ_REMOVE(&ifph->qh, have, q);
-		mutex_unlock(&ifph->qmutex);
+	SVC_REF(xprt, SVC_REF_FLAG_NONE);
 
-		xioq = _IOQ(have);
-		xprt = (SVCXPRT *)xioq->xdrs[0].x_lib[1];
+	mutex_lock(&svc_ioq_sched.mtx);
+	TAILQ_INSERT_TAIL(&svc_ioq_sched.ready, &rec->out.wpe.pqe, q);
+	if (svc_ioq_sched.tasks < svc_ioq_sched.max_tasks) {
+		svc_ioq_sched.tasks++;
+		wpe = mem_zalloc(sizeof(*wpe));
+	}
+	mutex_unlock(&svc_ioq_sched.mtx);
+
+	if (wpe) {
+		wpe->fun = svc_ioq_sched_task;
+		work_pool_submit(&svc_work_pool, wpe);
 	}
-	mutex_unlock(&ifph->qmutex);
 }
 
+/*
+ * Output event, with a transport reference.
+ */
 static void
-svc_ioq_write_callback(struct work_pool_entry *wpe)
+svc_ioq_resume(struct work_pool_entry *wpe)
+{
+	struct rpc_dplx_rec *rec =
+			opr_containerof(wpe, struct rpc_dplx_rec, out.wpe);
+
+	atomic_clear_uint16_t_bits(&rec->out.flags, RPC_DPLX_OUT_WORKING);
+
+	if (!(rec->xprt.xp_flags & SVC_XPRT_FLAG_DESTROYED))
+		svc_ioq_turn(&rec->xprt);
+
+	SVC_RELEASE(&rec->xprt, SVC_RELEASE_FLAG_NONE);
+}
+
+/*
+ * Replies are written in order.  Returns true when this thread is the
+ * owner (the transport had nothing queued).
+ */
+static inline bool
+svc_ioq_append(SVCXPRT *xprt, struct xdr_ioq *xioq)
 {
-	struct xdr_ioq *xioq = opr_containerof(wpe, struct xdr_ioq, ioq_wpe);
-	SVCXPRT *xprt = (SVCXPRT *)xioq->xdrs[0].x_lib[1];
-	struct poolq_head *ifph = &ioq_ifqh[xprt->xp_ifindex & IOQ_IF_MASK];
+	struct rpc_dplx_rec *rec = REC_XPRT(xprt);
+	bool first;
+
+	/* update the most recent data length, before it is counted */
+	xdr_tail_update(xioq->xdrs);
 
-	svc_ioq_write(xprt, xioq, ifph);
+	mutex_lock(&rec->out.mtx);
+	first = TAILQ_EMPTY(&rec->out.q);
+	TAILQ_INSERT_TAIL(&rec->out.q, &xioq->ioq_s, q);
+	if (++(rec->out.count) > rec->out.max_count)
+		rec->out.max_count = rec->out.count;
+	rec->out.bytes += svc_ioq_length(xioq);
+	mutex_unlock(&rec->out.mtx);
+
+	return (first);
+}
+
+/*
+ * Input waits while the transport has too much output queued.  When
+ * output drains, svc_rqst_rearm_buffered() continues input.
+ *
+ * Returns true when throttled.
+ */
+bool
+svc_ioq_throttle(SVCXPRT *xprt)
+{
+	struct rpc_dplx_rec *rec = REC_XPRT(xprt);
+	bool throttled;
+
+	if (likely(rec->out.bytes < __svc_params->ioq.queue_max))
+		return (false);
+
+	mutex_lock(&rec->out.mtx);
+	throttled = (rec->out.bytes >= __svc_params->ioq.queue_max);
+	if (throttled) {
+		atomic_set_uint16_t_bits(&rec->out.flags,
+					 RPC_DPLX_OUT_THROTTLED);
+		rec->out.throttles++;
+	}
+	mutex_unlock(&rec->out.mtx);
+
+	if (throttled) {
+		__warnx(TIRPC_DEBUG_FLAG_SVC_VC,
+			"%s: %p fd %d input waits, %" PRIu32 " bytes queued",
+			__func__, xprt, xprt->xp_fd, rec->out.bytes);
+	}
+	return (throttled);
 }
 
+void
+svc_ioq_stats(SVCXPRT *xprt, struct svc_outq_stats *stats)
+{
+	struct rpc_dplx_rec *rec = REC_XPRT(xprt);
+
+	mutex_lock(&rec->out.mtx);
+	stats->replies = rec->out.count;
+	stats->bytes = rec->out.bytes;
+	stats->max_replies = rec->out.max_count;
+	stats->waits = rec->out.waits;
+	stats->throttles = rec->out.throttles;
+	mutex_unlock(&rec->out.mtx);
+}
+
+/*
+ * Handle this output request on this (hot) thread, unless another owns
+ * the transport output.
+ */
 void
 svc_ioq_write_now(SVCXPRT *xprt, struct xdr_ioq *xioq)
 {
-	struct poolq_head *ifph = &ioq_ifqh[xprt->xp_ifindex & IOQ_IF_MASK];
+	if (unlikely(!svc_work_pool.params.thrd_max
+		  || (xprt->xp_flags & SVC_XPRT_FLAG_DESTROYED))) {
+		XDR_DESTROY(xioq->xdrs);
+		return;
+	}
 
 	SVC_REF(xprt, SVC_REF_FLAG_NONE);
-	mutex_lock(&ifph->qmutex);
+	if (svc_ioq_append(xprt, xioq))
+		svc_ioq_turn(xprt);
+	SVC_RELEASE(xprt, SVC_RELEASE_FLAG_NONE);
+}
 
-	if ((ifph->qcount)++ > 0) {
-		/* queue additional output requests without task switch */
-		TAILQ_INSERT_TAIL(&ifph->qh, &(xioq->ioq_s), q);
-		mutex_unlock(&ifph->qmutex);
+/*
+ * Queue output without writing on this thread.
+ */
+void
+svc_ioq_write_submit(SVCXPRT *xprt, struct xdr_ioq *xioq)
+{
+	if (unlikely(!svc_work_pool.params.thrd_max
+		  || (xprt->xp_flags & SVC_XPRT_FLAG_DESTROYED))) {
+		XDR_DESTROY(xioq->xdrs);
 		return;
 	}
-	mutex_unlock(&ifph->qmutex);
 
-	/* handle this output request without queuing, then any additional
-	 * output requests without a task switch (using this thread).
-	 */
-	svc_ioq_write(xprt, xioq, ifph);
+	if (svc_ioq_append(xprt, xioq)) {
+		REC_XPRT(xprt)->out.deficit = 0;
+		svc_ioq_schedule(xprt);
+	}
 }
 
 /*
- * Handle rare case of first output followed by heavy traffic that prevents the
- * original thread from continuing for too long.
- *
- * In the more common case, server traffic will already have begun and this
- * will rapidly queue the output and return.
+ * Prepend the record mark for one message, in the headroom of its first
+ * buffer when there is some (see xdr_ioq_reset()), and move its buffers
+ * to the tail of the batch.
+ */
+static void
+svc_ioq_batch_move(struct xdr_ioq *batch, struct xdr_ioq *xioq)
+{
+	struct xdr_ioq_uv *uv = IOQ_(TAILQ_FIRST(&xioq->ioq_uv.uvqh.qh));
+	uint32_t len;
+
+	xdr_tail_update(xioq->xdrs);
+	len = svc_ioq_length(xioq);
+
+	if (uv->v.vio_head - uv->v.vio_base >= sizeof(uint32_t)) {
+		uv->v.vio_head -= sizeof(uint32_t);
+	} else {
+		uv = xdr_ioq_uv_create(sizeof(uint32_t), UIO_FLAG_FREE);
+		uv->v.vio_tail += sizeof(uint32_t);
+		TAILQ_INSERT_HEAD(&xioq->ioq_uv.uvqh.qh, &uv->uvq, q);
+		(xioq->ioq_uv.uvqh.qcount)++;
+	}
+	*(uint32_t *)uv->v.vio_head = htonl(len | LAST_FRAG);
+
+	if (batch == xioq)
+		return;
+
+	TAILQ_CONCAT(&batch->ioq_uv.uvqh.qh, &xioq->ioq_uv.uvqh.qh, q);
+	batch->ioq_uv.uvqh.qcount += xioq->ioq_uv.uvqh.qcount;
+	xioq->ioq_uv.uvqh.qcount = 0;
+	XDR_DESTROY(xioq->xdrs);
+}
+
+/*
+ * Queue the messages on ioqh (emptied) as one output request, so they
+ * are written together.  Each keeps its own record mark.
  */
 void
-svc_ioq_write_submit(SVCXPRT *xprt, struct xdr_ioq *xioq)
+svc_ioq_write_batch(SVCXPRT *xprt, struct poolq_head *ioqh)
 {
-	struct poolq_head *ifph = &ioq_ifqh[xprt->xp_ifindex & IOQ_IF_MASK];
+	struct poolq_entry *have = TAILQ_FIRST(&ioqh->qh);
+	struct xdr_ioq *batch;
 
-	SVC_REF(xprt, SVC_REF_FLAG_NONE);
-	mutex_lock(&ifph->qmutex);
-
-	if ((ifph->qcount)++ > 0) {
-		/* queue additional output requests, they will be handled by
-		 * existing thread without another task switch.
-		 */
-		TAILQ_INSERT_TAIL(&ifph->qh, &(xioq->ioq_s), q);
-		mutex_unlock(&ifph->qmutex);
+	if (!have)
 		return;
+	TAILQ_REMOVE(&ioqh->qh, have, q);
+	batch = _IOQ(have);
+
+	if (--(ioqh->qcount)) {
+		svc_ioq_batch_move(batch, batch);
+		while ((have = TAILQ_FIRST(&ioqh->qh))) {
+			TAILQ_REMOVE(&ioqh->qh, have, q);
+			svc_ioq_batch_move(batch, _IOQ(have));
+		}
+		ioqh->qcount = 0;
+		batch->ioq_s.qflags |= IOQ_FLAG_RECORDS;
 	}
-	mutex_unlock(&ifph->qmutex);
-
-	xioq->ioq_wpe.fun = svc_ioq_write_callback;
-	work_pool_submit(&svc_work_pool, &xioq->ioq_wpe);
+	svc_ioq_write_submit(xprt, batch);
 }
@@ -32,5 +32,12 @@
 void svc_ioq_init(void);
 void svc_ioq_write_now(SVCXPRT *, struct xdr_ioq *);
 void svc_ioq_write_submit(SVCXPRT *, struct xdr_ioq *);
+void svc_ioq_write_batch(SVCXPRT *, struct poolq_head *);
+bool svc_ioq_throttle(SVCXPRT *);
+void svc_ioq_stats(SVCXPRT *, struct svc_outq_stats *);
+#if defined(MSG_ZEROCOPY)
+void svc_ioq_zerocopy_reap(SVCXPRT *);
+bool svc_ioq_zerocopy_drain(SVCXPRT *);
+#endif
 
 #endif				/* SVC_IOQ_H */
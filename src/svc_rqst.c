@@ -36,6 +36,11 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <signal.h>
+#if defined(TIRPC_URING)
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#endif
 
 #include <rpc/types.h>
 #include <misc/portable.h>
@@ -53,6 +58,7 @@
 #include "clnt_internal.h"
 #include "svc_internal.h"
 #include "svc_xprt.h"
+#include "rpc_ctx.h"
 
 /**
  * @file svc_rqst.c
@@ -69,6 +75,7 @@
  */
 
 #define SVC_RQST_TIMEOUT_MS (29 /* seconds (prime) was 120 */ * 1000)
+#define SVC_RQST_OUTPUT (1)	/* tags rec in event data, output event */
 #define SVC_RQST_WAKEUPS (1023)
 
 static uint32_t round_robin;
@@ -81,6 +88,7 @@ struct svc_rqst_rec {
 	uint32_t id_k;		/* chan id */
 	uint32_t refcnt;
 	uint16_t flags;
+	int cpu;		/* channel thread CPU hint, or -1 */
 
 	/*
 	 * union of event processor types
@@ -93,7 +101,29 @@ struct svc_rqst_rec {
 			struct epoll_event ctrl_ev;
 			struct epoll_event *events;
 			u_int max_events;	/* max epoll events */
+			u_int max_inline;	/* events handled inline */
 		} epoll;
+#endif
+#if defined(TIRPC_URING)
+		struct {
+			int ring_fd;
+			mutex_t sq_mtx;		/* submitters */
+			void *ring;		/* IORING_FEAT_SINGLE_MMAP */
+			size_t ring_sz;
+			struct io_uring_sqe *sqes;
+			size_t sqes_sz;
+			uint32_t *sq_head;
+			uint32_t *sq_tail;
+			uint32_t *sq_array;
+			uint32_t sq_mask;
+			uint32_t sq_entries;
+			uint32_t *cq_head;
+			uint32_t *cq_tail;
+			uint32_t cq_mask;
+			struct io_uring_cqe *cqes;
+			u_int max_events;	/* max completions per wakeup */
+			u_int max_inline;	/* events handled inline */
+		} uring;
 #endif
 		struct {
 			fd_set set;	/* select/fd_set (currently unhooked) */
@@ -158,11 +188,322 @@ svc_rqst_lookup_chan(uint32_t chan_id)
 	return (sr_rec);
 }
 
+#if defined(TIRPC_URING)
+/* io_uring user_data, other than struct rpc_dplx_rec */
+#define SVC_RQST_URING_CTRL	0	/* IORING_OP_POLL_ADD on sv[1] */
+#define SVC_RQST_URING_CANCEL	1	/* IORING_OP_ASYNC_CANCEL */
+
+static inline int
+io_uring_setup_wr(unsigned entries, struct io_uring_params *params)
+{
+	return syscall(__NR_io_uring_setup, entries, params);
+}
+
+static inline int
+io_uring_enter_wr(int ring_fd, unsigned to_submit, unsigned min_complete,
+		  unsigned flags, void *arg, size_t argsz)
+{
+	return syscall(__NR_io_uring_enter, ring_fd, to_submit, min_complete,
+		       flags, arg, argsz);
+}
+
+/*
+ * Queue one submission, and enter any not yet consumed by the kernel.
+ *
+ * Returns 0 once entered, the operation will complete.  Otherwise,
+ * returns a negative errno, and the submission has been withdrawn.
+ */
+static int
+svc_rqst_uring_submit(struct svc_rqst_rec *sr_rec, struct io_uring_sqe *sqe)
+{
+	uint32_t head;
+	uint32_t tail;
+	uint32_t ix;
+	int code = 0;
+
+	mutex_lock(&sr_rec->ev_u.uring.sq_mtx);
+	head = atomic_fetch_uint32_t(sr_rec->ev_u.uring.sq_head);
+	tail = *sr_rec->ev_u.uring.sq_tail;
+
+	if (unlikely(tail - head >= sr_rec->ev_u.uring.sq_entries)) {
+		mutex_unlock(&sr_rec->ev_u.uring.sq_mtx);
+		__warnx(TIRPC_DEBUG_FLAG_ERROR,
+			"%s: evchan %d submission queue full",
+			__func__, sr_rec->id_k);
+		return (-EBUSY);
+	}
+
+	ix = tail & sr_rec->ev_u.uring.sq_mask;
+	sr_rec->ev_u.uring.sqes[ix] = *sqe;
+	sr_rec->ev_u.uring.sq_array[ix] = ix;
+	atomic_store_uint32_t(sr_rec->ev_u.uring.sq_tail, ++tail);
+
+	while (io_uring_enter_wr(sr_rec->ev_u.uring.ring_fd, tail - head, 0, 0,
+				 NULL, 0) < 0) {
+		code = errno;
+		if (code != EINTR)
+			break;
+		code = 0;
+	}
+	if (unlikely(code)
+	 && atomic_fetch_uint32_t(sr_rec->ev_u.uring.sq_head) != tail) {
+		/* not consumed, and still last (under sq_mtx) */
+		atomic_store_uint32_t(sr_rec->ev_u.uring.sq_tail, --tail);
+	} else {
+		code = 0;
+	}
+	mutex_unlock(&sr_rec->ev_u.uring.sq_mtx);
+
+	if (unlikely(code)) {
+		__warnx(TIRPC_DEBUG_FLAG_WARN,
+			"%s: evchan %d io_uring_enter failed (%d)",
+			__func__, sr_rec->id_k, code);
+		return (-code);
+	}
+	return (0);
+}
+
+static inline int
+svc_rqst_uring_ctrl(struct svc_rqst_rec *sr_rec)
+{
+	struct io_uring_sqe sqe;
+
+	/* permit wakeup of threads blocked in io_uring_enter */
+	memset(&sqe, 0, sizeof(sqe));
+	sqe.opcode = IORING_OP_POLL_ADD;
+	sqe.fd = sr_rec->sv[1];
+	sqe.poll32_events = POLLIN | POLLRDHUP;
+	sqe.user_data = SVC_RQST_URING_CTRL;
+
+	return svc_rqst_uring_submit(sr_rec, &sqe);
+}
+
+static void
+svc_rqst_uring_destroy(struct svc_rqst_rec *sr_rec)
+{
+	munmap(sr_rec->ev_u.uring.sqes, sr_rec->ev_u.uring.sqes_sz);
+	munmap(sr_rec->ev_u.uring.ring, sr_rec->ev_u.uring.ring_sz);
+	close(sr_rec->ev_u.uring.ring_fd);
+	mutex_destroy(&sr_rec->ev_u.uring.sq_mtx);
+}
+
+static int
+svc_rqst_uring_create(struct svc_rqst_rec *sr_rec)
+{
+	struct io_uring_params params;
+	const uint32_t features = IORING_FEAT_SINGLE_MMAP
+				| IORING_FEAT_NODROP
+				| IORING_FEAT_EXT_ARG;
+	size_t cq_sz;
+	char *ring;
+	int code;
+
+	/* XXX improve this too */
+	sr_rec->ev_u.uring.max_events = __svc_params->ev_u.evchan.max_events;
+	sr_rec->ev_u.uring.max_inline = __svc_params->ev_u.evchan.max_inline;
+
+	memset(&params, 0, sizeof(params));
+	sr_rec->ev_u.uring.ring_fd =
+		io_uring_setup_wr(sr_rec->ev_u.uring.max_events, &params);
+	if (sr_rec->ev_u.uring.ring_fd < 0)
+		return (errno);
+
+	if ((params.features & features) != features) {
+		close(sr_rec->ev_u.uring.ring_fd);
+		return (ENOTSUP);
+	}
+
+	sr_rec->ev_u.uring.ring_sz = params.sq_off.array
+				   + params.sq_entries * sizeof(uint32_t);
+	cq_sz = params.cq_off.cqes
+	      + params.cq_entries * sizeof(struct io_uring_cqe);
+	if (sr_rec->ev_u.uring.ring_sz < cq_sz)
+		sr_rec->ev_u.uring.ring_sz = cq_sz;
+
+	ring = mmap(NULL, sr_rec->ev_u.uring.ring_sz, PROT_READ | PROT_WRITE,
+		    MAP_SHARED | MAP_POPULATE, sr_rec->ev_u.uring.ring_fd,
+		    IORING_OFF_SQ_RING);
+	if (ring == MAP_FAILED) {
+		code = errno;
+		close(sr_rec->ev_u.uring.ring_fd);
+		return (code);
+	}
+
+	sr_rec->ev_u.uring.sqes_sz =
+		params.sq_entries * sizeof(struct io_uring_sqe);
+	sr_rec->ev_u.uring.sqes =
+		mmap(NULL, sr_rec->ev_u.uring.sqes_sz, PROT_READ | PROT_WRITE,
+		     MAP_SHARED | MAP_POPULATE, sr_rec->ev_u.uring.ring_fd,
+		     IORING_OFF_SQES);
+	if (sr_rec->ev_u.uring.sqes == MAP_FAILED) {
+		code = errno;
+		munmap(ring, sr_rec->ev_u.uring.ring_sz);
+		close(sr_rec->ev_u.uring.ring_fd);
+		return (code);
+	}
+
+	sr_rec->ev_u.uring.ring = ring;
+	sr_rec->ev_u.uring.sq_head = (uint32_t *)(ring + params.sq_off.head);
+	sr_rec->ev_u.uring.sq_tail = (uint32_t *)(ring + params.sq_off.tail);
+	sr_rec->ev_u.uring.sq_array = (uint32_t *)(ring + params.sq_off.array);
+	sr_rec->ev_u.uring.sq_mask =
+		*(uint32_t *)(ring + params.sq_off.ring_mask);
+	sr_rec->ev_u.uring.sq_entries = params.sq_entries;
+	sr_rec->ev_u.uring.cq_head = (uint32_t *)(ring + params.cq_off.head);
+	sr_rec->ev_u.uring.cq_tail = (uint32_t *)(ring + params.cq_off.tail);
+	sr_rec->ev_u.uring.cq_mask =
+		*(uint32_t *)(ring + params.cq_off.ring_mask);
+	sr_rec->ev_u.uring.cqes =
+		(struct io_uring_cqe *)(ring + params.cq_off.cqes);
+	mutex_init(&sr_rec->ev_u.uring.sq_mtx, NULL);
+
+	code = -svc_rqst_uring_ctrl(sr_rec);
+	if (code)
+		svc_rqst_uring_destroy(sr_rec);
+	return (code);
+}
+
+/*
+ * SVC_RQST_FLAG_LOCKED, and SVC_XPRT_FLAG_ADDED set
+ *
+ * Submit the operation prepared by the transport (svc_rqst_uring_prep),
+ * or simply wait for input.
+ */
+static int
+svc_rqst_uring_arm(struct rpc_dplx_rec *rec, struct svc_rqst_rec *sr_rec)
+{
+	struct io_uring_sqe sqe;
+
+	memset(&sqe, 0, sizeof(sqe));
+	sqe.opcode = rec->ev_u.uring.prep;
+	sqe.fd = rec->xprt.xp_fd;
+	sqe.user_data = (uintptr_t)rec;
+
+	switch (rec->ev_u.uring.prep) {
+	case IORING_OP_RECV:
+		sqe.addr = (uintptr_t)rec->ev_u.uring.buf;
+		sqe.len = rec->ev_u.uring.len;
+		break;
+	case IORING_OP_RECVMSG:
+		sqe.addr = (uintptr_t)rec->ev_u.uring.buf;	/* msghdr */
+		sqe.len = 1;
+		break;
+	case IORING_OP_ACCEPT:
+	case IORING_OP_NOP:
+		break;
+	default:
+		sqe.opcode = IORING_OP_POLL_ADD;
+		sqe.poll32_events = POLLIN;
+		break;
+	};
+
+	/* next time, unless prepared again */
+	rec->ev_u.uring.prep = IORING_OP_POLL_ADD;
+	rec->ev_u.uring.op = sqe.opcode;
+
+	return svc_rqst_uring_submit(sr_rec, &sqe);
+}
+
+/*
+ * SVC_RQST_FLAG_LOCKED, and SVC_XPRT_FLAG_ADDED cleared
+ *
+ * Caller holds a reference for this completion.
+ */
+static int
+svc_rqst_uring_cancel(struct rpc_dplx_rec *rec, struct svc_rqst_rec *sr_rec,
+		      uintptr_t tag)
+{
+	struct io_uring_sqe sqe;
+
+	memset(&sqe, 0, sizeof(sqe));
+	sqe.opcode = IORING_OP_ASYNC_CANCEL;
+	sqe.fd = -1;
+	sqe.addr = (uintptr_t)rec | tag;
+	sqe.user_data = SVC_RQST_URING_CANCEL;
+
+	return svc_rqst_uring_submit(sr_rec, &sqe);
+}
+
+/*
+ * not locked
+ *
+ * The transport is registered on an io_uring channel: the next event
+ * will be the result of this operation (instead of readiness).
+ *
+ *	IORING_OP_RECV		into buf, len
+ *	IORING_OP_RECVMSG	into msghdr buf
+ *	IORING_OP_ACCEPT	result is the new fd
+ *	IORING_OP_NOP		immediately (data already buffered)
+ */
+bool
+svc_rqst_uring_prep(SVCXPRT *xprt, uint8_t op, void *buf, uint32_t len)
+{
+	struct rpc_dplx_rec *rec = REC_XPRT(xprt);
+	struct svc_rqst_rec *sr_rec = (struct svc_rqst_rec *)rec->ev_p;
+
+	if (!sr_rec || sr_rec->ev_type != SVC_EVENT_URING)
+		return (false);
+
+	rec->ev_u.uring.prep = op;
+	rec->ev_u.uring.buf = buf;
+	rec->ev_u.uring.len = len;
+	return (true);
+}
+
+/*
+ * not locked
+ *
+ * Returns true when registered on an io_uring channel, with the completed
+ * (prepared) operation and its result, otherwise IORING_OP_NOP (readiness).
+ */
+bool
+svc_rqst_uring_done(SVCXPRT *xprt, uint8_t *op, int32_t *res)
+{
+	struct rpc_dplx_rec *rec = REC_XPRT(xprt);
+	struct svc_rqst_rec *sr_rec = (struct svc_rqst_rec *)rec->ev_p;
+
+	if (!sr_rec || sr_rec->ev_type != SVC_EVENT_URING)
+		return (false);
+
+	switch (rec->ev_u.uring.op) {
+	case IORING_OP_RECV:
+	case IORING_OP_RECVMSG:
+	case IORING_OP_ACCEPT:
+		*op = rec->ev_u.uring.op;
+		*res = rec->ev_u.uring.res;
+		break;
+	default:
+		*op = IORING_OP_NOP;
+		*res = 0;
+		break;
+	};
+
+	rec->ev_u.uring.op = IORING_OP_NOP;
+	return (true);
+}
+#endif /* TIRPC_URING */
+
 /* forward declaration in lieu of moving code {WAS} */
 static void svc_rqst_run_task(struct work_pool_entry *);
+static int svc_rqst_run_thread(struct svc_rqst_rec *);
+void svc_rqst_xprt_task(struct work_pool_entry *);
+static void svc_rqst_idle_add(struct rpc_dplx_rec *);
+static void svc_rqst_idle_del(struct rpc_dplx_rec *);
 
 int
 svc_rqst_new_evchan(uint32_t *chan_id /* OUT */, void *u_data, uint32_t flags)
+{
+	return svc_rqst_new_evchan_cpu(chan_id, u_data, flags, -1);
+}
+
+/*
+ * The channel has its own thread on this cpu (when not negative), so the
+ * transports on this channel are polled (and their sockets handled by
+ * the kernel) there.  Ready transports are handled by the work pool.
+ */
+int
+svc_rqst_new_evchan_cpu(uint32_t *chan_id /* OUT */, void *u_data,
+			uint32_t flags, int cpu)
 {
 	struct svc_rqst_rec *sr_rec;
 	uint32_t n_id;
@@ -186,6 +527,9 @@ svc_rqst_new_evchan(uint32_t *chan_id /* OUT */, void *u_data, uint32_t flags)
 		return (0);
 	}
 
+#if defined(TIRPC_URING)
+	if (!(flags & SVC_RQST_FLAG_URING))
+#endif
 	flags |= SVC_RQST_FLAG_EPOLL;	/* XXX */
 
 	/* create a pair of anonymous sockets for async event channel wakeups */
@@ -203,6 +547,23 @@ svc_rqst_new_evchan(uint32_t *chan_id /* OUT */, void *u_data, uint32_t flags)
 	SetNonBlock(sr_rec->sv[0]);
 	SetNonBlock(sr_rec->sv[1]);
 
+#if defined(TIRPC_URING)
+	if (flags & SVC_RQST_FLAG_URING) {
+		sr_rec->ev_type = SVC_EVENT_URING;
+
+		code = svc_rqst_uring_create(sr_rec);
+		if (code) {
+			__warnx(TIRPC_DEBUG_FLAG_ERROR,
+				"%s: io_uring_setup failed (%d)", __func__,
+				code);
+			close(sr_rec->sv[0]);
+			close(sr_rec->sv[1]);
+			++(svc_rqst_set.next_id);
+			mutex_unlock(&svc_rqst_set.mtx);
+			return (code);
+		}
+	} else
+#endif
 #if defined(TIRPC_EPOLL)
 	if (flags & SVC_RQST_FLAG_EPOLL) {
 		sr_rec->ev_type = SVC_EVENT_EPOLL;
@@ -210,6 +571,8 @@ svc_rqst_new_evchan(uint32_t *chan_id /* OUT */, void *u_data, uint32_t flags)
 		/* XXX improve this too */
 		sr_rec->ev_u.epoll.max_events =
 		    __svc_params->ev_u.evchan.max_events;
+		sr_rec->ev_u.epoll.max_inline =
+		    __svc_params->ev_u.evchan.max_inline;
 		sr_rec->ev_u.epoll.events = (struct epoll_event *)
 		    mem_alloc(sr_rec->ev_u.epoll.max_events *
 			      sizeof(struct epoll_event));
@@ -257,12 +620,17 @@ svc_rqst_new_evchan(uint32_t *chan_id /* OUT */, void *u_data, uint32_t flags)
 	sr_rec->id_k = n_id;
 	sr_rec->refcnt = 1;	/* svc_rqst_set ref */
 	sr_rec->flags = flags & SVC_RQST_FLAG_MASK;
+	sr_rec->cpu = cpu;
 
 	if (!code) {
 		sr_rec->refcnt = 2;
 		sr_rec->ev_wpe.fun = svc_rqst_run_task;
 		sr_rec->ev_wpe.arg = u_data;
-		work_pool_submit(&svc_work_pool, &sr_rec->ev_wpe);
+		if (cpu < 0 || svc_rqst_run_thread(sr_rec)) {
+			/* without the hint, in turn on work_pool threads */
+			sr_rec->cpu = -1;
+			work_pool_submit(&svc_work_pool, &sr_rec->ev_wpe);
+		}
 	}
 	mutex_unlock(&svc_rqst_set.mtx);
 
@@ -359,6 +727,21 @@ svc_rqst_unhook_events(struct rpc_dplx_rec *rec, struct svc_rqst_rec *sr_rec)
 		}
 		break;
 	}
+#endif
+#if defined(TIRPC_URING)
+	case SVC_EVENT_URING:
+		code = -svc_rqst_uring_cancel(rec, sr_rec, 0);
+		__warnx(TIRPC_DEBUG_FLAG_SVC_RQST |
+			TIRPC_DEBUG_FLAG_REFCNT,
+			"%s: %p fd %d xp_refs %" PRIu32
+			" sr_rec %p evchan %d refcnt %" PRIu32
+			" ring_fd %d control fd pair (%d:%d) cancel (%d)",
+			__func__, rec, rec->xprt.xp_fd,
+			rec->xprt.xp_refs,
+			sr_rec, sr_rec->id_k, sr_rec->refcnt,
+			sr_rec->ev_u.uring.ring_fd,
+			sr_rec->sv[0], sr_rec->sv[1], code);
+		break;
 #endif
 	default:
 		/* XXX formerly select/fd_set case, now placeholder for new
@@ -369,14 +752,100 @@ svc_rqst_unhook_events(struct rpc_dplx_rec *rec, struct svc_rqst_rec *sr_rec)
 	return (code);
 }
 
+/*
+ * Edge triggered transports are owned by the task that cleared
+ * SVC_XPRT_FLAG_ADDED.  An event arriving while owned only leaves
+ * SVC_XPRT_FLAG_PENDING, handled by svc_rqst_rearm_drained().
+ *
+ * Returns the xp_flags, SVC_XPRT_FLAG_ADDED set when taken.
+ */
+static inline uint16_t
+svc_rqst_edge_take(SVCXPRT *xprt)
+{
+	uint16_t xp_flags = atomic_postclear_uint16_t_bits(&xprt->xp_flags,
+							   SVC_XPRT_FLAG_ADDED);
+
+	if (xp_flags & SVC_XPRT_FLAG_ADDED)
+		return (xp_flags);
+
+	atomic_set_uint16_t_bits(&xprt->xp_flags, SVC_XPRT_FLAG_PENDING);
+
+	/* owner may have released before seeing the pending event */
+	xp_flags = atomic_postclear_uint16_t_bits(&xprt->xp_flags,
+						  SVC_XPRT_FLAG_ADDED);
+	if (xp_flags & SVC_XPRT_FLAG_ADDED)
+		atomic_clear_uint16_t_bits(&xprt->xp_flags,
+					   SVC_XPRT_FLAG_PENDING);
+	return (xp_flags);
+}
+
+/*
+ * Returns true when still owned (event was pending).
+ */
+static inline bool
+svc_rqst_edge_release(SVCXPRT *xprt)
+{
+	atomic_set_uint16_t_bits(&xprt->xp_flags, SVC_XPRT_FLAG_ADDED);
+
+	if (!(atomic_postclear_uint16_t_bits(&xprt->xp_flags,
+					     SVC_XPRT_FLAG_PENDING)
+	      & SVC_XPRT_FLAG_PENDING))
+		return (false);
+
+	/* retake, unless another event already has */
+	return (atomic_postclear_uint16_t_bits(&xprt->xp_flags,
+					       SVC_XPRT_FLAG_ADDED)
+		& SVC_XPRT_FLAG_ADDED);
+}
+
+/*
+ * Instead of waiting for another (edge) event, queue the next recv.
+ * Also used when the transport has buffered data.
+ */
+static inline void
+svc_rqst_edge_dispatch(struct rpc_dplx_rec *rec)
+{
+	SVC_REF(&rec->xprt, SVC_REF_FLAG_NONE);
+
+	if (atomic_postset_uint16_t_bits(&rec->ioq.ioq_s.qflags,
+					 IOQ_FLAG_WORKING)
+	    & IOQ_FLAG_WORKING) {
+		/* destroying */
+		SVC_RELEASE(&rec->xprt, SVC_RELEASE_FLAG_NONE);
+		return;
+	}
+
+	__warnx(TIRPC_DEBUG_FLAG_SVC_RQST,
+		"%s: %p fd %d edge dispatch",
+		__func__, rec, rec->xprt.xp_fd);
+
+	rec->ioq.ioq_wpe.fun = svc_rqst_xprt_task;
+	work_pool_submit(&svc_work_pool, &(rec->ioq.ioq_wpe));
+}
+
+static inline bool
+svc_rqst_is_edge(struct rpc_dplx_rec *rec, struct svc_rqst_rec *sr_rec)
+{
+#if defined(TIRPC_EPOLL)
+	return (sr_rec->ev_type == SVC_EVENT_EPOLL
+		&& (rec->ev_u.epoll.event.events & EPOLLET));
+#else
+	return (false);
+#endif
+}
+
 /*
  * not locked
+ *
+ * More data may remain.  Edge triggered transports queue another recv
+ * (without any system call).
  */
 int
 svc_rqst_rearm_events(SVCXPRT *xprt)
 {
 	struct rpc_dplx_rec *rec = REC_XPRT(xprt);
 	struct svc_rqst_rec *sr_rec = (struct svc_rqst_rec *)rec->ev_p;
+	bool fallback = false;
 	int code = EINVAL;
 
 	if (xprt->xp_flags & (SVC_XPRT_FLAG_ADDED | SVC_XPRT_FLAG_DESTROYED))
@@ -386,6 +855,14 @@ svc_rqst_rearm_events(SVCXPRT *xprt)
 	if (sr_rec->flags & SVC_RQST_FLAG_SHUTDOWN)
 		return (0);
 
+	if (svc_rqst_is_edge(rec, sr_rec)) {
+		/* still owned, about to recv anyway */
+		atomic_clear_uint16_t_bits(&xprt->xp_flags,
+					   SVC_XPRT_FLAG_PENDING);
+		svc_rqst_edge_dispatch(rec);
+		return (0);
+	}
+
 	rpc_dplx_rli(rec);
 
 	/* assuming success */
@@ -430,6 +907,37 @@ svc_rqst_rearm_events(SVCXPRT *xprt)
 		}
 		break;
 	}
+#endif
+#if defined(TIRPC_URING)
+	case SVC_EVENT_URING:
+		code = -svc_rqst_uring_arm(rec, sr_rec);
+		if (code && rec->ev_u.uring.op != IORING_OP_POLL_ADD) {
+			/* prepared operation was not submitted, the
+			 * transport receives for itself (as with epoll).
+			 */
+			atomic_clear_uint16_t_bits(&xprt->xp_flags,
+						   SVC_XPRT_FLAG_ADDED);
+			__warnx(TIRPC_DEBUG_FLAG_WARN,
+				"%s: %p fd %d evchan %d op %d failed (%d), recv",
+				__func__, rec, rec->xprt.xp_fd,
+				sr_rec->id_k, rec->ev_u.uring.op, code);
+			rec->ev_u.uring.op = IORING_OP_NOP;
+			fallback = true;
+			code = 0;
+		} else if (code) {
+			atomic_clear_uint16_t_bits(&xprt->xp_flags,
+						   SVC_XPRT_FLAG_ADDED);
+			__warnx(TIRPC_DEBUG_FLAG_ERROR,
+				"%s: %p fd %d xp_refs %" PRIu32
+				" sr_rec %p evchan %d refcnt %" PRIu32
+				" ring_fd %d control fd pair (%d:%d) rearm failed (%d)",
+				__func__, rec, rec->xprt.xp_fd,
+				rec->xprt.xp_refs,
+				sr_rec, sr_rec->id_k, sr_rec->refcnt,
+				sr_rec->ev_u.uring.ring_fd,
+				sr_rec->sv[0], sr_rec->sv[1], code);
+		}
+		break;
 #endif
 	default:
 		/* XXX formerly select/fd_set case, now placeholder for new
@@ -439,9 +947,64 @@ svc_rqst_rearm_events(SVCXPRT *xprt)
 
 	rpc_dplx_rui(rec);
 
+	if (fallback)
+		svc_rqst_edge_dispatch(rec);
+
 	return (code);
 }
 
+/*
+ * not locked
+ *
+ * Recv found no more data (EAGAIN or short read).
+ */
+int
+svc_rqst_rearm_drained(SVCXPRT *xprt)
+{
+	struct rpc_dplx_rec *rec = REC_XPRT(xprt);
+	struct svc_rqst_rec *sr_rec = (struct svc_rqst_rec *)rec->ev_p;
+
+	if (xprt->xp_flags & (SVC_XPRT_FLAG_ADDED | SVC_XPRT_FLAG_DESTROYED))
+		return (0);
+
+	/* MUST follow the destroyed check above */
+	if (sr_rec->flags & SVC_RQST_FLAG_SHUTDOWN)
+		return (0);
+
+	if (!svc_rqst_is_edge(rec, sr_rec))
+		return svc_rqst_rearm_events(xprt);
+
+	if (svc_rqst_edge_release(xprt))
+		svc_rqst_edge_dispatch(rec);
+
+	return (0);
+}
+
+/*
+ * not locked
+ *
+ * The transport has already buffered more data.  Still owned, queue the
+ * next recv without any system call.
+ */
+int
+svc_rqst_rearm_buffered(SVCXPRT *xprt)
+{
+	struct rpc_dplx_rec *rec = REC_XPRT(xprt);
+	struct svc_rqst_rec *sr_rec = (struct svc_rqst_rec *)rec->ev_p;
+
+	if (xprt->xp_flags & (SVC_XPRT_FLAG_ADDED | SVC_XPRT_FLAG_DESTROYED))
+		return (0);
+
+	/* MUST follow the destroyed check above */
+	if (sr_rec->flags & SVC_RQST_FLAG_SHUTDOWN)
+		return (0);
+
+	/* about to recv anyway */
+	atomic_clear_uint16_t_bits(&xprt->xp_flags, SVC_XPRT_FLAG_PENDING);
+	svc_rqst_edge_dispatch(rec);
+	return (0);
+}
+
 /*
  * SVC_RQST_FLAG_LOCKED, and SVC_XPRT_FLAG_ADDED set
  */
@@ -458,9 +1021,16 @@ svc_rqst_hook_events(struct rpc_dplx_rec *rec, struct svc_rqst_rec *sr_rec)
 
 		/* set up epoll user data */
 		ev->data.ptr = rec;
+		rec->ev_u.epoll.out_fd = -1;
 
-		/* wait for read events, level triggered, oneshot */
-		ev->events = EPOLLIN | EPOLLONESHOT;
+		if ((sr_rec->flags & SVC_RQST_FLAG_EDGE)
+		 && (rec->xprt.xp_flags & SVC_XPRT_FLAG_EDGE)) {
+			/* wait for read events, edge triggered */
+			ev->events = EPOLLIN | EPOLLET;
+		} else {
+			/* wait for read events, level triggered, oneshot */
+			ev->events = EPOLLIN | EPOLLONESHOT;
+		}
 
 		/* add to epoll vector */
 		code = epoll_ctl(sr_rec->ev_u.epoll.epoll_fd,
@@ -493,35 +1063,217 @@ svc_rqst_hook_events(struct rpc_dplx_rec *rec, struct svc_rqst_rec *sr_rec)
 		break;
 	}
 #endif
-	default:
-		/* XXX formerly select/fd_set case, now placeholder for new
-		 * event systems, reworked select, etc. */
-		break;
-	}			/* switch */
-
-	ev_sig(sr_rec->sv[0], 0);	/* send wakeup */
-
-	return (code);
-}
+#if defined(TIRPC_URING)
+	case SVC_EVENT_URING:
+		/* wait for input, until the transport prepares more */
+		rec->ev_u.uring.prep = IORING_OP_POLL_ADD;
+		rec->ev_u.uring.op = IORING_OP_NOP;
+
+		code = -svc_rqst_uring_arm(rec, sr_rec);
+		if (code) {
+			atomic_clear_uint16_t_bits(&rec->xprt.xp_flags,
+						   SVC_XPRT_FLAG_ADDED);
+			__warnx(TIRPC_DEBUG_FLAG_ERROR,
+				"%s: %p fd %d xp_refs %" PRIu32
+				" sr_rec %p evchan %d refcnt %" PRIu32
+				" ring_fd %d control fd pair (%d:%d) hook failed (%d)",
+				__func__, rec, rec->xprt.xp_fd,
+				rec->xprt.xp_refs,
+				sr_rec, sr_rec->id_k, sr_rec->refcnt,
+				sr_rec->ev_u.uring.ring_fd,
+				sr_rec->sv[0], sr_rec->sv[1], code);
+		}
+		break;
+#endif
+	default:
+		/* XXX formerly select/fd_set case, now placeholder for new
+		 * event systems, reworked select, etc. */
+		break;
+	}			/* switch */
+
+	ev_sig(sr_rec->sv[0], 0);	/* send wakeup */
+
+	return (code);
+}
 
 /*
  * SVC_RQST_FLAG_LOCKED
+ *
+ * Output is a separate (oneshot) registration, leaving input alone.
  */
-static void
+static int
+svc_rqst_hook_output(struct rpc_dplx_rec *rec, struct svc_rqst_rec *sr_rec)
+{
+	int code = EINVAL;
+
+	/* assuming success */
+	atomic_set_uint16_t_bits(&rec->out.flags, RPC_DPLX_OUT_ARMED);
+
+	switch (sr_rec->ev_type) {
+#if defined(TIRPC_EPOLL)
+	case SVC_EVENT_EPOLL:
+	{
+		struct epoll_event ev;
+		int op = EPOLL_CTL_MOD;
+
+		ev.events = EPOLLOUT | EPOLLONESHOT;
+		ev.data.u64 = (uintptr_t)rec | SVC_RQST_OUTPUT;
+
+		if (rec->ev_u.epoll.out_fd < 0) {
+			/* epoll has one registration per fd */
+			rec->ev_u.epoll.out_fd = dup(rec->xprt.xp_fd);
+			if (rec->ev_u.epoll.out_fd < 0) {
+				code = errno;
+				break;
+			}
+			op = EPOLL_CTL_ADD;
+		}
+
+		code = epoll_ctl(sr_rec->ev_u.epoll.epoll_fd, op,
+				 rec->ev_u.epoll.out_fd, &ev);
+		if (code)
+			code = errno;
+		break;
+	}
+#endif
+#if defined(TIRPC_URING)
+	case SVC_EVENT_URING:
+	{
+		struct io_uring_sqe sqe;
+
+		memset(&sqe, 0, sizeof(sqe));
+		sqe.opcode = IORING_OP_POLL_ADD;
+		sqe.fd = rec->xprt.xp_fd;
+		sqe.poll32_events = POLLOUT;
+		sqe.user_data = (uintptr_t)rec | SVC_RQST_OUTPUT;
+
+		code = -svc_rqst_uring_submit(sr_rec, &sqe);
+		break;
+	}
+#endif
+	default:
+		break;
+	}			/* switch */
+
+	if (code) {
+		atomic_clear_uint16_t_bits(&rec->out.flags,
+					   RPC_DPLX_OUT_ARMED);
+		__warnx(TIRPC_DEBUG_FLAG_ERROR,
+			"%s: %p fd %d sr_rec %p evchan %d output hook failed (%d)",
+			__func__, rec, rec->xprt.xp_fd,
+			sr_rec, sr_rec->id_k, code);
+	} else {
+		__warnx(TIRPC_DEBUG_FLAG_SVC_RQST,
+			"%s: %p fd %d sr_rec %p evchan %d output hook",
+			__func__, rec, rec->xprt.xp_fd,
+			sr_rec, sr_rec->id_k);
+	}
+	return (code);
+}
+
+/*
+ * SVC_RQST_FLAG_LOCKED
+ *
+ * Returns true when waiting for output.
+ */
+static bool
+svc_rqst_unhook_output(struct rpc_dplx_rec *rec, struct svc_rqst_rec *sr_rec)
+{
+	bool armed = atomic_postclear_uint16_t_bits(&rec->out.flags,
+						    RPC_DPLX_OUT_ARMED)
+		     & RPC_DPLX_OUT_ARMED;
+
+	switch (sr_rec->ev_type) {
+#if defined(TIRPC_EPOLL)
+	case SVC_EVENT_EPOLL:
+		if (rec->ev_u.epoll.out_fd < 0)
+			break;
+
+		/* MUST remove before close, the socket remains open */
+		(void)epoll_ctl(sr_rec->ev_u.epoll.epoll_fd, EPOLL_CTL_DEL,
+				rec->ev_u.epoll.out_fd, NULL);
+		(void)close(rec->ev_u.epoll.out_fd);
+		rec->ev_u.epoll.out_fd = -1;
+		break;
+#endif
+#if defined(TIRPC_URING)
+	case SVC_EVENT_URING:
+		if (!armed)
+			break;
+
+		/* poll in flight still completes, referencing rec */
+		SVC_REF(&rec->xprt, SVC_REF_FLAG_NONE);
+		(void)svc_rqst_uring_cancel(rec, sr_rec, SVC_RQST_OUTPUT);
+		break;
+#endif
+	default:
+		break;
+	}			/* switch */
+
+	return (armed);
+}
+
+/*
+ * not locked
+ *
+ * The socket is full.  The next output event submits rec->out.wpe
+ * (prepared by the caller) with a transport reference.
+ *
+ * Returns non-zero when not registered on an event channel.
+ */
+int
+svc_rqst_rearm_output(SVCXPRT *xprt)
+{
+	struct rpc_dplx_rec *rec = REC_XPRT(xprt);
+	struct svc_rqst_rec *sr_rec;
+	int code = EINVAL;
+
+	rpc_dplx_rli(rec);
+	sr_rec = (struct svc_rqst_rec *)rec->ev_p;
+
+	/* MUST check shutdown after the channel */
+	if (sr_rec
+	 && !(xprt->xp_flags & SVC_XPRT_FLAG_DESTROYED)
+	 && !(sr_rec->flags & SVC_RQST_FLAG_SHUTDOWN))
+		code = svc_rqst_hook_output(rec, sr_rec);
+
+	rpc_dplx_rui(rec);
+	return (code);
+}
+
+/*
+ * SVC_RQST_FLAG_LOCKED
+ */
+static bool
 svc_rqst_unreg(struct rpc_dplx_rec *rec, struct svc_rqst_rec *sr_rec)
 {
-	uint16_t xp_flags = atomic_postclear_uint16_t_bits(&rec->xprt.xp_flags,
-							   SVC_XPRT_FLAG_ADDED);
+	uint16_t xp_flags;
+	bool output = svc_rqst_unhook_output(rec, sr_rec);
+
+#if defined(TIRPC_URING)
+	/* io_uring operation in flight still completes, referencing rec */
+	if (sr_rec->ev_type == SVC_EVENT_URING)
+		SVC_REF(&rec->xprt, SVC_REF_FLAG_NONE);
+#endif
+	xp_flags = atomic_postclear_uint16_t_bits(&rec->xprt.xp_flags,
+						  SVC_XPRT_FLAG_ADDED);
 
 	/* clear events */
 	if (xp_flags & SVC_XPRT_FLAG_ADDED)
 		(void)svc_rqst_unhook_events(rec, sr_rec);
+#if defined(TIRPC_URING)
+	else if (sr_rec->ev_type == SVC_EVENT_URING) {
+		/* nothing in flight; already destroying, or caller has ref */
+		atomic_dec_uint32_t(&rec->xprt.xp_refs);
+	}
+#endif
 
 	/* Unlinking after debug message ensures both the xprt and the sr_rec
 	 * are still present, as the xprt unregisters before release.
 	 */
 	rec->ev_p = NULL;
 	svc_rqst_release(sr_rec);
+	return (output);
 }
 
 /*
@@ -535,6 +1287,7 @@ svc_rqst_evchan_reg(uint32_t chan_id, SVCXPRT *xprt, uint32_t flags)
 	struct svc_rqst_rec *ev_p;
 	int code;
 	uint16_t bits = SVC_XPRT_FLAG_ADDED | (flags & SVC_XPRT_FLAG_UREG);
+	bool output = false;
 
 	if (chan_id == 0) {
 		/* Create a global/legacy event channel */
@@ -569,7 +1322,7 @@ svc_rqst_evchan_reg(uint32_t chan_id, SVCXPRT *xprt, uint32_t flags)
 				__func__, xprt, chan_id);
 			return (0);
 		}
-		svc_rqst_unreg(rec, ev_p);
+		output = svc_rqst_unreg(rec, ev_p);
 	}
 
 	/* assuming success */
@@ -580,6 +1333,12 @@ svc_rqst_evchan_reg(uint32_t chan_id, SVCXPRT *xprt, uint32_t flags)
 
 	/* register on event channel */
 	code = svc_rqst_hook_events(rec, sr_rec);
+	if (!code)
+		svc_rqst_idle_add(rec);
+
+	/* still waiting for output, moved with the transport */
+	if (!code && output)
+		code = svc_rqst_hook_output(rec, sr_rec);
 
 	if (!(flags & SVC_RQST_FLAG_LOCKED))
 		rpc_dplx_rui(rec);
@@ -636,15 +1395,33 @@ svc_rqst_xprt_unregister(SVCXPRT *xprt)
 
 	rpc_dplx_rli(rec);
 	if ((ev_p = (struct svc_rqst_rec *)rec->ev_p) != NULL) {
-		svc_rqst_unreg(rec, ev_p);
+		(void)svc_rqst_unreg(rec, ev_p);
 	}
+	svc_rqst_idle_del(rec);
 
 	/* There is a small window between removing the registration
 	 * (system call latency) and processing outstanding events.
-	 * Therefore, remove from the transport tree here (and only here).
+	 * Therefore, remove from the transport table here (and only here),
+	 * unlocked, as clearing may wait out a lookup of the same fd.
 	 */
-	svc_xprt_clear(xprt);
 	rpc_dplx_rui(rec);
+	svc_xprt_clear(xprt);
+}
+
+/*
+ * not locked
+ *
+ * Wake the channel of xprt, to look again at its wait timeout.  Channels
+ * are only released at shutdown.
+ */
+void
+svc_rqst_xprt_wakeup(SVCXPRT *xprt)
+{
+	struct svc_rqst_rec *sr_rec =
+		atomic_fetch_voidptr(&REC_XPRT(xprt)->ev_p);
+
+	if (sr_rec)
+		ev_sig(sr_rec->sv[0], 0);	/* send wakeup */
 }
 
 /*static*/ void
@@ -669,70 +1446,403 @@ svc_rqst_xprt_task(struct work_pool_entry *wpe)
 }
 
 /*
- * Like __svc_clean_idle but event-type independent.  For now no cleanfds.
+ * Idle transports are reaped from a timer wheel of SVC_RQST_IDLE_SLOTS
+ * slots, each idle_timeout / (SVC_RQST_IDLE_SLOTS - 1) seconds (at least
+ * one).  A transport is queued in the slot of its deadline when it is
+ * registered; receiving only updates rec->recv.ts.  When its slot comes
+ * due, a transport that received since moves to the slot of its new
+ * deadline, otherwise it is destroyed, so expiry costs O(due) instead of
+ * a scan of all transports.
+ *
+ * The wheel turns from the channels' wait timeouts (svc_rqst_idle_tick),
+ * which are no longer than a slot while idle_timeout is set.  Expired
+ * transports are destroyed by a task that ends when none remain.
  */
+#define SVC_RQST_IDLE_SLOTS 256
+#define SVC_RQST_IDLE_REAPING ((time_t)-1)
+
+TAILQ_HEAD(svc_rqst_idle_q, rpc_dplx_rec);
 
-struct svc_rqst_clean_arg {
-	struct timespec ts;
-	int timeout;
-	int cleaned;
+static struct svc_rqst_idle_s {
+	struct svc_rqst_idle_q slot[SVC_RQST_IDLE_SLOTS];
+	struct svc_rqst_idle_q expired;	/* for svc_rqst_idle_task */
+	mutex_t mtx;
+	struct work_pool_entry wpe;
+	time_t width;		/* seconds per slot, 0 before first use */
+	time_t tick;		/* next slot time to expire */
+	int64_t due;		/* (atomic) tick in seconds, 0 when none */
+	u_int count;		/* queued transports */
+	bool running;		/* svc_rqst_idle_task submitted */
+} svc_rqst_idle = {
+	.expired = TAILQ_HEAD_INITIALIZER(svc_rqst_idle.expired),
+	.mtx = MUTEX_INITIALIZER,
 };
 
-static bool
-svc_rqst_clean_func(SVCXPRT *xprt, void *arg)
+/*
+ * Seconds per slot, at least one
+ */
+static inline time_t
+svc_rqst_idle_width(int timeout)
 {
-	struct svc_rqst_clean_arg *acc = (struct svc_rqst_clean_arg *)arg;
+	return ((timeout + SVC_RQST_IDLE_SLOTS - 2) / (SVC_RQST_IDLE_SLOTS - 1));
+}
 
-	if (xprt->xp_ops == NULL)
-		return (false);
+static inline struct svc_rqst_idle_q *
+svc_rqst_idle_slot(time_t expires)
+{
+	return (&svc_rqst_idle.slot[expires & (SVC_RQST_IDLE_SLOTS - 1)]);
+}
 
-	if (xprt->xp_flags & (SVC_XPRT_FLAG_DESTROYED | SVC_XPRT_FLAG_UREG))
-		return (false);
+/*
+ * The slot time of the deadline, after the last receive.
+ */
+static inline time_t
+svc_rqst_idle_expires(struct rpc_dplx_rec *rec)
+{
+	time_t width = svc_rqst_idle.width;
 
-	if ((acc->ts.tv_sec - REC_XPRT(xprt)->recv.ts.tv_sec) < acc->timeout)
-		return (false);
+	return ((rec->recv.ts.tv_sec + __svc_params->idle_timeout + width - 1)
+		/ width);
+}
 
-	SVC_DESTROY(xprt);
-	acc->cleaned++;
-	return (true);
+/*
+ * svc_rqst_idle.mtx held
+ */
+static void
+svc_rqst_idle_take(time_t tick, struct svc_rqst_idle_q *expired)
+{
+	struct svc_rqst_idle_q *q = svc_rqst_idle_slot(tick);
+	struct rpc_dplx_rec *rec = TAILQ_FIRST(q);
+	struct rpc_dplx_rec *next;
+	time_t expires;
+
+	for (; rec; rec = next) {
+		next = TAILQ_NEXT(rec, idle.q);
+		if (rec->idle.expires > tick) {
+			/* a later turn of the wheel */
+			continue;
+		}
+		TAILQ_REMOVE(q, rec, idle.q);
+
+		expires = svc_rqst_idle_expires(rec);
+		if (expires > tick) {
+			TAILQ_INSERT_TAIL(svc_rqst_idle_slot(expires), rec,
+					  idle.q);
+			rec->idle.expires = expires;
+			continue;
+		}
+
+		/* svc_rqst_idle_del() leaves it on expired */
+		rec->idle.expires = SVC_RQST_IDLE_REAPING;
+		svc_rqst_idle.count--;
+		SVC_REF(&rec->xprt, SVC_REF_FLAG_NONE);
+		TAILQ_INSERT_TAIL(expired, rec, idle.q);
+	}
 }
 
-void authgss_ctx_gc_idle(void);
+static void
+svc_rqst_idle_reap(struct svc_rqst_idle_q *expired)
+{
+	struct rpc_dplx_rec *rec;
+
+	while ((rec = TAILQ_FIRST(expired))) {
+		TAILQ_REMOVE(expired, rec, idle.q);
+
+		if (!(rec->xprt.xp_flags & SVC_XPRT_FLAG_DESTROYED)) {
+			__warnx(TIRPC_DEBUG_FLAG_SVC_RQST,
+				"%s: %p fd %d idle",
+				__func__, &rec->xprt, rec->xprt.xp_fd);
+			SVC_DESTROY(&rec->xprt);
+		}
+
+		mutex_lock(&svc_rqst_idle.mtx);
+		rec->idle.expires = 0;
+		mutex_unlock(&svc_rqst_idle.mtx);
+		SVC_RELEASE(&rec->xprt, SVC_RELEASE_FLAG_NONE);
+	}
+}
 
 static void
-svc_rqst_clean_idle(int timeout)
+svc_rqst_idle_task(struct work_pool_entry *wpe)
 {
-	struct svc_rqst_clean_arg acc;
-	static mutex_t active_mtx = MUTEX_INITIALIZER;
-	static uint32_t active;
+	struct svc_rqst_idle_q expired = TAILQ_HEAD_INITIALIZER(expired);
+
+	mutex_lock(&svc_rqst_idle.mtx);
+	while (!TAILQ_EMPTY(&svc_rqst_idle.expired)) {
+		TAILQ_CONCAT(&expired, &svc_rqst_idle.expired, idle.q);
+		mutex_unlock(&svc_rqst_idle.mtx);
+		svc_rqst_idle_reap(&expired);
+		mutex_lock(&svc_rqst_idle.mtx);
+	}
+	svc_rqst_idle.running = false;
+	mutex_unlock(&svc_rqst_idle.mtx);
+}
 
-	if (mutex_trylock(&active_mtx) != 0)
+/*
+ * svc_rqst_idle.mtx held
+ */
+static inline void
+svc_rqst_idle_set_due(void)
+{
+	atomic_store_int64_t(&svc_rqst_idle.due, svc_rqst_idle.count
+			     ? svc_rqst_idle.tick * svc_rqst_idle.width : 0);
+}
+
+/*
+ * not locked
+ *
+ * Called by each channel before waiting.  Expires the slots that are
+ * due (whichever channel comes first), and returns the wait timeout.
+ */
+static int
+svc_rqst_idle_tick(void)
+{
+	int timeout = __svc_params->idle_timeout;
+	struct timespec now;
+	int64_t due;
+	int64_t ms;
+
+	if (timeout <= 0)
+		return (SVC_RQST_TIMEOUT_MS);
+
+	due = atomic_fetch_int64_t(&svc_rqst_idle.due);
+	if (!due) {
+		/* nothing queued, look again after a slot */
+		return (MIN(svc_rqst_idle_width(timeout) * 1000,
+			    SVC_RQST_TIMEOUT_MS));
+	}
+
+	(void)clock_gettime(CLOCK_MONOTONIC_FAST, &now);
+	if (now.tv_sec >= due && !mutex_trylock(&svc_rqst_idle.mtx)) {
+		while (svc_rqst_idle.count
+		    && svc_rqst_idle.tick <= now.tv_sec / svc_rqst_idle.width)
+			svc_rqst_idle_take(svc_rqst_idle.tick++,
+					   &svc_rqst_idle.expired);
+		svc_rqst_idle_set_due();
+
+		if (!TAILQ_EMPTY(&svc_rqst_idle.expired)
+		 && !svc_rqst_idle.running) {
+			svc_rqst_idle.running = true;
+			svc_rqst_idle.wpe.fun = svc_rqst_idle_task;
+			work_pool_submit(&svc_work_pool, &svc_rqst_idle.wpe);
+		}
+		due = svc_rqst_idle.due;
+		mutex_unlock(&svc_rqst_idle.mtx);
+
+		if (!due)
+			return (MIN(svc_rqst_idle_width(timeout) * 1000,
+				    SVC_RQST_TIMEOUT_MS));
+	}
+
+	/* another channel may be expiring, then look again soon */
+	ms = (due - now.tv_sec) * 1000 - now.tv_nsec / 1000000;
+	return (MAX(1, MIN(ms, SVC_RQST_TIMEOUT_MS)));
+}
+
+/*
+ * SVC_RQST_FLAG_LOCKED
+ */
+static void
+svc_rqst_idle_add(struct rpc_dplx_rec *rec)
+{
+	int timeout = __svc_params->idle_timeout;
+	time_t expires;
+	int i;
+
+	if (timeout <= 0 || (rec->xprt.xp_flags & SVC_XPRT_FLAG_UREG))
 		return;
 
-	if (active > 0)
-		goto unlock;
+	/* registration counts as activity */
+	(void)clock_gettime(CLOCK_MONOTONIC_FAST, &rec->recv.ts);
+
+	mutex_lock(&svc_rqst_idle.mtx);
+	if (rec->idle.expires) {
+		/* queued (moved to another channel), or reaping */
+		mutex_unlock(&svc_rqst_idle.mtx);
+		return;
+	}
+	if (!svc_rqst_idle.width) {
+		for (i = 0; i < SVC_RQST_IDLE_SLOTS; i++)
+			TAILQ_INIT(&svc_rqst_idle.slot[i]);
+		svc_rqst_idle.width = svc_rqst_idle_width(timeout);
+	}
+	if (!svc_rqst_idle.count)
+		svc_rqst_idle.tick = rec->recv.ts.tv_sec / svc_rqst_idle.width;
+
+	expires = svc_rqst_idle_expires(rec);
+	if (expires < svc_rqst_idle.tick)
+		expires = svc_rqst_idle.tick;
+	TAILQ_INSERT_TAIL(svc_rqst_idle_slot(expires), rec, idle.q);
+	rec->idle.expires = expires;
+	if (!svc_rqst_idle.count++)
+		svc_rqst_idle_set_due();
+	mutex_unlock(&svc_rqst_idle.mtx);
+}
+
+/*
+ * SVC_RQST_FLAG_LOCKED
+ */
+static void
+svc_rqst_idle_del(struct rpc_dplx_rec *rec)
+{
+	if (__svc_params->idle_timeout <= 0)
+		return;
+
+	mutex_lock(&svc_rqst_idle.mtx);
+	if (rec->idle.expires && rec->idle.expires != SVC_RQST_IDLE_REAPING) {
+		TAILQ_REMOVE(svc_rqst_idle_slot(rec->idle.expires), rec,
+			     idle.q);
+		rec->idle.expires = 0;
+		if (!--(svc_rqst_idle.count))
+			svc_rqst_idle_set_due();
+	}
+	mutex_unlock(&svc_rqst_idle.mtx);
+}
+
+/*
+ * not locked
+ *
+ * Wait timeout of a channel, until the idle wheel or an async call
+ * timeout is due.
+ */
+static inline int
+svc_rqst_timeout(void)
+{
+	int timeout = svc_rqst_idle_tick();
+	int ms = rpc_ctx_expire_tick();
 
-	++active;
+	return (ms >= 0 && ms < timeout ? ms : timeout);
+}
+
+void authgss_ctx_gc_idle(void);
 
+static void
+svc_rqst_clean_idle(void)
+{
 #ifdef _HAVE_GSSAPI
+	static mutex_t active_mtx = MUTEX_INITIALIZER;
+
+	if (mutex_trylock(&active_mtx) != 0)
+		return;
+
 	/* trim gss context cache */
 	authgss_ctx_gc_idle();
+
+	mutex_unlock(&active_mtx);
 #endif /* _HAVE_GSSAPI */
+}
 
-	if (timeout <= 0)
-		goto unlock;
+/*
+ * Events array is re-used after the channel is re-posted,
+ * so ready transports are linked by their (idle) entry.
+ */
+static inline void
+svc_rqst_ready(struct rpc_dplx_rec *rec, struct poolq_head_s *q)
+{
+	rec->ioq.ioq_wpe.fun = svc_rqst_xprt_task;
+	TAILQ_INSERT_TAIL(q, &rec->ioq.ioq_wpe.pqe, q);
+}
+
+/*
+ * not locked
+ *
+ * The first max_inline ready transports are handled by this hot thread,
+ * in order.  The remainder (and another task to handle events on this
+ * channel) are queued together, with a single work_pool lock.  With
+ * per-worker queues, the channel task is shared instead, so that another
+ * worker can re-arm the channel while this one is busy.
+ */
+static inline void
+svc_rqst_dispatch(struct svc_rqst_rec *sr_rec, struct poolq_head_s *inlineq,
+		  struct poolq_head_s *batch)
+{
+	struct poolq_entry *have;
 
-	/* trim xprts (not sorted, not aggressive [but self limiting]) */
-	(void)clock_gettime(CLOCK_MONOTONIC_FAST, &acc.ts);
-	acc.timeout = timeout;
-	acc.cleaned = 0;
+	if (sr_rec->cpu >= 0) {
+		/* the pinned channel thread continues waiting */
+		TAILQ_CONCAT(inlineq, batch, q);
+		work_pool_submit_batch(&svc_work_pool, inlineq);
+	} else {
+		/* submit another task to handle events in order */
+		atomic_inc_uint32_t(&sr_rec->refcnt);
+		if (svc_work_pool.wpq) {
+			/* not behind the remainder on own queue */
+			work_pool_submit_batch(&svc_work_pool, batch);
+			work_pool_submit_shared(&svc_work_pool,
+						&sr_rec->ev_wpe);
+		} else {
+			TAILQ_INSERT_TAIL(batch, &sr_rec->ev_wpe.pqe, q);
+			work_pool_submit_batch(&svc_work_pool, batch);
+		}
+	}
 
-	svc_xprt_foreach(svc_rqst_clean_func, (void *)&acc);
+	/* in most cases have only one event, use this hot thread */
+	while ((have = TAILQ_FIRST(inlineq))) {
+		TAILQ_REMOVE(inlineq, have, q);
+		svc_rqst_xprt_task((struct work_pool_entry *)have);
+	}
 
- unlock:
-	--active;
-	mutex_unlock(&active_mtx);
-	return;
+	/* failsafe idle processing after work task */
+	if (atomic_postclear_uint32_t_bits(&wakeups, ~SVC_RQST_WAKEUPS)
+	    > SVC_RQST_WAKEUPS) {
+		svc_rqst_clean_idle();
+	}
+}
+
+/*
+ * not locked
+ *
+ * Output event (instead of input), submit the writer's task.
+ */
+static void
+svc_rqst_output_event(struct svc_rqst_rec *sr_rec, struct rpc_dplx_rec *rec,
+		      int32_t res)
+{
+	uint16_t out_flags;
+
+	/* Another task may release transport in parallel.
+	 * Take extra reference now to keep window as small as possible.
+	 */
+	SVC_REF(&rec->xprt, SVC_REF_FLAG_NONE);
+
+#if defined(TIRPC_URING)
+	if (res == -ECANCELED) {
+		/* by svc_rqst_unhook_output(), release its ref.
+		 * May be already waiting on another channel.
+		 */
+		SVC_RELEASE(&rec->xprt, SVC_RELEASE_FLAG_NONE);
+		SVC_RELEASE(&rec->xprt, SVC_RELEASE_FLAG_NONE);
+		return;
+	}
+#endif
+
+	out_flags = atomic_postclear_uint16_t_bits(&rec->out.flags,
+						   RPC_DPLX_OUT_ARMED);
+
+	__warnx(TIRPC_DEBUG_FLAG_SVC_RQST,
+		"%s: %p fd %d output event",
+		__func__, rec, rec->xprt.xp_fd);
+
+	if (!(out_flags & RPC_DPLX_OUT_ARMED)) {
+#if defined(TIRPC_URING)
+		/* unhooked in flight, also release svc_rqst_unreg() ref */
+		if (sr_rec->ev_type == SVC_EVENT_URING)
+			SVC_RELEASE(&rec->xprt, SVC_RELEASE_FLAG_NONE);
+#endif
+	} else if (rec->xprt.xp_refs > 1
+		&& !(rec->xprt.xp_flags & SVC_XPRT_FLAG_DESTROYED)
+		&& !(atomic_postset_uint16_t_bits(&rec->out.flags,
+						  RPC_DPLX_OUT_WORKING)
+		     & RPC_DPLX_OUT_WORKING)) {
+		/* (idempotent) xp_flags and xp_refs are set atomic.
+		 * xp_refs need more than 1 (this event).
+		 */
+		work_pool_submit(&svc_work_pool, &rec->out.wpe);
+		return;
+	}
+
+	/* Do not write destroyed transports. */
+	SVC_RELEASE(&rec->xprt, SVC_RELEASE_FLAG_NONE);
 }
 
 #ifdef TIRPC_EPOLL
@@ -758,6 +1868,12 @@ svc_rqst_epoll_event(struct svc_rqst_rec *sr_rec, struct epoll_event *ev)
 		return (NULL);
 	}
 
+	if ((uintptr_t)rec & SVC_RQST_OUTPUT) {
+		svc_rqst_output_event(sr_rec, (struct rpc_dplx_rec *)
+				      ((uintptr_t)rec & ~SVC_RQST_OUTPUT), 0);
+		return (NULL);
+	}
+
 	/* Another task may release transport in parallel.
 	 * Take extra reference now to keep window as small as possible.
 	 * Under normal circumstances, worker task (above) will release.
@@ -767,8 +1883,11 @@ svc_rqst_epoll_event(struct svc_rqst_rec *sr_rec, struct epoll_event *ev)
 	/* MUST handle flags after reference.
 	 * Although another task may unhook, the error is non-fatal.
 	 */
-	xp_flags = atomic_postclear_uint16_t_bits(&rec->xprt.xp_flags,
-						  SVC_XPRT_FLAG_ADDED);
+	if (svc_rqst_is_edge(rec, sr_rec))
+		xp_flags = svc_rqst_edge_take(&rec->xprt);
+	else
+		xp_flags = atomic_postclear_uint16_t_bits(&rec->xprt.xp_flags,
+							  SVC_XPRT_FLAG_ADDED);
 
 	__warnx(TIRPC_DEBUG_FLAG_SVC_RQST,
 		"%s: %p fd %d event %d",
@@ -799,45 +1918,27 @@ svc_rqst_epoll_event(struct svc_rqst_rec *sr_rec, struct epoll_event *ev)
 static inline bool
 svc_rqst_epoll_events(struct svc_rqst_rec *sr_rec, int n_events)
 {
-	struct rpc_dplx_rec *rec = NULL;
+	struct poolq_head_s batch = TAILQ_HEAD_INITIALIZER(batch);
+	struct poolq_head_s inlineq = TAILQ_HEAD_INITIALIZER(inlineq);
+	u_int n_inline = 0;
 	int ix = 0;
 
-	while (ix < n_events) {
-		rec = svc_rqst_epoll_event(sr_rec,
-					   &(sr_rec->ev_u.epoll.events[ix++]));
-		if (rec)
-			break;
-	}
-
-	if (!rec) {
-		/* continue waiting for events with this task */
-		return false;
-	}
-
 	while (ix < n_events) {
 		struct rpc_dplx_rec *rec = svc_rqst_epoll_event(sr_rec,
 					    &(sr_rec->ev_u.epoll.events[ix++]));
 		if (!rec)
 			continue;
 
-		rec->ioq.ioq_wpe.fun = svc_rqst_xprt_task;
-		work_pool_submit(&svc_work_pool, &(rec->ioq.ioq_wpe));
+		svc_rqst_ready(rec, n_inline++ < sr_rec->ev_u.epoll.max_inline
+				    ? &inlineq : &batch);
 	}
 
-	/* submit another task to handle events in order */
-	atomic_inc_uint32_t(&sr_rec->refcnt);
-	work_pool_submit(&svc_work_pool, &sr_rec->ev_wpe);
-
-	/* in most cases have only one event, use this hot thread */
-	rec->ioq.ioq_wpe.fun = svc_rqst_xprt_task;
-	svc_rqst_xprt_task(&(rec->ioq.ioq_wpe));
-
-	/* failsafe idle processing after work task */
-	if (atomic_postclear_uint32_t_bits(&wakeups, ~SVC_RQST_WAKEUPS)
-	    > SVC_RQST_WAKEUPS) {
-		svc_rqst_clean_idle(__svc_params->idle_timeout);
+	if (!n_inline) {
+		/* continue waiting for events with this task */
+		return false;
 	}
 
+	svc_rqst_dispatch(sr_rec, &inlineq, &batch);
 	return true;
 }
 
@@ -855,7 +1956,7 @@ svc_rqst_epoll_loop(struct svc_rqst_rec *sr_rec)
 		n_events = epoll_wait(sr_rec->ev_u.epoll.epoll_fd,
 				      sr_rec->ev_u.epoll.events,
 				      sr_rec->ev_u.epoll.max_events,
-				      SVC_RQST_TIMEOUT_MS);
+				      svc_rqst_timeout());
 
 		if (unlikely(sr_rec->flags & SVC_RQST_FLAG_SHUTDOWN)) {
 			__warnx(TIRPC_DEBUG_FLAG_SVC_RQST,
@@ -890,14 +1991,193 @@ svc_rqst_epoll_loop(struct svc_rqst_rec *sr_rec)
 }
 #endif
 
+#if defined(TIRPC_URING)
+
+static struct rpc_dplx_rec *
+svc_rqst_uring_event(struct svc_rqst_rec *sr_rec, struct io_uring_cqe *cqe)
+{
+	struct rpc_dplx_rec *rec;
+	uint16_t xp_flags;
+
+	switch (cqe->user_data) {
+	case SVC_RQST_URING_CTRL:
+		/* signalled -- there was a wakeup on sv[1] */
+		__warnx(TIRPC_DEBUG_FLAG_SVC_RQST,
+			"%s: fd %d wakeup (sr_rec %p)",
+			__func__, sr_rec->sv[1],
+			sr_rec);
+		(void)consume_ev_sig_nb(sr_rec->sv[1]);
+		if (!(sr_rec->flags & SVC_RQST_FLAG_SHUTDOWN))
+			(void)svc_rqst_uring_ctrl(sr_rec);
+		return (NULL);
+	case SVC_RQST_URING_CANCEL:
+		return (NULL);
+	default:
+		break;
+	};
+
+	if (cqe->user_data & SVC_RQST_OUTPUT) {
+		svc_rqst_output_event(sr_rec, (struct rpc_dplx_rec *)
+				      (uintptr_t)(cqe->user_data
+						  & ~SVC_RQST_OUTPUT),
+				      cqe->res);
+		return (NULL);
+	}
+
+	rec = (struct rpc_dplx_rec *)(uintptr_t)cqe->user_data;
+	rec->ev_u.uring.res = cqe->res;
+
+	/* Another task may release transport in parallel.
+	 * Take extra reference now to keep window as small as possible.
+	 * Under normal circumstances, worker task will release.
+	 */
+	SVC_REF(&rec->xprt, SVC_REF_FLAG_NONE);
+
+	xp_flags = atomic_postclear_uint16_t_bits(&rec->xprt.xp_flags,
+						  SVC_XPRT_FLAG_ADDED);
+
+	__warnx(TIRPC_DEBUG_FLAG_SVC_RQST,
+		"%s: %p fd %d op %d res %d",
+		__func__, rec, rec->xprt.xp_fd, rec->ev_u.uring.op, cqe->res);
+
+	if (!(xp_flags & SVC_XPRT_FLAG_ADDED)) {
+		/* unhooked in flight, also release svc_rqst_unreg() ref */
+		SVC_RELEASE(&rec->xprt, SVC_RELEASE_FLAG_NONE);
+	} else if (rec->xprt.xp_refs > 1
+		&& !(xp_flags & SVC_XPRT_FLAG_DESTROYED)
+		&& !(atomic_postset_uint16_t_bits(&rec->ioq.ioq_s.qflags,
+						  IOQ_FLAG_WORKING)
+		     & IOQ_FLAG_WORKING)) {
+		/* (idempotent) xp_flags and xp_refs are set atomic.
+		 * xp_refs need more than 1 (this event).
+		 */
+		return (rec);
+	}
+
+	/* Do not return destroyed transports. */
+	SVC_RELEASE(&rec->xprt, SVC_RELEASE_FLAG_NONE);
+	return (NULL);
+}
+
+/*
+ * not locked
+ */
+static inline bool
+svc_rqst_uring_events(struct svc_rqst_rec *sr_rec, uint32_t head,
+		      uint32_t tail)
+{
+	struct poolq_head_s batch = TAILQ_HEAD_INITIALIZER(batch);
+	struct poolq_head_s inlineq = TAILQ_HEAD_INITIALIZER(inlineq);
+	u_int n_inline = 0;
+
+	while (head != tail) {
+		struct rpc_dplx_rec *rec = svc_rqst_uring_event(sr_rec,
+			&sr_rec->ev_u.uring.cqes[head++
+						 & sr_rec->ev_u.uring.cq_mask]);
+		if (!rec)
+			continue;
+
+		svc_rqst_ready(rec, n_inline++ < sr_rec->ev_u.uring.max_inline
+				    ? &inlineq : &batch);
+	}
+
+	/* consumed, before another task looks */
+	atomic_store_uint32_t(sr_rec->ev_u.uring.cq_head, head);
+
+	if (!n_inline) {
+		/* continue waiting for events with this task */
+		return false;
+	}
+
+	svc_rqst_dispatch(sr_rec, &inlineq, &batch);
+	return true;
+}
+
+static inline bool
+svc_rqst_uring_loop(struct svc_rqst_rec *sr_rec)
+{
+	struct __kernel_timespec ts;
+	struct io_uring_getevents_arg arg = {
+		.ts = (uintptr_t)&ts,
+	};
+	uint32_t head;
+	uint32_t tail;
+	int code;
+	int ms;
+
+	for (;;) {
+		/* also while busy, for the idle wheel */
+		ms = svc_rqst_timeout();
+		ts.tv_sec = ms / 1000;
+		ts.tv_nsec = (ms % 1000) * 1000000;
+
+		head = *sr_rec->ev_u.uring.cq_head;
+		tail = atomic_fetch_uint32_t(sr_rec->ev_u.uring.cq_tail);
+		code = 0;
+
+		if (head == tail) {
+			/* also enter any submission deferred by failure */
+			uint32_t pending =
+			    atomic_fetch_uint32_t(sr_rec->ev_u.uring.sq_tail)
+			  - atomic_fetch_uint32_t(sr_rec->ev_u.uring.sq_head);
+
+			__warnx(TIRPC_DEBUG_FLAG_SVC_RQST,
+				"%s: ring_fd %d before io_uring_enter",
+				__func__,
+				sr_rec->ev_u.uring.ring_fd);
+
+			if (io_uring_enter_wr(sr_rec->ev_u.uring.ring_fd,
+					      pending, 1,
+					      IORING_ENTER_GETEVENTS
+					      | IORING_ENTER_EXT_ARG,
+					      &arg, sizeof(arg)) < 0)
+				code = errno;
+			tail = atomic_fetch_uint32_t(
+						sr_rec->ev_u.uring.cq_tail);
+		}
+
+		if (unlikely(sr_rec->flags & SVC_RQST_FLAG_SHUTDOWN)) {
+			__warnx(TIRPC_DEBUG_FLAG_SVC_RQST,
+				"%s: ring_fd %d io_uring_enter shutdown (%d)",
+				__func__,
+				sr_rec->ev_u.uring.ring_fd,
+				code);
+			return true;
+		}
+		if (head != tail) {
+			if (tail - head > sr_rec->ev_u.uring.max_events)
+				tail = head + sr_rec->ev_u.uring.max_events;
+			atomic_add_uint32_t(&wakeups, tail - head);
+
+			if (svc_rqst_uring_events(sr_rec, head, tail))
+				return false;
+			continue;
+		}
+		if (!code || code == ETIME) {
+			/* timed out (idle) */
+			atomic_inc_uint32_t(&wakeups);
+			continue;
+		}
+		__warnx(TIRPC_DEBUG_FLAG_WARN,
+			"%s: ring_fd %d io_uring_enter failed (%d)",
+			__func__,
+			sr_rec->ev_u.uring.ring_fd,
+			code);
+
+		if (code != EINTR && code != EBUSY && code != EAGAIN)
+			return true;
+	}
+}
+#endif /* TIRPC_URING */
+
 /*
  * No locking, "there can be only one"
+ *
+ * Returns true when the channel is finished.
  */
-static void
-svc_rqst_run_task(struct work_pool_entry *wpe)
+static bool
+svc_rqst_run(struct svc_rqst_rec *sr_rec)
 {
-	struct svc_rqst_rec *sr_rec =
-		opr_containerof(wpe, struct svc_rqst_rec, ev_wpe);
 	bool finished;
 
 	/* enter event loop */
@@ -912,6 +2192,13 @@ svc_rqst_run_task(struct work_pool_entry *wpe)
 				 sizeof(struct epoll_event));
 		}
 		break;
+#endif
+#if defined(TIRPC_URING)
+	case SVC_EVENT_URING:
+		finished = svc_rqst_uring_loop(sr_rec);
+		if (finished)
+			svc_rqst_uring_destroy(sr_rec);
+		break;
 #endif
 	default:
 		finished = true;
@@ -926,12 +2213,73 @@ svc_rqst_run_task(struct work_pool_entry *wpe)
 	if (finished) {
 		/* reference count here should be 2:
 		 *	1	svc_rqst_set
-		 *	+1	this work_pool thread
+		 *	+1	this work_pool (or channel) thread
 		 * so, DROP one here so the final release will go to 0.
 		 */
 		atomic_dec_uint32_t(&sr_rec->refcnt);	/* svc_rqst_set */
 	}
+	return (finished);
+}
+
+static void
+svc_rqst_run_task(struct work_pool_entry *wpe)
+{
+	struct svc_rqst_rec *sr_rec =
+		opr_containerof(wpe, struct svc_rqst_rec, ev_wpe);
+
+	(void)svc_rqst_run(sr_rec);
+	svc_rqst_release(sr_rec);
+}
+
+/*
+ * The channel thread, pinned once (on creation) to the channel cpu.
+ * Events are dispatched to the work pool, while it waits for more.
+ */
+static void *
+svc_rqst_thread(void *arg)
+{
+	struct svc_rqst_rec *sr_rec = arg;
+
+	while (!svc_rqst_run(sr_rec))
+		;
 	svc_rqst_release(sr_rec);
+	return (NULL);
+}
+
+static int
+svc_rqst_run_thread(struct svc_rqst_rec *sr_rec)
+{
+#if defined(__linux__)
+	pthread_attr_t attr;
+	pthread_t thread;
+	cpu_set_t cpus;
+	int code;
+
+	if (sr_rec->cpu >= CPU_SETSIZE)
+		return (EINVAL);
+
+	CPU_ZERO(&cpus);
+	CPU_SET(sr_rec->cpu, &cpus);
+
+	code = pthread_attr_init(&attr);
+	if (code)
+		return (code);
+	code = pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	if (!code)
+		code = pthread_attr_setaffinity_np(&attr, sizeof(cpus), &cpus);
+	if (!code)
+		code = pthread_create(&thread, &attr, svc_rqst_thread, sr_rec);
+	pthread_attr_destroy(&attr);
+
+	if (code) {
+		__warnx(TIRPC_DEBUG_FLAG_WARN,
+			"%s: evchan %d cpu %d thread failed (%d)",
+			__func__, sr_rec->id_k, sr_rec->cpu, code);
+	}
+	return (code);
+#else
+	return (ENOTSUP);
+#endif
 }
 
 int
@@ -81,6 +81,7 @@
 
 static void svc_vc_rendezvous_ops(SVCXPRT *);
 static void svc_vc_override_ops(SVCXPRT *, SVCXPRT *);
+static bool svc_vc_zerocopy(SVCXPRT *, u_int);
 
 /*
  * A record is composed of one or more record fragments.
@@ -97,6 +98,8 @@ static void svc_vc_override_ops(SVCXPRT *, SVCXPRT *);
 
 #define LAST_FRAG ((u_int32_t)(1 << 31))
 
+#define SVC_VC_RA_BUFSZ (16 * 1024)	/* record marks and small requests */
+
 /*
  * Usage:
  * xprt = svc_vc_ncreate(sock, send_buf_size, recv_buf_size);
@@ -119,6 +122,9 @@ svc_vc_xprt_free(struct svc_vc_xprt *xd)
 	rpc_dplx_rec_destroy(&xd->sx_dr);
 	mutex_destroy(&xd->sx_dr.xprt.xp_lock);
 
+	if (xd->sx_ra.base)
+		mem_free(xd->sx_ra.base, SVC_VC_RA_BUFSZ);
+
 #if defined(HAVE_BLKIN)
 	if (xd->sx_dr.xprt.blkin.svc_name)
 		mem_free(xd->sx_dr.xprt.blkin.svc_name, 2*INET6_ADDRSTRLEN);
@@ -304,7 +310,8 @@ makefd_xprt(const int fd, const u_int sendsz, const u_int recvsz,
 	rec = REC_XPRT(xprt);
 
 	xp_flags = atomic_postset_uint16_t_bits(&xprt->xp_flags, flags
-						| SVC_XPRT_FLAG_INITIALIZED);
+						| SVC_XPRT_FLAG_INITIALIZED
+						| SVC_XPRT_FLAG_EDGE);
 	if (xp_flags & SVC_XPRT_FLAG_INITIALIZED) {
 		rpc_dplx_rui(rec);
 		XPRT_TRACE(xprt, __func__, __func__, __LINE__);
@@ -431,10 +438,37 @@ svc_vc_rendezvous(SVCXPRT *xprt)
 	int rc;
 	socklen_t len;
 	static int n = 1;
+#if defined(TIRPC_URING)
+	uint8_t op;
+	int32_t res;
+
+	if (svc_rqst_uring_done(xprt, &op, &res)
+	 && op == IORING_OP_ACCEPT) {
+		if (unlikely(res == -EINTR || res == -EAGAIN)) {
+			(void)svc_rqst_uring_prep(xprt, IORING_OP_ACCEPT,
+						  NULL, 0);
+			if (unlikely(svc_rqst_rearm_events(xprt)))
+				return (XPRT_DIED);
+			return (XPRT_IDLE);
+		}
+		/* accepted by io_uring, without the peer address */
+		len = sizeof(addr);
+		fd = res;
+		if (fd < 0)
+			errno = -res;
+		else if (getpeername(fd, (struct sockaddr *)(void *)&addr,
+				     &len) < 0)
+			len = 0;
+		goto accepted;
+	}
+#endif
 
  again:
 	len = sizeof(addr);
 	fd = accept(xprt->xp_fd, (struct sockaddr *)(void *)&addr, &len);
+#if defined(TIRPC_URING)
+ accepted:
+#endif
 	if (fd < 0) {
 		if (errno == EINTR)
 			goto again;
@@ -456,6 +490,10 @@ svc_vc_rendezvous(SVCXPRT *xprt)
 		}
 		return (XPRT_DIED);
 	}
+#if defined(TIRPC_URING)
+	/* next accept completes in the ring (no-op otherwise) */
+	(void)svc_rqst_uring_prep(xprt, IORING_OP_ACCEPT, NULL, 0);
+#endif
 	if (unlikely(svc_rqst_rearm_events(xprt))) {
 		__warnx(TIRPC_DEBUG_FLAG_ERROR,
 			"%s: %p fd %d svc_rqst_rearm_events failed (will set dead)",
@@ -509,6 +547,9 @@ svc_vc_rendezvous(SVCXPRT *xprt)
 	xd->sx_dr.pagesz = req_xd->sx_dr.pagesz;
 	xd->sx_dr.maxrec = req_xd->sx_dr.maxrec;
 
+	if (req_xd->sx_dr.zc.min)
+		(void)svc_vc_zerocopy(newxprt, req_xd->sx_dr.zc.min);
+
 	SVC_REF(xprt, SVC_REF_FLAG_NONE);
 	newxprt->xp_parent = xprt;
 	if (xprt->xp_dispatch.rendezvous_cb(newxprt)
@@ -531,6 +572,20 @@ svc_vc_destroy_task(struct work_pool_entry *wpe)
 		return;
 	}
 
+#if defined(MSG_ZEROCOPY)
+	if (rec->out.flags & RPC_DPLX_OUT_LINGER) {
+		/* no more senders, all MSG_ZEROCOPY ids are taken */
+		if (!svc_ioq_zerocopy_drain(&rec->xprt)) {
+			/* instead of nanosleep */
+			work_pool_submit(&svc_work_pool, &(rec->ioq.ioq_wpe));
+			return;
+		}
+		if ((rec->xprt.xp_flags & SVC_XPRT_FLAG_CLOSE)
+		    && rec->xprt.xp_fd != RPC_ANYFD)
+			(void)close(rec->xprt.xp_fd);
+	}
+#endif
+
 	if (rec->xprt.xp_ops->xp_free_user_data)
 		rec->xprt.xp_ops->xp_free_user_data(&rec->xprt);
 
@@ -552,6 +607,9 @@ svc_vc_destroy_it(SVCXPRT *xprt, u_int flags, const char *tag, const int line)
 		.tv_sec = 0,
 		.tv_nsec = 0,
 	};
+#if defined(MSG_ZEROCOPY)
+	struct rpc_dplx_rec *rec = REC_XPRT(xprt);
+#endif
 
 	/* clears xprt from the xprt table (eg, idle scans) */
 	svc_rqst_xprt_unregister(xprt);
@@ -561,6 +619,17 @@ svc_vc_destroy_it(SVCXPRT *xprt, u_int flags, const char *tag, const int line)
 		" should actually destroy things @ %s:%d",
 		__func__, xprt, xprt->xp_fd, xprt->xp_refs, tag, line);
 
+#if defined(MSG_ZEROCOPY)
+	if (rec->zc.min || rec->zc.next != rec->zc.done) {
+		/* completions are read from the socket, closed after they
+		 * drain (svc_vc_destroy_task).
+		 */
+		atomic_set_uint16_t_bits(&rec->out.flags, RPC_DPLX_OUT_LINGER);
+		if ((xprt->xp_flags & SVC_XPRT_FLAG_CLOSE)
+		    && xprt->xp_fd != RPC_ANYFD)
+			(void)shutdown(xprt->xp_fd, SHUT_RDWR);
+	} else
+#endif
 	if ((xprt->xp_flags & SVC_XPRT_FLAG_CLOSE)
 	    && xprt->xp_fd != RPC_ANYFD)
 		(void)close(xprt->xp_fd);
@@ -586,6 +655,30 @@ svc_vc_destroy(SVCXPRT *xprt, u_int flags, const char *tag, const int line)
 
 extern mutex_t ops_lock;
 
+/*
+ * Replies of at least min bytes are sent with MSG_ZEROCOPY.
+ */
+static bool
+svc_vc_zerocopy(SVCXPRT *xprt, u_int min)
+{
+#if defined(SO_ZEROCOPY) && defined(MSG_ZEROCOPY)
+	struct rpc_dplx_rec *rec = REC_XPRT(xprt);
+	int one = 1;
+
+	if (min && setsockopt(xprt->xp_fd, SOL_SOCKET, SO_ZEROCOPY,
+			      &one, sizeof(one)) < 0) {
+		__warnx(TIRPC_DEBUG_FLAG_WARN,
+			"%s: %p fd %d SO_ZEROCOPY failed (%d)",
+			__func__, xprt, xprt->xp_fd, errno);
+		return (FALSE);
+	}
+	rec->zc.min = min;
+	return (TRUE);
+#else
+	return (!min);
+#endif
+}
+
  /*ARGSUSED*/
 static bool
 svc_vc_control(SVCXPRT *xprt, const u_int rq, void *in)
@@ -607,6 +700,14 @@ svc_vc_control(SVCXPRT *xprt, const u_int rq, void *in)
 		xprt->xp_ops->xp_free_user_data = *(svc_xprt_fun_t) in;
 		mutex_unlock(&ops_lock);
 		break;
+	case SVCGET_ZEROCOPY:
+		*(u_int *)in = REC_XPRT(xprt)->zc.min;
+		break;
+	case SVCSET_ZEROCOPY:
+		return svc_vc_zerocopy(xprt, *(u_int *)in);
+	case SVCGET_OUTQ:
+		svc_ioq_stats(xprt, (struct svc_outq_stats *)in);
+		break;
 	default:
 		return (FALSE);
 	}
@@ -635,6 +736,11 @@ svc_vc_rendezvous_control(SVCXPRT *xprt, const u_int rq, void *in)
 		xprt->xp_ops->xp_free_user_data = *(svc_xprt_fun_t) in;
 		mutex_unlock(&ops_lock);
 		break;
+	case SVCGET_ZEROCOPY:
+		*(u_int *)in = REC_XPRT(xprt)->zc.min;
+		break;
+	case SVCSET_ZEROCOPY:
+		return svc_vc_zerocopy(xprt, *(u_int *)in);
 	default:
 		return (FALSE);
 	}
@@ -650,128 +756,359 @@ svc_vc_stat(SVCXPRT *xprt)
 	return (XPRT_IDLE);
 }
 
-static enum xprt_stat
-svc_vc_recv(SVCXPRT *xprt)
+/*
+ * Read-ahead buffer holds enough to make progress (without recv).
+ */
+static inline bool
+svc_vc_ra_ready(struct svc_vc_xprt *xd)
 {
-	struct rpc_dplx_rec *rec = REC_XPRT(xprt);
-	struct svc_vc_xprt *xd = VC_DR(rec);
+	u_int avail = xd->sx_ra.tail - xd->sx_ra.head;
+
+	return (avail >= BYTES_PER_XDR_UNIT || (avail && xd->sx_fbtbc));
+}
+
+/*
+ * Where the next recv goes.  xioq is only needed mid-fragment.
+ *
+ * Fragment bodies larger than the read-ahead buffer are received directly
+ * into their fragment buffer.  Otherwise, record marks and (pipelined)
+ * requests are received together into the read-ahead buffer.
+ */
+static inline u_int
+svc_vc_ra_prep(struct svc_vc_xprt *xd, struct xdr_ioq *xioq, void **buf)
+{
+	u_int avail = xd->sx_ra.tail - xd->sx_ra.head;
+
+	if (!avail && xd->sx_fbtbc >= SVC_VC_RA_BUFSZ) {
+		struct xdr_ioq_uv *uv =
+			IOQ_(TAILQ_LAST(&xioq->ioq_uv.uvqh.qh, poolq_head_s));
+
+		xd->sx_ra.direct = true;
+		*buf = uv->v.vio_tail;
+		return (xd->sx_fbtbc);
+	}
+
+	if (avail && xd->sx_ra.head)
+		memmove(xd->sx_ra.base, xd->sx_ra.base + xd->sx_ra.head, avail);
+	xd->sx_ra.head = 0;
+	xd->sx_ra.tail = avail;
+	xd->sx_ra.direct = false;
+	*buf = xd->sx_ra.base + avail;
+	return (SVC_VC_RA_BUFSZ - avail);
+}
+
+static inline int
+svc_vc_ra_rearm(SVCXPRT *xprt, struct xdr_ioq *xioq, bool drained)
+{
+	struct svc_vc_xprt *xd = VC_DR(REC_XPRT(xprt));
+
+	/* still owned, until output drains */
+	if (svc_ioq_throttle(xprt))
+		return (0);
+
+	if (svc_vc_ra_ready(xd))
+		return svc_rqst_rearm_buffered(xprt);
+
+#if defined(TIRPC_URING)
+	{
+		void *buf;
+		u_int len = svc_vc_ra_prep(xd, xioq, &buf);
+
+		/* next recv completes in the ring (no-op otherwise) */
+		(void)svc_rqst_uring_prep(xprt, IORING_OP_RECV, buf, len);
+	}
+#endif
+	if (drained)
+		return svc_rqst_rearm_drained(xprt);
+	return svc_rqst_rearm_events(xprt);
+}
+
+/*
+ * Pipelined request, queued by svc_vc_recv()
+ */
+static void
+svc_vc_request_task(struct work_pool_entry *wpe)
+{
+	struct xdr_ioq *xioq = opr_containerof(wpe, struct xdr_ioq, ioq_wpe);
+	SVCXPRT *xprt = (SVCXPRT *)wpe->arg;
+
+	if (!(xprt->xp_flags & SVC_XPRT_FLAG_DESTROYED))
+		(void)__svc_params->request_cb(xprt, xioq->xdrs);
+	else
+		xdr_ioq_destroy(xioq, xioq->ioq_s.qsize);
+
+	SVC_RELEASE(xprt, SVC_RELEASE_FLAG_NONE);
+}
+
+static inline struct xdr_ioq *
+svc_vc_recv_xioq(struct svc_vc_xprt *xd)
+{
+	struct rpc_dplx_rec *rec = &xd->sx_dr;
 	struct poolq_entry *have;
-	struct xdr_ioq_uv *uv;
 	struct xdr_ioq *xioq;
-	ssize_t rlen;
-	u_int flags;
-	int code;
 
-	/* no need for locking, only one svc_rqst_xprt_task() per event.
-	 * depends upon svc_rqst_rearm_events() for ordering.
-	 */
 	have = TAILQ_LAST(&rec->ioq.ioq_uv.uvqh.qh, poolq_head_s);
-	if (!have) {
-		xioq = xdr_ioq_create(xd->sx_dr.pagesz, xd->sx_dr.maxrec,
-				      UIO_FLAG_BUFQ);
-		(rec->ioq.ioq_uv.uvqh.qcount)++;
-		TAILQ_INSERT_TAIL(&rec->ioq.ioq_uv.uvqh.qh, &xioq->ioq_s, q);
-	} else {
-		xioq = _IOQ(have);
-	}
+	if (have)
+		return (_IOQ(have));
+
+	xioq = xdr_ioq_create(xd->sx_dr.pagesz, xd->sx_dr.maxrec,
+			      UIO_FLAG_BUFQ);
+	(rec->ioq.ioq_uv.uvqh.qcount)++;
+	TAILQ_INSERT_TAIL(&rec->ioq.ioq_uv.uvqh.qh, &xioq->ioq_s, q);
+	return (xioq);
+}
 
-	if (!xd->sx_fbtbc) {
-		rlen = recv(xprt->xp_fd, &xd->sx_fbtbc, BYTES_PER_XDR_UNIT,
-			    MSG_WAITALL);
+/*
+ * Parse buffered record marks and fragments.
+ *
+ * Returns the finished request, NULL when more data is needed, or
+ * (void *)-1 on a protocol error.
+ */
+static struct xdr_ioq *
+svc_vc_recv_parse(SVCXPRT *xprt, struct xdr_ioq *xioq,
+		  struct xdr_ioq_uv *uv)
+{
+	struct rpc_dplx_rec *rec = REC_XPRT(xprt);
+	struct svc_vc_xprt *xd = VC_DR(rec);
+	u_int avail;
+	u_int n;
+
+	for (;;) {
+		avail = xd->sx_ra.tail - xd->sx_ra.head;
+
+		if (xd->sx_fbtbc) {
+			uv = IOQ_(TAILQ_LAST(&xioq->ioq_uv.uvqh.qh,
+					     poolq_head_s));
+			n = MIN(avail, (u_int)xd->sx_fbtbc);
+			memcpy(uv->v.vio_tail, xd->sx_ra.base + xd->sx_ra.head,
+			       n);
+			uv->v.vio_tail += n;
+			xd->sx_ra.head += n;
+			xd->sx_fbtbc -= n;
+
+			if (xd->sx_fbtbc) {
+				/* short read, nothing more yet */
+				return (NULL);
+			}
+			avail -= n;
+		}
 
-		if (unlikely(rlen <= 0)) {
-			code = errno;
+		if (uv && !(uv->u.uio_flags & UIO_FLAG_MORE)) {
+			/* finished a request */
+			(rec->ioq.ioq_uv.uvqh.qcount)--;
+			TAILQ_REMOVE(&rec->ioq.ioq_uv.uvqh.qh, &xioq->ioq_s, q);
+			xdr_ioq_reset(xioq, 0);
+			return (xioq);
+		}
 
-			__warnx(TIRPC_DEBUG_FLAG_WARN,
-				"%s: %p fd %d recv errno %d (will set dead)",
-				__func__, xprt, xprt->xp_fd, code);
-			SVC_DESTROY(xprt);
-			return SVC_STAT(xprt);
+		if (avail < BYTES_PER_XDR_UNIT) {
+			/* record mark is in transit */
+			return (NULL);
 		}
 
+		memcpy(&xd->sx_fbtbc, xd->sx_ra.base + xd->sx_ra.head,
+		       BYTES_PER_XDR_UNIT);
+		xd->sx_ra.head += BYTES_PER_XDR_UNIT;
 		xd->sx_fbtbc = (int32_t)ntohl((long)xd->sx_fbtbc);
-		flags = UIO_FLAG_FREE | UIO_FLAG_MORE;
+		n = UIO_FLAG_FREE | UIO_FLAG_MORE;
 
 		if (xd->sx_fbtbc & LAST_FRAG) {
 			xd->sx_fbtbc &= (~LAST_FRAG);
-			flags = UIO_FLAG_FREE;
+			n = UIO_FLAG_FREE;
 		}
 
 		if (unlikely(!xd->sx_fbtbc)) {
 			__warnx(TIRPC_DEBUG_FLAG_ERROR,
 				"%s: %p fd %d fragment is zero (will set dead)",
 				__func__, xprt, xprt->xp_fd);
-			SVC_DESTROY(xprt);
-			return SVC_STAT(xprt);
+			return ((struct xdr_ioq *)-1);
 		}
 
 		/* one buffer per fragment */
-		uv = xdr_ioq_uv_create(xd->sx_fbtbc, flags);
+		uv = xdr_ioq_uv_create(xd->sx_fbtbc, n);
 		(xioq->ioq_uv.uvqh.qcount)++;
 		TAILQ_INSERT_TAIL(&xioq->ioq_uv.uvqh.qh, &uv->uvq, q);
-	} else {
-		uv = IOQ_(TAILQ_LAST(&xioq->ioq_uv.uvqh.qh, poolq_head_s));
-		flags = uv->u.uio_flags;
 	}
+}
 
-	rlen = recv(xprt->xp_fd, uv->v.vio_tail, xd->sx_fbtbc, MSG_DONTWAIT);
+/*
+ * Account for one recv (of up to want) into the read-ahead buffer, or
+ * directly into the last fragment buffer (returned in *uv).  Returns
+ * XPRT_IDLE when there is nothing more to read now, XPRT_DIED on error
+ * or close, otherwise XPRT_MOREREQS.
+ */
+static enum xprt_stat
+svc_vc_recvd(SVCXPRT *xprt, struct xdr_ioq *xioq, ssize_t rlen, u_int want,
+	     struct xdr_ioq_uv **uv, bool *drained)
+{
+	struct svc_vc_xprt *xd = VC_DR(REC_XPRT(xprt));
+	int code;
 
 	if (unlikely(rlen < 0)) {
 		code = errno;
 
-		if (code == EAGAIN || code == EWOULDBLOCK) {
+		if (code == EAGAIN || code == EWOULDBLOCK
+		 || code == EINTR) {
 			__warnx(TIRPC_DEBUG_FLAG_SVC_VC,
 				"%s: %p fd %d recv errno %d (try again)",
 				__func__, xprt, xprt->xp_fd, code);
-			return SVC_STAT(xprt);
+			*drained = (code != EINTR);
+			return (XPRT_IDLE);
 		}
-		__warnx(TIRPC_DEBUG_FLAG_ERROR,
+		__warnx(TIRPC_DEBUG_FLAG_WARN,
 			"%s: %p fd %d recv errno %d (will set dead)",
 			__func__, xprt, xprt->xp_fd, code);
-		SVC_DESTROY(xprt);
-		return SVC_STAT(xprt);
+		return (XPRT_DIED);
 	}
 
 	if (unlikely(!rlen)) {
 		__warnx(TIRPC_DEBUG_FLAG_EVENT,
 			"%s: %p fd %d recv closed (will set dead)",
 			__func__, xprt, xprt->xp_fd);
-		SVC_DESTROY(xprt);
-		return SVC_STAT(xprt);
+		return (XPRT_DIED);
 	}
 
-	uv->v.vio_tail += rlen;
-	xd->sx_fbtbc -= rlen;
+	if (xd->sx_ra.direct) {
+		*uv = IOQ_(TAILQ_LAST(&xioq->ioq_uv.uvqh.qh, poolq_head_s));
+		(*uv)->v.vio_tail += rlen;
+		xd->sx_fbtbc -= rlen;
+		xd->sx_ra.direct = false;
+	} else {
+		xd->sx_ra.tail += rlen;
+	}
+	*drained = (rlen < want);
 
 	__warnx(TIRPC_DEBUG_FLAG_SVC_VC,
-		"%s: %p fd %d recv %zd, need %" PRIu32 ", flags %x",
-		__func__, xprt, xprt->xp_fd, rlen, xd->sx_fbtbc, flags);
+		"%s: %p fd %d recv %zd, need %" PRIu32 ", buffered %u",
+		__func__, xprt, xprt->xp_fd, rlen, xd->sx_fbtbc,
+		xd->sx_ra.tail - xd->sx_ra.head);
+	return (XPRT_MOREREQS);
+}
 
-	if (xd->sx_fbtbc || (flags & UIO_FLAG_MORE)) {
-		if (unlikely(svc_rqst_rearm_events(xprt))) {
-			__warnx(TIRPC_DEBUG_FLAG_ERROR,
-				"%s: %p fd %d svc_rqst_rearm_events failed (will set dead)",
-				__func__, xprt, xprt->xp_fd);
-			SVC_DESTROY(xprt);
-		}
-		return SVC_STAT(xprt);
+/*
+ * Every complete request already buffered (up to the per connection
+ * recv_max) is parsed on each event.  The first is handled by this hot
+ * thread, the rest are submitted to the work pool as a batch.
+ */
+static enum xprt_stat
+svc_vc_recv(SVCXPRT *xprt)
+{
+	struct rpc_dplx_rec *rec = REC_XPRT(xprt);
+	struct svc_vc_xprt *xd = VC_DR(rec);
+	struct poolq_head_s batch;
+	struct xdr_ioq *first = NULL;
+	struct xdr_ioq_uv *uv;
+	struct xdr_ioq *xioq;
+	struct xdr_ioq *done;
+	struct poolq_entry *have;
+	enum xprt_stat stat;
+	void *buf;
+	ssize_t rlen;
+	u_int count = 0;
+	u_int want;
+	bool drained = false;
+	bool received = false;
+#if defined(TIRPC_URING)
+	uint8_t op;
+	int32_t res;
+#endif
+
+	/* no need for locking, only one svc_rqst_xprt_task() per event.
+	 * depends upon svc_rqst_rearm_events() for ordering.
+	 */
+	if (unlikely(!xd->sx_ra.base))
+		xd->sx_ra.base = mem_alloc(SVC_VC_RA_BUFSZ);
+
+#if defined(MSG_ZEROCOPY)
+	/* completions raise EPOLLERR, until reaped */
+	if (rec->zc.done != rec->zc.next)
+		svc_ioq_zerocopy_reap(xprt);
+#endif
+
+	TAILQ_INIT(&batch);
+	xioq = svc_vc_recv_xioq(xd);
+
+#if defined(TIRPC_URING)
+	if (svc_rqst_uring_done(xprt, &op, &res) && op == IORING_OP_RECV) {
+		/* prepared by svc_vc_ra_rearm() */
+		received = true;
+		rlen = res;
+		if (res < 0)
+			errno = -res;
+		want = (u_int)-1;
 	}
+#endif
 
-	/* finished a request */
-	(rec->ioq.ioq_uv.uvqh.qcount)--;
-	TAILQ_REMOVE(&rec->ioq.ioq_uv.uvqh.qh, &xioq->ioq_s, q);
-	xdr_ioq_reset(xioq, 0);
+	while (count < __svc_params->xprt_u.vc.recv_max) {
+		uv = NULL;
 
-	if (unlikely(svc_rqst_rearm_events(xprt))) {
+		if (!received && !svc_vc_ra_ready(xd)) {
+			if (drained)
+				break;
+
+			/* edge triggered may have nothing more to read */
+			want = svc_vc_ra_prep(xd, xioq, &buf);
+			rlen = recv(xprt->xp_fd, buf, want, MSG_DONTWAIT);
+			received = true;
+		}
+
+		if (received) {
+			received = false;
+			stat = svc_vc_recvd(xprt, xioq, rlen, want, &uv,
+					    &drained);
+			if (stat == XPRT_IDLE)
+				break;
+			if (unlikely(stat == XPRT_DIED))
+				goto destroy;
+		}
+
+		done = svc_vc_recv_parse(xprt, xioq, uv);
+		if (unlikely(done == (struct xdr_ioq *)-1))
+			goto destroy;
+		if (!done)
+			continue;
+
+		if (!first) {
+			first = done;
+		} else {
+			SVC_REF(xprt, SVC_REF_FLAG_NONE);
+			done->ioq_wpe.fun = svc_vc_request_task;
+			done->ioq_wpe.arg = xprt;
+			TAILQ_INSERT_TAIL(&batch, &done->ioq_wpe.pqe, q);
+		}
+		count++;
+		xioq = svc_vc_recv_xioq(xd);
+	}
+
+	if (unlikely(svc_vc_ra_rearm(xprt, xioq, drained))) {
 		__warnx(TIRPC_DEBUG_FLAG_ERROR,
 			"%s: %p fd %d svc_rqst_rearm_events failed (will set dead)",
 			__func__, xprt, xprt->xp_fd);
-		xdr_ioq_destroy(xioq, xioq->ioq_s.qsize);
-		SVC_DESTROY(xprt);
-		return SVC_STAT(xprt);
+		goto destroy;
 	}
 
-	return (__svc_params->request_cb(xprt, xioq->xdrs));
+	if (!first)
+		return SVC_STAT(xprt);
+
+	if (count > 1) {
+		__warnx(TIRPC_DEBUG_FLAG_SVC_VC,
+			"%s: %p fd %d pipelined %u requests",
+			__func__, xprt, xprt->xp_fd, count);
+		work_pool_submit_batch(&svc_work_pool, &batch);
+	}
+	return (__svc_params->request_cb(xprt, first->xdrs));
+
+ destroy:
+	if (first)
+		xdr_ioq_destroy(first, first->ioq_s.qsize);
+	while ((have = TAILQ_FIRST(&batch))) {
+		TAILQ_REMOVE(&batch, have, q);
+		done = opr_containerof(have, struct xdr_ioq, ioq_wpe.pqe);
+		xdr_ioq_destroy(done, done->ioq_s.qsize);
+		SVC_RELEASE(xprt, SVC_RELEASE_FLAG_NONE);
+	}
+	SVC_DESTROY(xprt);
+	return SVC_STAT(xprt);
 }
 
 static enum xprt_stat
@@ -34,6 +34,7 @@
 #include <err.h>
 #include <errno.h>
 #include <unistd.h>
+#include <sched.h>
 #include <signal.h>
 #include <rpc/types.h>
 #include <misc/portable.h>
@@ -52,78 +53,66 @@
  *
  * @section DESCRIPTION
  *
- * Maintains a tree of all extant transports by fd.
+ * Maintains a table of all extant transports, indexed by fd.
  *
  * Each SVCXPRT has its own instance, however, so operations to
  * close and delete (for example) given an existing xprt handle
  * are O(1) without any ordered or hashed representation.
  *
- * @note currently static sizes
- *	partitions should be largish prime, relative to connections.
- *	no cache slots, as rpc_dplx_rec has fd_node for direct access.
+ * Lookups do not lock: they mark the slot busy, take a reference, and
+ * restore it.  Clearing (under lock) waits only for a busy mark on that
+ * same slot, a few instructions, so a transport is freed only after no
+ * reader can reach it.  The table doubles (under lock) to hold larger
+ * fds; slots of the replaced table are marked moved, and it is kept
+ * until shutdown, as readers may still be looking at it.
  */
 
-#define SVC_XPRT_PARTITIONS 193
+#define SVC_XPRT_FD_MIN 1024
+
+/* tag bits of a slot (rec) pointer */
+#define SVC_XPRT_SLOT_BUSY	((uintptr_t)0x1)	/* reader taking ref */
+#define SVC_XPRT_SLOT_MOVED	((uintptr_t)0x2)	/* table was replaced */
+
+struct svc_xprt_tab {
+	struct svc_xprt_tab *retired;	/* replaced by a larger table */
+	u_int size;
+	struct rpc_dplx_rec *rec[];
+};
 
 static bool initialized;
 
 struct svc_xprt_fd {
-	mutex_t lock;
-	struct rbtree_x xt;
+	mutex_t lock;			/* slot writers, growth */
+	struct svc_xprt_tab *tab;
 };
 
 static struct svc_xprt_fd svc_xprt_fd = {
 	MUTEX_INITIALIZER /* svc_xprt_lock */ ,
-	{
-	 SVC_XPRT_PARTITIONS,	/* npart */
-	 RBT_X_FLAG_NONE,	/* flags */
-	 0,			/* cachesz */
-	 NULL			/* tree */
-	}			/* xt */
+	NULL,			/* tab */
 };
 
-static inline int
-svc_xprt_fd_cmpf(const struct opr_rbtree_node *lhs,
-		 const struct opr_rbtree_node *rhs)
+static struct svc_xprt_tab *
+svc_xprt_tab_alloc(u_int size)
 {
-	struct rpc_dplx_rec *lk, *rk;
-
-	lk = opr_containerof(lhs, struct rpc_dplx_rec, fd_node);
-	rk = opr_containerof(rhs, struct rpc_dplx_rec, fd_node);
+	struct svc_xprt_tab *tab =
+		mem_zalloc(sizeof(*tab) + size * sizeof(tab->rec[0]));
 
-	if (lk->xprt.xp_fd < rk->xprt.xp_fd)
-		return (-1);
-
-	if (lk->xprt.xp_fd == rk->xprt.xp_fd)
-		return (0);
-
-	return (1);
+	tab->size = size;
+	return (tab);
 }
 
 int
 svc_xprt_init(void)
 {
-	int code = 0;
-
 	mutex_lock(&svc_xprt_fd.lock);
 
-	if (initialized)
-		goto unlock;
-
-	/* one of advantages of this RBT is convenience of external
-	 * iteration, we'll go to that shortly */
-	code =
-	    rbtx_init(&svc_xprt_fd.xt, svc_xprt_fd_cmpf /* NULL (inline) */ ,
-		      SVC_XPRT_PARTITIONS, RBT_X_FLAG_ALLOC);
-	if (code)
-		__warnx(TIRPC_DEBUG_FLAG_SVC_XPRT,
-			"svc_xprt_init: rbtx_init failed");
-
-	initialized = true;
+	if (!initialized) {
+		svc_xprt_fd.tab = svc_xprt_tab_alloc(SVC_XPRT_FD_MIN);
+		initialized = true;
+	}
 
- unlock:
 	mutex_unlock(&svc_xprt_fd.lock);
-	return (code);
+	return (0);
 }
 
 static inline bool
@@ -134,59 +123,140 @@ svc_xprt_init_failure(void)
 	return (svc_xprt_init() != 0);
 }
 
+/*
+ * Locked; the slot's rec, without a reader's busy mark.
+ */
+static inline struct rpc_dplx_rec *
+svc_xprt_slot_rec(struct rpc_dplx_rec **slot)
+{
+	return ((struct rpc_dplx_rec *)
+		((uintptr_t)atomic_fetch_voidptr((void **)slot)
+		 & ~SVC_XPRT_SLOT_BUSY));
+}
+
+/*
+ * Without lock; returns with a reference, or NULL.
+ */
+static inline struct rpc_dplx_rec *
+svc_xprt_get(int fd)
+{
+	struct svc_xprt_tab *tab;
+	void **slot;
+	void *v;
+
+ retry:
+	tab = atomic_fetch_voidptr((void **)&svc_xprt_fd.tab);
+	if (unlikely(!tab || (u_int)fd >= tab->size))
+		return (NULL);
+
+	slot = (void **)&tab->rec[fd];
+	while ((v = atomic_fetch_voidptr(slot))) {
+		if ((uintptr_t)v & SVC_XPRT_SLOT_MOVED)
+			goto retry;
+		if ((uintptr_t)v & SVC_XPRT_SLOT_BUSY) {
+			/* another reader, only a few instructions */
+			sched_yield();
+			continue;
+		}
+		if (!atomic_cas_voidptr(slot, v,
+				(void *)((uintptr_t)v | SVC_XPRT_SLOT_BUSY)))
+			continue;
+
+		SVC_REF(&((struct rpc_dplx_rec *)v)->xprt, SVC_REF_FLAG_NONE);
+		atomic_store_voidptr(slot, v);
+		return ((struct rpc_dplx_rec *)v);
+	}
+	return (NULL);
+}
+
+/*
+ * Locked; replaces the slot value v (rec or NULL) with nv, after any
+ * reader of this slot has its reference.
+ */
+static void
+svc_xprt_slot_set(void **slot, void *v, void *nv)
+{
+	void *busy = (void *)((uintptr_t)v | SVC_XPRT_SLOT_BUSY);
+
+	while (!atomic_cas_voidptr(slot, v, nv)) {
+		if (atomic_fetch_voidptr(slot) != busy)
+			break;	/* cannot happen, only changed under lock */
+		sched_yield();
+	}
+}
+
+/*
+ * Locked; the table holds fd on return.
+ */
+static struct svc_xprt_tab *
+svc_xprt_tab_grow(int fd)
+{
+	struct svc_xprt_tab *tab = svc_xprt_fd.tab;
+	struct svc_xprt_tab *next;
+	u_int size = tab->size;
+	u_int ix;
+
+	if (likely((u_int)fd < size))
+		return (tab);
+
+	while (size <= (u_int)fd)
+		size <<= 1;
+	next = svc_xprt_tab_alloc(size);
+	for (ix = 0; ix < tab->size; ix++)
+		next->rec[ix] = svc_xprt_slot_rec(&tab->rec[ix]);
+	next->retired = tab;
+	atomic_store_voidptr((void **)&svc_xprt_fd.tab, next);
+
+	/* readers of the replaced table look again */
+	for (ix = 0; ix < tab->size; ix++)
+		svc_xprt_slot_set((void **)&tab->rec[ix], next->rec[ix],
+				  (void *)SVC_XPRT_SLOT_MOVED);
+	return (next);
+}
+
 /*
  * On success, returns with RPC_DPLX_FLAG_LOCKED
  */
 SVCXPRT *
 svc_xprt_lookup(int fd, svc_xprt_setup_t setup)
 {
-	struct rpc_dplx_rec sk;
+	struct svc_xprt_tab *tab;
 	struct rpc_dplx_rec *rec;
-	struct rbtree_x_part *t;
-	struct opr_rbtree_node *nv;
 	SVCXPRT *xprt = NULL;
 
-	if (svc_xprt_init_failure())
+	if (svc_xprt_init_failure() || fd < 0)
 		return (NULL);
 
-	sk.xprt.xp_fd = fd;
-	t = rbtx_partition_of_scalar(&svc_xprt_fd.xt, fd);
-
-	rwlock_rdlock(&t->lock);
-	nv = opr_rbtree_lookup(&t->t, &sk.fd_node);
-	if (!nv) {
-		rwlock_unlock(&t->lock);
+	rec = svc_xprt_get(fd);
+	if (!rec) {
 		if (!setup)
 			return (NULL);
 
-		rwlock_wrlock(&t->lock);
-		nv = opr_rbtree_lookup(&t->t, &sk.fd_node);
-		if (!nv) {
+		mutex_lock(&svc_xprt_fd.lock);
+		if (unlikely(!svc_xprt_fd.tab)) {
+			/* after svc_xprt_shutdown() */
+			mutex_unlock(&svc_xprt_fd.lock);
+			return (NULL);
+		}
+		tab = svc_xprt_tab_grow(fd);
+		rec = svc_xprt_slot_rec(&tab->rec[fd]);
+		if (!rec) {
 			(*setup)(&xprt); /* zalloc, xp_refs = 1 */
 			xprt->xp_fd = fd;
 			xprt->xp_flags = SVC_XPRT_FLAG_INITIAL;
 
 			rec = REC_XPRT(xprt);
 			rpc_dplx_rli(rec);
-			if (opr_rbtree_insert(&t->t, &rec->fd_node)) {
-				/* cant happen */
-				rpc_dplx_rui(rec);
-				__warnx(TIRPC_DEBUG_FLAG_LOCK,
-					"%s: collision inserting in locked rbtree partition",
-					__func__);
-				(*setup)(&xprt);	/* free, sets NULL */
-			}
-			rwlock_unlock(&t->lock);
+			atomic_store_voidptr((void **)&tab->rec[fd], rec);
+			mutex_unlock(&svc_xprt_fd.lock);
 			return (xprt);
 		}
 		/* raced, fallthru */
+		SVC_REF(&rec->xprt, SVC_REF_FLAG_NONE);
+		mutex_unlock(&svc_xprt_fd.lock);
 	}
-	rec = opr_containerof(nv, struct rpc_dplx_rec, fd_node);
 	xprt = &rec->xprt;
-
-	SVC_REF(xprt, SVC_REF_FLAG_NONE);
 	rpc_dplx_rli(rec);
-	rwlock_unlock(&t->lock);
 
 	if (unlikely(xprt->xp_flags & SVC_XPRT_FLAG_DESTROYED)) {
 		/* do not return destroyed xprts */
@@ -203,89 +273,58 @@ svc_xprt_lookup(int fd, svc_xprt_setup_t setup)
  * Clear an xprt
  *
  * @note Locking
- * - xprt is locked
- *   returned locked
+ * - xprt need not be locked; waits only for lookups of its own slot
  */
 void
 svc_xprt_clear(SVCXPRT *xprt)
 {
-	struct rbtree_x_part *t;
+	struct rpc_dplx_rec *rec = REC_XPRT(xprt);
+	struct svc_xprt_tab *tab;
+	int fd = xprt->xp_fd;
 
-	if (svc_xprt_init_failure())
+	if (svc_xprt_init_failure() || fd < 0)
 		return;
 
-	if (opr_rbtree_node_valid(&REC_XPRT(xprt)->fd_node)) {
-		t = rbtx_partition_of_scalar(&svc_xprt_fd.xt, xprt->xp_fd);
+	/* not (or no longer) in the table, eg svc_dg requests */
+	tab = atomic_fetch_voidptr((void **)&svc_xprt_fd.tab);
+	if (!tab || (u_int)fd >= tab->size
+	 || ((uintptr_t)atomic_fetch_voidptr((void **)&tab->rec[fd])
+	     & ~(SVC_XPRT_SLOT_BUSY | SVC_XPRT_SLOT_MOVED)) != (uintptr_t)rec)
+		return;
 
-		rwlock_wrlock(&t->lock);
-		opr_rbtree_remove(&t->t, &REC_XPRT(xprt)->fd_node);
-		rwlock_unlock(&t->lock);
-	}
+	mutex_lock(&svc_xprt_fd.lock);
+	tab = svc_xprt_fd.tab;
+	if (tab && (u_int)fd < tab->size
+	 && svc_xprt_slot_rec(&tab->rec[fd]) == rec)
+		svc_xprt_slot_set((void **)&tab->rec[fd], rec, NULL);
+	mutex_unlock(&svc_xprt_fd.lock);
 }
 
 int
 svc_xprt_foreach(svc_xprt_each_func_t each_f, void *arg)
 {
-	struct rpc_dplx_rec sk;
+	struct svc_xprt_tab *tab;
 	struct rpc_dplx_rec *rec;
-	struct rbtree_x_part *t;
-	struct opr_rbtree_node *n;
-	uint64_t tgen;
-	int p_ix;
-	int x_ix;
-	int restarts;
+	u_int fd;
 
 	if (svc_xprt_init_failure())
 		return (-1);
 
-	/* concurrent, restartable iteration over t */
-	p_ix = 0;
-	while (p_ix < SVC_XPRT_PARTITIONS) {
-		t = &svc_xprt_fd.xt.tree[p_ix];
-		restarts = 0;
-		/* TI-RPC __svc_clean_idle held global svc_fd_lock
-		 * exclusive locked for a full scan of the legacy svc_xprts
-		 * array.  We avoid this via tree partitioning and by
-		 * operating mostly unlocked. */
- restart:
-		if (++restarts > 5)
-			return (1);
-
-		/* start with rlock */
-		rwlock_rdlock(&t->lock);	/* t RLOCKED */
-		tgen = t->t.gen;
-		x_ix = 0;
-		n = opr_rbtree_first(&t->t);
-		while (n != NULL) {
-			++x_ix;	/* diagnostic, index into logical srec
-				 * sequence */
-			rec = opr_containerof(n, struct rpc_dplx_rec, fd_node);
-			sk.xprt.xp_fd = rec->xprt.xp_fd;
-
-			/* call each_func with t !LOCKED */
-			rwlock_unlock(&t->lock);
-
-			/* restart if each_f disposed xprt */
-			if (each_f(&rec->xprt, arg))
-				goto restart;
-
-			/* validate */
-			rwlock_rdlock(&t->lock);
-
-			if (tgen != t->t.gen) {
-				n = opr_rbtree_lookup(&t->t, &sk.fd_node);
-				if (!n) {
-					/* invalidated, try harder */
-					rwlock_unlock(&t->lock);
-							/* t !LOCKED */
-					goto restart;
-				}
-			}
-			n = opr_rbtree_next(n);
-		}		/* curr partition */
-		rwlock_unlock(&t->lock); /* t !LOCKED */
-		p_ix++;
-	}			/* SVC_XPRT_PARTITIONS */
+	/* TI-RPC __svc_clean_idle held global svc_fd_lock
+	 * exclusive locked for a full scan of the legacy svc_xprts
+	 * array.  Here, each_f is called without locks, holding a
+	 * reference to its transport. */
+	for (fd = 0; ; fd++) {
+		tab = atomic_fetch_voidptr((void **)&svc_xprt_fd.tab);
+		if (!tab || fd >= tab->size)
+			break;
+		rec = svc_xprt_get(fd);
+		if (!rec)
+			continue;
+
+		(void)each_f(&rec->xprt, arg);
+		SVC_RELEASE(&rec->xprt, SVC_RELEASE_FLAG_NONE);
+	}
 
 	return (0);
 }
@@ -293,71 +332,75 @@ svc_xprt_foreach(svc_xprt_each_func_t each_f, void *arg)
 void
 svc_xprt_dump_xprts(const char *tag)
 {
-	struct rbtree_x_part *t = NULL;
-	struct opr_rbtree_node *n;
+	struct svc_xprt_tab *tab;
 	struct rpc_dplx_rec *rec;
-	int p_ix;
+	u_int fd;
+	u_int n = 0;
 
 	if (!initialized)
-		goto out;
+		return;
 
-	p_ix = 0;
-	while (p_ix < SVC_XPRT_PARTITIONS) {
-		t = &svc_xprt_fd.xt.tree[p_ix];
-		rwlock_rdlock(&t->lock);	/* t RLOCKED */
+	/* cleared transports are not freed while locked */
+	mutex_lock(&svc_xprt_fd.lock);
+	tab = svc_xprt_fd.tab;
+	for (fd = 0; tab && fd < tab->size; fd++) {
+		rec = svc_xprt_slot_rec(&tab->rec[fd]);
+		if (!rec)
+			continue;
+		n++;
 		__warnx(TIRPC_DEBUG_FLAG_SVC_XPRT,
-			"xprts at %s: tree %d size %d", tag, p_ix, t->t.size);
-		n = opr_rbtree_first(&t->t);
-		while (n != NULL) {
-			rec = opr_containerof(n, struct rpc_dplx_rec, fd_node);
-			__warnx(TIRPC_DEBUG_FLAG_SVC_XPRT,
-				"xprts at %s: %p xp_fd %d",
-				tag, &rec->xprt, rec->xprt.xp_fd);
-			n = opr_rbtree_next(n);
-		}		/* curr partition */
-		rwlock_unlock(&t->lock);	/* t !LOCKED */
-		p_ix++;
-	}			/* SVC_XPRT_PARTITIONS */
- out:
-	return;
+			"xprts at %s: %p xp_fd %d",
+			tag, &rec->xprt, rec->xprt.xp_fd);
+	}
+	__warnx(TIRPC_DEBUG_FLAG_SVC_XPRT,
+		"xprts at %s: %u of table size %u",
+		tag, n, tab ? tab->size : 0);
+	mutex_unlock(&svc_xprt_fd.lock);
 }
 
 void
 svc_xprt_shutdown()
 {
-	struct rbtree_x_part *t;
-	struct opr_rbtree_node *n;
+	struct svc_xprt_tab *tab;
 	struct rpc_dplx_rec *rec;
-	int p_ix;
+	u_int fd;
 
 	if (!initialized)
 		return;
 
-	p_ix = 0;
-	while (p_ix < SVC_XPRT_PARTITIONS) {
-		t = &svc_xprt_fd.xt.tree[p_ix];
+	for (fd = 0; ; fd++) {
+		/* prevent repeats, see svc_xprt_clear() */
+		mutex_lock(&svc_xprt_fd.lock);
+		tab = svc_xprt_fd.tab;
+		if (!tab || fd >= tab->size) {
+			mutex_unlock(&svc_xprt_fd.lock);
+			break;
+		}
+		rec = svc_xprt_slot_rec(&tab->rec[fd]);
+		if (rec)
+			svc_xprt_slot_set((void **)&tab->rec[fd], rec, NULL);
+		mutex_unlock(&svc_xprt_fd.lock);
+
+		if (!rec)
+			continue;
+		SVC_DESTROY(&rec->xprt);
+	}
 
-		rwlock_wrlock(&t->lock);	/* t WLOCKED */
-		n = opr_rbtree_first(&t->t);
-		while (n != NULL) {
-			rec = opr_containerof(n, struct rpc_dplx_rec, fd_node);
-			n = opr_rbtree_next(n);
+	/* free tables; later lookups find nothing */
+	mutex_lock(&svc_xprt_fd.lock);
+	tab = svc_xprt_fd.tab;
+	atomic_store_voidptr((void **)&svc_xprt_fd.tab, NULL);
+	for (fd = 0; tab && fd < tab->size; fd++)
+		svc_xprt_slot_set((void **)&tab->rec[fd], NULL,
+				  (void *)SVC_XPRT_SLOT_MOVED);
+	mutex_unlock(&svc_xprt_fd.lock);
 
-			/* prevent repeats, see svc_xprt_clear() */
-			rpc_dplx_rli(rec);
-			opr_rbtree_remove(&t->t, &rec->fd_node);
-			rpc_dplx_rui(rec);
-
-			SVC_DESTROY(&rec->xprt);
-		}		/* curr partition */
-		rwlock_unlock(&t->lock);	/* t !LOCKED */
-		rwlock_destroy(&t->lock);
-		p_ix++;
-	}			/* SVC_XPRT_PARTITIONS */
-
-	/* free tree */
-	mem_free(svc_xprt_fd.xt.tree,
-		 SVC_XPRT_PARTITIONS * sizeof(struct rbtree_x_part));
+	while (tab) {
+		struct svc_xprt_tab *retired = tab->retired;
+
+		mem_free(tab, sizeof(*tab) + tab->size * sizeof(tab->rec[0]));
+		tab = retired;
+	}
 }
 
 void
@@ -30,7 +30,6 @@
 
 #include <rpc/svc.h>
 #include <misc/portable.h>
-#include <misc/rbtree_x.h>
 
 /**
  * @file svc_xprt.h
@@ -39,14 +38,14 @@
  *
  * @section DESCRIPTION
  *
- * Maintains a tree of all extant transports by fd.
+ * Maintains a table of all extant transports, indexed by fd.
  *
  *  svc_xprt_init -- init module; usually called by svc_init()
  *  svc_xprt_lookup -- find or create shared fd state
  *  svc_xprt_clear -- remove a transport
  *  svc_xprt_foreach -- scan registered transports
  *  svc_xprt_dump_xprts -- dump registered transports
- *  svc_xprt_shutdown -- clear the tree, destroy transports
+ *  svc_xprt_shutdown -- clear the table, destroy transports
  */
 
 int svc_xprt_init(void);
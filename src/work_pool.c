@@ -32,6 +32,10 @@
  *
  * This provides simple work queues using pthreads and TAILQ primitives.
  *
+ * With WORK_POOL_FLAG_STEAL, each worker also has its own queue.  Work
+ * submitted by a worker is queued there, and idle workers steal from
+ * the other queues before waiting on the shared queue.
+ *
  * @note    Loosely based upon previous thrdpool by
  *          Matt Benjamin <matt@cohortfs.com>
  */
@@ -60,6 +64,12 @@
 #define WORK_POOL_STACK_SIZE MAX(64 * 1024, PTHREAD_STACK_MIN)
 #define WORK_POOL_TIMEOUT_MS (31 /* seconds (prime) */ * 1000)
 
+/* wpt->pqe.qflags */
+#define WORK_POOL_THREAD_WAITING 0x0001	/* on pqh, not yet dispatched */
+
+/* worker context of the current thread, if any */
+static __thread struct work_pool_thread *work_pool_self;
+
 /* forward declaration in lieu of moving code, was inline */
 
 static int work_pool_spawn(struct work_pool *pool);
@@ -91,6 +101,16 @@ work_pool_init(struct work_pool *pool, const char *name,
 		pool->params.thrd_min = 1;
 	};
 
+	if (pool->params.flags & WORK_POOL_FLAG_STEAL) {
+		uint32_t ix;
+
+		pool->n_queues = pool->params.thrd_max;
+		pool->wpq = mem_zalloc(pool->n_queues * sizeof(*pool->wpq));
+
+		for (ix = 0; ix < pool->n_queues; ix++)
+			poolq_head_setup(&pool->wpq[ix].pqh);
+	}
+
 	rc = pthread_attr_init(&pool->attr);
 	if (rc) {
 		__warnx(TIRPC_DEBUG_FLAG_ERROR,
@@ -126,6 +146,139 @@ work_pool_init(struct work_pool *pool, const char *name,
 	return work_pool_spawn(pool);
 }
 
+/*
+ * Per-worker queues (WORK_POOL_FLAG_STEAL)
+ *
+ * Each queue is only appended by its owner, so its mutex is normally
+ * uncontended.  The qcount is changed atomically (under the queue mutex)
+ * so that it may be peeked without locking.
+ *
+ * Lock order:  pool->pqh.qmutex, then wpq->pqh.qmutex.
+ */
+
+static inline void
+work_pool_queue_put(struct work_pool_queue *wpq, struct work_pool_entry *work)
+{
+	pthread_mutex_lock(&wpq->pqh.qmutex);
+	TAILQ_INSERT_TAIL(&wpq->pqh.qh, &work->pqe, q);
+	atomic_inc_int32_t(&wpq->pqh.qcount);
+	pthread_mutex_unlock(&wpq->pqh.qmutex);
+}
+
+static inline void
+work_pool_queue_concat(struct work_pool_queue *wpq, struct poolq_head_s *batch,
+		       int count)
+{
+	pthread_mutex_lock(&wpq->pqh.qmutex);
+	TAILQ_CONCAT(&wpq->pqh.qh, batch, q);
+	atomic_add_int32_t(&wpq->pqh.qcount, count);
+	pthread_mutex_unlock(&wpq->pqh.qmutex);
+}
+
+static inline struct work_pool_entry *
+work_pool_queue_get(struct work_pool_queue *wpq)
+{
+	struct poolq_entry *have;
+
+	if (atomic_fetch_int32_t(&wpq->pqh.qcount) <= 0)
+		return (NULL);
+
+	pthread_mutex_lock(&wpq->pqh.qmutex);
+	have = TAILQ_FIRST(&wpq->pqh.qh);
+	if (have) {
+		TAILQ_REMOVE(&wpq->pqh.qh, have, q);
+		atomic_dec_int32_t(&wpq->pqh.qcount);
+	}
+	pthread_mutex_unlock(&wpq->pqh.qmutex);
+
+	return ((struct work_pool_entry *)have);
+}
+
+/*
+ * Without the pool lock (peeks), while tasks are queued on the worker
+ * queues instead of the shared queue.  One spawn at a time, until the
+ * new thread is counted in n_threads.
+ */
+static inline void
+work_pool_grow(struct work_pool *pool)
+{
+	if (atomic_fetch_int32_t(&pool->pqh.qcount) >= pool->params.thrd_min
+	 || atomic_fetch_uint32_t(&pool->n_threads)
+	    >= (uint32_t)pool->params.thrd_max
+	 || atomic_postset_uint32_t_bits(&pool->spawning, 1))
+		return;
+
+	if (work_pool_spawn(pool))
+		atomic_store_uint32_t(&pool->spawning, 0);
+}
+
+/*
+ * Own queue first, then the others, starting after own queue.
+ */
+static struct work_pool_entry *
+work_pool_steal(struct work_pool *pool, struct work_pool_thread *wpt)
+{
+	struct work_pool_entry *work;
+	uint32_t ix = wpt->worker_index;
+	uint32_t n;
+
+	for (n = pool->n_queues; n > 0; n--) {
+		work = work_pool_queue_get(&pool->wpq[ix]);
+		if (work) {
+			__warnx(TIRPC_DEBUG_FLAG_WORKER,
+				"%s() %s task %p from queue %" PRIu32,
+				__func__, pool->name, work, ix);
+			return (work);
+		}
+		if (++ix >= pool->n_queues)
+			ix = 0;
+	}
+	return (NULL);
+}
+
+/*
+ * Called with pool->pqh.qmutex held
+ */
+static void
+work_pool_queue_attach(struct work_pool *pool, struct work_pool_thread *wpt)
+{
+	uint32_t ix;
+
+	for (ix = 0; ix < pool->n_queues; ix++) {
+		if (!pool->wpq[ix].wpt) {
+			pool->wpq[ix].wpt = wpt;
+			wpt->wpq = &pool->wpq[ix];
+			wpt->worker_index = ix;
+			return;
+		}
+	}
+	/* more threads than queues (spawn race), use shared queue only */
+}
+
+/* forward declaration in lieu of moving code */
+static inline void work_pool_insert(struct work_pool *pool,
+				    struct work_pool_entry *work);
+
+/*
+ * Called with pool->pqh.qmutex held
+ */
+static void
+work_pool_queue_detach(struct work_pool *pool, struct work_pool_thread *wpt)
+{
+	struct work_pool_queue *wpq = wpt->wpq;
+	struct work_pool_entry *work;
+
+	if (!wpq)
+		return;
+
+	/* hand remaining tasks to the shared queue (or waiting workers) */
+	while ((work = work_pool_queue_get(wpq)))
+		work_pool_insert(pool, work);
+
+	wpq->wpt = NULL;
+	wpt->wpq = NULL;
+}
+
 /**
  * @brief The worker thread
  *
@@ -145,17 +298,21 @@ work_pool_thread(void *arg)
 	int rc;
 	bool spawn;
 
+	work_pool_self = wpt;
 	pthread_cond_init(&wpt->pqcond, NULL);
 	pthread_mutex_lock(&pool->pqh.qmutex);
 	TAILQ_INSERT_TAIL(&pool->wptqh, wpt, wptq);
 	pool->n_threads++;
+	atomic_store_uint32_t(&pool->spawning, 0);
+
+	if (pool->wpq)
+		work_pool_queue_attach(pool, wpt);
 
 	do {
 		/* testing at top of loop allows pre-specification of work,
 		 * and thread termination after timeout with no work (below).
 		 */
 		if (wpt->work) {
-			wpt->work->wpt = wpt;
 			spawn = pool->pqh.qcount < pool->params.thrd_min
 			      && pool->n_threads < pool->params.thrd_max;
 			pthread_mutex_unlock(&pool->pqh.qmutex);
@@ -165,15 +322,33 @@ work_pool_thread(void *arg)
 				(void)work_pool_spawn(pool);
 			}
 
-			__warnx(TIRPC_DEBUG_FLAG_WORKER,
-				"%s() %s task %p",
-				__func__, pool->name, wpt->work);
-			wpt->work->fun(wpt->work);
-			wpt->work = NULL;
+			do {
+				wpt->work->wpt = wpt;
+				__warnx(TIRPC_DEBUG_FLAG_WORKER,
+					"%s() %s task %p",
+					__func__, pool->name, wpt->work);
+				wpt->work->fun(wpt->work);
+				wpt->work = NULL;
+
+				/* without the pool lock, unless shared
+				 * queue has task(s) waiting (fairness).
+				 */
+				if (pool->wpq
+				 && atomic_fetch_int32_t(&pool->pqh.qcount)
+				    >= 0) {
+					wpt->work = work_pool_steal(pool, wpt);
+					if (wpt->work) {
+						/* still busy */
+						work_pool_grow(pool);
+					}
+				}
+			} while (wpt->work);
+
 			pthread_mutex_lock(&pool->pqh.qmutex);
 		}
 
-		if (0 > pool->pqh.qcount++) {
+		/* atomic, orders against work_pool_submit() peek */
+		if (0 > atomic_postinc_int32_t(&pool->pqh.qcount)) {
 			/* negative for task(s) */
 			have = TAILQ_FIRST(&pool->pqh.qh);
 			TAILQ_REMOVE(&pool->pqh.qh, have, q);
@@ -187,6 +362,20 @@ work_pool_thread(void *arg)
 		 * simplifying mutex and pointer setup.
 		 */
 		TAILQ_INSERT_TAIL(&pool->pqh.qh, &wpt->pqe, q);
+		wpt->pqe.qflags |= WORK_POOL_THREAD_WAITING;
+
+		if (pool->wpq) {
+			/* after waiting is visible, last look for work
+			 * queued by other workers (before they noticed).
+			 */
+			wpt->work = work_pool_steal(pool, wpt);
+			if (wpt->work) {
+				pool->pqh.qcount--;
+				TAILQ_REMOVE(&pool->pqh.qh, &wpt->pqe, q);
+				wpt->pqe.qflags &= ~WORK_POOL_THREAD_WAITING;
+				continue;
+			}
+		}
 
 		__warnx(TIRPC_DEBUG_FLAG_WORKER,
 			"%s() %s waiting for task",
@@ -201,25 +390,37 @@ work_pool_thread(void *arg)
 		 */
 		rc = pthread_cond_timedwait(&wpt->pqcond, &pool->pqh.qmutex,
 					    &ts);
-		if (rc) {
-			if (!wpt->work) {
-				/* Allow for possible timing race:
-				 * work entry can be submitted by another
-				 * thread during the timeout result?
-				 * Then, has already been removed there.
-				 * Only remove with no work here.
-				 */
-				pool->pqh.qcount--;
-				TAILQ_REMOVE(&pool->pqh.qh, &wpt->pqe, q);
-			}
-			if (unlikely(rc != ETIMEDOUT)) {
-				__warnx(TIRPC_DEBUG_FLAG_ERROR,
-					"%s() cond_timedwait failed (%d)\n",
-					__func__, rc);
-				break;
-			}
+		if (wpt->pqe.qflags & WORK_POOL_THREAD_WAITING) {
+			/* Allow for possible timing race:
+			 * work entry can be submitted by another
+			 * thread during the timeout result?
+			 * Then, has already been removed there.
+			 * Only remove when not dispatched (timeout,
+			 * shutdown, or spurious wakeup).
+			 */
+			pool->pqh.qcount--;
+			TAILQ_REMOVE(&pool->pqh.qh, &wpt->pqe, q);
+			wpt->pqe.qflags &= ~WORK_POOL_THREAD_WAITING;
+		}
+		if (unlikely(rc && rc != ETIMEDOUT)) {
+			__warnx(TIRPC_DEBUG_FLAG_ERROR,
+				"%s() cond_timedwait failed (%d)\n",
+				__func__, rc);
+			break;
 		}
-	} while (wpt->work || pool->pqh.qcount <= pool->params.thrd_min);
+		if (unlikely(!pool->params.thrd_max) && !wpt->work) {
+			/* work_pool_shutdown() is draining, the same test as
+			 * work_pool_submit().  The waiting entry was removed
+			 * above, so qcount no longer exceeds thrd_min here.
+			 */
+			break;
+		}
+	} while (wpt->work
+		 || pool->pqh.qcount <= pool->params.thrd_min
+		 || (pool->wpq && (wpt->work = work_pool_steal(pool, wpt))));
+
+	if (pool->wpq)
+		work_pool_queue_detach(pool, wpt);
 
 	pool->n_threads--;
 	TAILQ_REMOVE(&pool->wptqh, wpt, wptq);
@@ -228,6 +429,7 @@ work_pool_thread(void *arg)
 	__warnx(TIRPC_DEBUG_FLAG_WORKER,
 		"%s() %s terminate thread",
 		__func__, pool->name);
+	work_pool_self = NULL;
 	cond_destroy(&wpt->pqcond);
 	mem_free(wpt, sizeof(*wpt));
 
@@ -241,6 +443,7 @@ work_pool_dispatch(struct work_pool *pool, struct work_pool_entry *work)
 		TAILQ_FIRST(&pool->pqh.qh);
 
 	TAILQ_REMOVE(&pool->pqh.qh, &wpt->pqe, q);
+	wpt->pqe.qflags &= ~WORK_POOL_THREAD_WAITING;
 	wpt->work = work;
 
 	/* Note: the mutex is the pool _head,
@@ -250,6 +453,21 @@ work_pool_dispatch(struct work_pool *pool, struct work_pool_entry *work)
 	pthread_cond_signal(&wpt->pqcond);
 }
 
+/*
+ * Called with pool->pqh.qmutex held
+ */
+static inline void
+work_pool_insert(struct work_pool *pool, struct work_pool_entry *work)
+{
+	if (0 < pool->pqh.qcount--) {
+		/* positive for waiting worker(s) */
+		work_pool_dispatch(pool, work);
+	} else {
+		/* negative for task(s) */
+		TAILQ_INSERT_TAIL(&pool->pqh.qh, &work->pqe, q);
+	}
+}
+
 static int
 work_pool_spawn(struct work_pool *pool)
 {
@@ -269,29 +487,126 @@ work_pool_spawn(struct work_pool *pool)
 	return (0);
 }
 
+/*
+ * Worker submitting to its own pool, with own queue (WORK_POOL_FLAG_STEAL)
+ */
+static inline struct work_pool_queue *
+work_pool_self_queue(struct work_pool *pool)
+{
+	if (!pool->wpq
+	 || !work_pool_self
+	 || work_pool_self->pool != pool)
+		return (NULL);
+
+	return (work_pool_self->wpq);
+}
+
+/*
+ * After queuing count task(s) on own queue, wakeup waiting worker(s)
+ * to steal them.  Any worker that began waiting before the task(s)
+ * were visible may already have looked at this queue.
+ */
+static inline void
+work_pool_wakeup(struct work_pool *pool, int count)
+{
+	if (likely(atomic_fetch_int32_t(&pool->pqh.qcount) <= 0))
+		return;
+
+	pthread_mutex_lock(&pool->pqh.qmutex);
+	while (count-- > 0 && 0 < pool->pqh.qcount) {
+		pool->pqh.qcount--;
+		work_pool_dispatch(pool, NULL);
+	}
+	pthread_mutex_unlock(&pool->pqh.qmutex);
+}
+
 int
 work_pool_submit(struct work_pool *pool, struct work_pool_entry *work)
 {
+	struct work_pool_queue *wpq;
 	int rc = 0;
 
 	if (unlikely(!pool->params.thrd_max)) {
 		/* queue is draining */
 		return (0);
 	}
-	pthread_mutex_lock(&pool->pqh.qmutex);
 
-	if (0 < pool->pqh.qcount--) {
-		/* positive for waiting worker(s) */
-		work_pool_dispatch(pool, work);
-	} else {
-		/* negative for task(s) */
-		TAILQ_INSERT_TAIL(&pool->pqh.qh, &work->pqe, q);
+	wpq = work_pool_self_queue(pool);
+	if (wpq && atomic_fetch_int32_t(&pool->pqh.qcount) <= 0) {
+		/* no waiting worker(s), keep on this worker's own queue */
+		work_pool_queue_put(wpq, work);
+		work_pool_wakeup(pool, 1);
+		if (atomic_fetch_int32_t(&wpq->pqh.qcount) > 1)
+			work_pool_grow(pool);
+		return rc;
 	}
 
+	pthread_mutex_lock(&pool->pqh.qmutex);
+	work_pool_insert(pool, work);
 	pthread_mutex_unlock(&pool->pqh.qmutex);
 	return rc;
 }
 
+/*
+ * Always use the shared queue, even from a worker with its own queue
+ * (WORK_POOL_FLAG_STEAL).  Other workers look there before their own
+ * queues, so the task does not wait behind this worker's backlog.
+ */
+int
+work_pool_submit_shared(struct work_pool *pool, struct work_pool_entry *work)
+{
+	if (unlikely(!pool->params.thrd_max)) {
+		/* queue is draining */
+		return (0);
+	}
+
+	pthread_mutex_lock(&pool->pqh.qmutex);
+	work_pool_insert(pool, work);
+	pthread_mutex_unlock(&pool->pqh.qmutex);
+	return (0);
+}
+
+/*
+ * Submit a list of tasks (linked by pqe) with a single lock acquisition.
+ * The list is empty upon return.
+ */
+int
+work_pool_submit_batch(struct work_pool *pool, struct poolq_head_s *batch)
+{
+	struct work_pool_queue *wpq;
+	struct poolq_entry *have;
+	int count = 0;
+
+	if (unlikely(!pool->params.thrd_max)) {
+		/* queue is draining */
+		TAILQ_INIT(batch);
+		return (0);
+	}
+
+	if (TAILQ_EMPTY(batch))
+		return (0);
+
+	wpq = work_pool_self_queue(pool);
+	if (wpq && atomic_fetch_int32_t(&pool->pqh.qcount) <= 0) {
+		/* no waiting worker(s), keep on this worker's own queue */
+		TAILQ_FOREACH(have, batch, q)
+			count++;
+		work_pool_queue_concat(wpq, batch, count);
+		work_pool_wakeup(pool, count);
+		if (atomic_fetch_int32_t(&wpq->pqh.qcount) > 1)
+			work_pool_grow(pool);
+		return (0);
+	}
+
+	pthread_mutex_lock(&pool->pqh.qmutex);
+	while ((have = TAILQ_FIRST(batch))) {
+		TAILQ_REMOVE(batch, have, q);
+		work_pool_insert(pool, (struct work_pool_entry *)have);
+	}
+	pthread_mutex_unlock(&pool->pqh.qmutex);
+	return (0);
+}
+
 int
 work_pool_shutdown(struct work_pool *pool)
 {
@@ -318,6 +633,15 @@ work_pool_shutdown(struct work_pool *pool)
 		nanosleep(&ts, NULL);
 	}
 
+	if (pool->wpq) {
+		uint32_t ix;
+
+		for (ix = 0; ix < pool->n_queues; ix++)
+			poolq_head_destroy(&pool->wpq[ix].pqh);
+		mem_free(pool->wpq, pool->n_queues * sizeof(*pool->wpq));
+		pool->wpq = NULL;
+	}
+
 	mem_free(pool->name, 0);
 	poolq_head_destroy(&pool->pqh);
 
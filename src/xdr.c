@@ -71,6 +71,14 @@ XDR xdr_free_null_stream = {
 	.x_v = {NULL, NULL, NULL, NULL},
 };
 
+/*
+ * for cleanup after XDR_FLAG_ZEROCOPY decoding
+ */
+XDR xdr_free_zerocopy_stream = {
+	.x_op = XDR_FREE,
+	.x_flags = XDR_FLAG_ZEROCOPY,
+};
+
 /*
  * XDR nothing
  */
@@ -523,23 +531,11 @@ xdr_wrapstring(XDR *xdrs, char **cpp)
 bool
 xdr_int64_t(XDR *xdrs, int64_t *llp)
 {
-	u_long ul[2];
-
 	switch (xdrs->x_op) {
 	case XDR_ENCODE:
-		ul[0] = (u_long) ((u_int64_t) *llp >> 32) & 0xffffffff;
-		ul[1] = (u_long) ((u_int64_t) *llp) & 0xffffffff;
-		if (XDR_PUTLONG(xdrs, (long *)&ul[0]) == false)
-			return (false);
-		return (XDR_PUTLONG(xdrs, (long *)&ul[1]));
+		return (XDR_PUTUINT64(xdrs, (uint64_t *)llp));
 	case XDR_DECODE:
-		if (XDR_GETLONG(xdrs, (long *)&ul[0]) == false)
-			return (false);
-		if (XDR_GETLONG(xdrs, (long *)&ul[1]) == false)
-			return (false);
-		*llp = (int64_t)
-		    (((u_int64_t) ul[0] << 32) | ((u_int64_t) ul[1]));
-		return (true);
+		return (XDR_GETUINT64(xdrs, (uint64_t *)llp));
 	case XDR_FREE:
 		return (true);
 	}
@@ -553,23 +549,11 @@ xdr_int64_t(XDR *xdrs, int64_t *llp)
 bool
 xdr_u_int64_t(XDR *xdrs, u_int64_t *ullp)
 {
-	u_long ul[2];
-
 	switch (xdrs->x_op) {
 	case XDR_ENCODE:
-		ul[0] = (u_long) (*ullp >> 32) & 0xffffffff;
-		ul[1] = (u_long) (*ullp) & 0xffffffff;
-		if (XDR_PUTLONG(xdrs, (long *)&ul[0]) == false)
-			return (false);
-		return (XDR_PUTLONG(xdrs, (long *)&ul[1]));
+		return (XDR_PUTUINT64(xdrs, ullp));
 	case XDR_DECODE:
-		if (XDR_GETLONG(xdrs, (long *)&ul[0]) == false)
-			return (false);
-		if (XDR_GETLONG(xdrs, (long *)&ul[1]) == false)
-			return (false);
-		*ullp = (u_int64_t)
-		    (((u_int64_t) ul[0] << 32) | ((u_int64_t) ul[1]));
-		return (true);
+		return (XDR_GETUINT64(xdrs, ullp));
 	case XDR_FREE:
 		return (true);
 	}
@@ -583,23 +567,11 @@ xdr_u_int64_t(XDR *xdrs, u_int64_t *ullp)
 bool
 xdr_uint64_t(XDR *xdrs, uint64_t *ullp)
 {
-	u_long ul[2];
-
 	switch (xdrs->x_op) {
 	case XDR_ENCODE:
-		ul[0] = (u_long) (*ullp >> 32) & 0xffffffff;
-		ul[1] = (u_long) (*ullp) & 0xffffffff;
-		if (XDR_PUTLONG(xdrs, (long *)&ul[0]) == false)
-			return (false);
-		return (XDR_PUTLONG(xdrs, (long *)&ul[1]));
+		return (XDR_PUTUINT64(xdrs, ullp));
 	case XDR_DECODE:
-		if (XDR_GETLONG(xdrs, (long *)&ul[0]) == false)
-			return (false);
-		if (XDR_GETLONG(xdrs, (long *)&ul[1]) == false)
-			return (false);
-		*ullp = (uint64_t)
-		    (((uint64_t) ul[0] << 32) | ((uint64_t) ul[1]));
-		return (true);
+		return (XDR_GETUINT64(xdrs, ullp));
 	case XDR_FREE:
 		return (true);
 	}
@@ -47,6 +47,9 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#endif
 
 #include <rpc/types.h>
 #include <rpc/xdr_inline.h>
@@ -144,3 +147,292 @@ xdr_vector(XDR *xdrs, char *basep, u_int nelem, u_int elemsize,
 	}
 	return (true);
 }
+
+/*
+ * Bulk byte swapping for arrays of fixed-size integers.
+ *
+ * XDR integers are big-endian, so on a little-endian host encoding and
+ * decoding are the same block byte swap between the host array and the
+ * stream buffer.  The stream side need not be aligned.  On x86_64 the
+ * swap runs 32 (AVX2) or 16 (SSSE3) bytes at a time, picked at first use.
+ */
+typedef void (*xdr_bswap_fn)(void *, const void *, u_int);
+
+static void
+xdr_bswap32_scalar(void *dst, const void *src, u_int n)
+{
+	uint8_t *d = dst;
+	const uint8_t *s = src;
+	uint32_t v;
+
+	for (; n; n--, d += sizeof(v), s += sizeof(v)) {
+		memcpy(&v, s, sizeof(v));
+		v = htonl(v);
+		memcpy(d, &v, sizeof(v));
+	}
+}
+
+static void
+xdr_bswap64_scalar(void *dst, const void *src, u_int n)
+{
+	uint8_t *d = dst;
+	const uint8_t *s = src;
+	uint64_t v;
+
+	for (; n; n--, d += sizeof(v), s += sizeof(v)) {
+		memcpy(&v, s, sizeof(v));
+#if BYTE_ORDER == LITTLE_ENDIAN
+		v = __builtin_bswap64(v);
+#endif
+		memcpy(d, &v, sizeof(v));
+	}
+}
+
+#if defined(__x86_64__) && defined(__GNUC__) && BYTE_ORDER == LITTLE_ENDIAN
+#define XDR_BSWAP_MASK(w) \
+	(w == 4 ? _mm_set_epi8(12, 13, 14, 15, 8, 9, 10, 11, \
+			       4, 5, 6, 7, 0, 1, 2, 3) \
+		: _mm_set_epi8(8, 9, 10, 11, 12, 13, 14, 15, \
+			       0, 1, 2, 3, 4, 5, 6, 7))
+
+/* w is the element width; n elements, 16 bytes per shuffle */
+static inline __attribute__((target("ssse3"), always_inline)) u_int
+xdr_bswap_ssse3(uint8_t *d, const uint8_t *s, u_int n, u_int w)
+{
+	const __m128i mask = XDR_BSWAP_MASK(w);
+	u_int per = 16 / w;
+	u_int i;
+
+	for (i = 0; i + per <= n; i += per, d += 16, s += 16)
+		_mm_storeu_si128((__m128i *)d,
+				 _mm_shuffle_epi8(
+					_mm_loadu_si128((const __m128i *)s),
+					mask));
+	return i;
+}
+
+static inline __attribute__((target("avx2"), always_inline)) u_int
+xdr_bswap_avx2(uint8_t *d, const uint8_t *s, u_int n, u_int w)
+{
+	const __m256i mask = _mm256_broadcastsi128_si256(XDR_BSWAP_MASK(w));
+	u_int per = 32 / w;
+	u_int i;
+
+	for (i = 0; i + per <= n; i += per, d += 32, s += 32)
+		_mm256_storeu_si256((__m256i *)d,
+				    _mm256_shuffle_epi8(
+					_mm256_loadu_si256((const __m256i *)s),
+					mask));
+	return i;
+}
+
+static __attribute__((target("ssse3"))) void
+xdr_bswap32_ssse3(void *dst, const void *src, u_int n)
+{
+	u_int i = xdr_bswap_ssse3(dst, src, n, 4);
+
+	xdr_bswap32_scalar((uint8_t *)dst + i * 4,
+			   (const uint8_t *)src + i * 4, n - i);
+}
+
+static __attribute__((target("ssse3"))) void
+xdr_bswap64_ssse3(void *dst, const void *src, u_int n)
+{
+	u_int i = xdr_bswap_ssse3(dst, src, n, 8);
+
+	xdr_bswap64_scalar((uint8_t *)dst + i * 8,
+			   (const uint8_t *)src + i * 8, n - i);
+}
+
+static __attribute__((target("avx2"))) void
+xdr_bswap32_avx2(void *dst, const void *src, u_int n)
+{
+	u_int i = xdr_bswap_avx2(dst, src, n, 4);
+
+	i += xdr_bswap_ssse3((uint8_t *)dst + i * 4,
+			     (const uint8_t *)src + i * 4, n - i, 4);
+	xdr_bswap32_scalar((uint8_t *)dst + i * 4,
+			   (const uint8_t *)src + i * 4, n - i);
+}
+
+static __attribute__((target("avx2"))) void
+xdr_bswap64_avx2(void *dst, const void *src, u_int n)
+{
+	u_int i = xdr_bswap_avx2(dst, src, n, 8);
+
+	i += xdr_bswap_ssse3((uint8_t *)dst + i * 8,
+			     (const uint8_t *)src + i * 8, n - i, 8);
+	xdr_bswap64_scalar((uint8_t *)dst + i * 8,
+			   (const uint8_t *)src + i * 8, n - i);
+}
+#endif /* __x86_64__ */
+
+static void xdr_bswap32_pick(void *, const void *, u_int);
+static void xdr_bswap64_pick(void *, const void *, u_int);
+
+/* racing first users all store the same pointer */
+static xdr_bswap_fn xdr_bswap32 = xdr_bswap32_pick;
+static xdr_bswap_fn xdr_bswap64 = xdr_bswap64_pick;
+
+static void
+xdr_bswap_init(void)
+{
+	xdr_bswap_fn fn32 = xdr_bswap32_scalar;
+	xdr_bswap_fn fn64 = xdr_bswap64_scalar;
+
+#if defined(__x86_64__) && defined(__GNUC__) && BYTE_ORDER == LITTLE_ENDIAN
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) {
+		fn32 = xdr_bswap32_avx2;
+		fn64 = xdr_bswap64_avx2;
+	} else if (__builtin_cpu_supports("ssse3")) {
+		fn32 = xdr_bswap32_ssse3;
+		fn64 = xdr_bswap64_ssse3;
+	}
+#endif
+	xdr_bswap32 = fn32;
+	xdr_bswap64 = fn64;
+}
+
+static void
+xdr_bswap32_pick(void *dst, const void *src, u_int n)
+{
+	xdr_bswap_init();
+	xdr_bswap32(dst, src, n);
+}
+
+static void
+xdr_bswap64_pick(void *dst, const void *src, u_int n)
+{
+	xdr_bswap_init();
+	xdr_bswap64(dst, src, n);
+}
+
+/*
+ * XDR nelem elements of width w bytes at p.  Whole runs that fit the
+ * current contiguous buffer are swapped in one block; an element that
+ * straddles a buffer boundary (or a stream without XDR_FLAG_VIO) goes
+ * through the per-element primitive, which moves to the next buffer.
+ */
+static inline bool
+xdr_fixed_elements(XDR *xdrs, void *p, u_int nelem, u_int w)
+{
+	uint8_t *elptr = p;
+	uint8_t *limit;
+	xdr_bswap_fn swap;
+	u_int n;
+
+	while (nelem) {
+		if (xdrs->x_flags & XDR_FLAG_VIO) {
+			limit = (xdrs->x_op == XDR_DECODE)
+				? xdrs->x_v.vio_tail
+				: xdrs->x_v.vio_wrap;
+			n = (limit > xdrs->x_data)
+				? (limit - xdrs->x_data) / w
+				: 0;
+			if (n > nelem)
+				n = nelem;
+			if (n) {
+				/* short runs are not worth the vector setup */
+				swap = (n * w < 32)
+					? (w == 4 ? xdr_bswap32_scalar
+						  : xdr_bswap64_scalar)
+					: (w == 4 ? xdr_bswap32 : xdr_bswap64);
+				if (xdrs->x_op == XDR_DECODE)
+					swap(elptr, xdrs->x_data, n);
+				else
+					swap(xdrs->x_data, elptr, n);
+				xdrs->x_data += n * w;
+				elptr += n * w;
+				nelem -= n;
+				continue;
+			}
+		}
+		if (!(w == 4
+		      ? inline_xdr_u_int32_t(xdrs, (uint32_t *)elptr)
+		      : inline_xdr_u_int64_t(xdrs, (uint64_t *)elptr)))
+			return (false);
+		elptr += w;
+		nelem--;
+	}
+	return (true);
+}
+
+/*
+ * Counted array of w byte integers, as xdr_array() with
+ * xdr_uint32_t or xdr_uint64_t elements.
+ */
+static inline bool
+xdr_fixed_array(XDR *xdrs, void **addrp, u_int *sizep, u_int maxsize,
+		u_int w)
+{
+	u_int c;
+
+	if (!inline_xdr_u_int(xdrs, sizep))
+		return (false);
+	c = *sizep;
+
+	switch (xdrs->x_op) {
+	case XDR_FREE:
+		if (*addrp) {
+			mem_free(*addrp, (size_t)c * w);
+			*addrp = NULL;
+		}
+		return (true);
+	case XDR_DECODE:
+		if (c > maxsize || UINT_MAX / w < c)
+			return (false);
+		if (*addrp == NULL) {
+			if (c == 0)
+				return (true);
+			*addrp = mem_zalloc((size_t)c * w);
+		}
+		break;
+	case XDR_ENCODE:
+		if (c > maxsize || UINT_MAX / w < c)
+			return (false);
+		break;
+	}
+	return (xdr_fixed_elements(xdrs, *addrp, c, w));
+}
+
+/*
+ * xdr_array_u32(), xdr_array_u64():
+ *
+ * Equivalent to xdr_array() with xdr_uint32_t or xdr_uint64_t elements,
+ * without a procedure call per element.
+ */
+bool
+xdr_array_u32(XDR *xdrs, uint32_t **addrp, u_int *sizep, u_int maxsize)
+{
+	return (xdr_fixed_array(xdrs, (void **)addrp, sizep, maxsize,
+				sizeof(uint32_t)));
+}
+
+bool
+xdr_array_u64(XDR *xdrs, uint64_t **addrp, u_int *sizep, u_int maxsize)
+{
+	return (xdr_fixed_array(xdrs, (void **)addrp, sizep, maxsize,
+				sizeof(uint64_t)));
+}
+
+/*
+ * xdr_vector_u32(), xdr_vector_u64():
+ *
+ * Equivalent to xdr_vector() with xdr_uint32_t or xdr_uint64_t elements.
+ */
+bool
+xdr_vector_u32(XDR *xdrs, uint32_t *basep, u_int nelem)
+{
+	if (xdrs->x_op == XDR_FREE)
+		return (true);
+	return (xdr_fixed_elements(xdrs, basep, nelem, sizeof(uint32_t)));
+}
+
+bool
+xdr_vector_u64(XDR *xdrs, uint64_t *basep, u_int nelem)
+{
+	if (xdrs->x_op == XDR_FREE)
+		return (true);
+	return (xdr_fixed_elements(xdrs, basep, nelem, sizeof(uint64_t)));
+}
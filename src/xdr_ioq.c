@@ -38,6 +38,7 @@
 #include <rpc/types.h>
 #include <misc/portable.h>
 #include <rpc/xdr.h>
+#include <rpc/xdr_inline.h>
 #include <rpc/rpc.h>
 #include <rpc/auth.h>
 #include <rpc/svc_auth.h>
@@ -58,17 +59,270 @@ static bool xdr_ioq_noop(void) __attribute__ ((unused));
 
 static uint64_t next_id;
 
-#if 0				/* jemalloc docs warn about reclaim */
-#define alloc_buffer(size) mem_aligned(0x8, (size))
-#else
-#define alloc_buffer(size) mem_alloc((size))
-#endif				/* 0 */
-#define free_buffer(addr,size) mem_free((addr), size)
+/*
+ * Size-classed buffer pool, with per-thread caches.
+ *
+ * Classes are powers of 2, from 64 bytes up to 64 KB.  Larger buffers
+ * are allocated directly.  Each thread caches up to XDR_IOQ_POOL_CACHE
+ * bytes per class, exchanging half of its cache with the shared list
+ * when it runs empty or full.
+ *
+ * Everything allocated by xdr_ioq_pool_alloc() MUST be returned by
+ * xdr_ioq_pool_free() with the same size.
+ */
+#define XDR_IOQ_POOL_SHIFT 6
+#define XDR_IOQ_POOL_CLASSES 11
+#define XDR_IOQ_POOL_CACHE (256 * 1024)		/* per thread, per class */
+#define XDR_IOQ_POOL_SHARED (4 * 1024 * 1024)	/* per class */
+
+struct xdr_ioq_pool_item {
+	struct xdr_ioq_pool_item *next;
+};
+
+struct xdr_ioq_pool_list {
+	struct xdr_ioq_pool_item *head;
+	uint32_t count;
+};
+
+struct xdr_ioq_pool_cache {
+	TAILQ_ENTRY(xdr_ioq_pool_cache) q;
+	struct xdr_ioq_pool_list list[XDR_IOQ_POOL_CLASSES];
+	struct xdr_ioq_pool_stats stats[XDR_IOQ_POOL_CLASSES];
+};
+
+static struct {
+	pthread_mutex_t mtx;
+	pthread_key_t key;
+	TAILQ_HEAD(xdr_ioq_pool_caches, xdr_ioq_pool_cache) caches;
+	struct xdr_ioq_pool_list list[XDR_IOQ_POOL_CLASSES];
+	struct xdr_ioq_pool_stats retired[XDR_IOQ_POOL_CLASSES];
+} xdr_ioq_pool = {
+	.mtx = PTHREAD_MUTEX_INITIALIZER,
+	.caches = TAILQ_HEAD_INITIALIZER(xdr_ioq_pool.caches),
+};
+
+static pthread_once_t xdr_ioq_pool_once = PTHREAD_ONCE_INIT;
+static __thread struct xdr_ioq_pool_cache *xdr_ioq_pool_self;
+
+static inline u_int
+xdr_ioq_pool_class(size_t size)
+{
+	u_int c = 0;
+
+	size = (size - 1) >> XDR_IOQ_POOL_SHIFT;
+	while (size) {
+		size >>= 1;
+		c++;
+	}
+	return (c);
+}
+
+#define xdr_ioq_pool_size(c) ((size_t)1 << ((c) + XDR_IOQ_POOL_SHIFT))
+#define xdr_ioq_pool_cache_max(c) (XDR_IOQ_POOL_CACHE / xdr_ioq_pool_size(c))
+#define xdr_ioq_pool_shared_max(c) \
+	(XDR_IOQ_POOL_SHARED / xdr_ioq_pool_size(c))
+
+/*
+ * Move up to count items between lists, returns number moved.
+ */
+static inline uint32_t
+xdr_ioq_pool_move(struct xdr_ioq_pool_list *to,
+		  struct xdr_ioq_pool_list *from, uint32_t count)
+{
+	struct xdr_ioq_pool_item *item;
+	uint32_t n = 0;
+
+	while (n < count && (item = from->head)) {
+		from->head = item->next;
+		item->next = to->head;
+		to->head = item;
+		n++;
+	}
+	from->count -= n;
+	to->count += n;
+	return (n);
+}
+
+/*
+ * Thread exit: return cached buffers, keep the counters.
+ */
+static void
+xdr_ioq_pool_retire(void *arg)
+{
+	struct xdr_ioq_pool_cache *cache = arg;
+	struct xdr_ioq_pool_item *item;
+	u_int c;
+
+	/* later destructors may allocate again */
+	xdr_ioq_pool_self = NULL;
+
+	pthread_mutex_lock(&xdr_ioq_pool.mtx);
+	TAILQ_REMOVE(&xdr_ioq_pool.caches, cache, q);
+
+	for (c = 0; c < XDR_IOQ_POOL_CLASSES; c++) {
+		struct xdr_ioq_pool_list *shared = &xdr_ioq_pool.list[c];
+		struct xdr_ioq_pool_stats *retired = &xdr_ioq_pool.retired[c];
+		uint32_t room = xdr_ioq_pool_shared_max(c) - shared->count;
+
+		xdr_ioq_pool_move(shared, &cache->list[c],
+				  MIN(room, cache->list[c].count));
+		while ((item = cache->list[c].head)) {
+			cache->list[c].head = item->next;
+			mem_free(item, xdr_ioq_pool_size(c));
+			cache->stats[c].frees++;
+		}
+		retired->hits += cache->stats[c].hits;
+		retired->misses += cache->stats[c].misses;
+		retired->frees += cache->stats[c].frees;
+	}
+	pthread_mutex_unlock(&xdr_ioq_pool.mtx);
+
+	mem_free(cache, sizeof(*cache));
+}
+
+static void
+xdr_ioq_pool_init(void)
+{
+	(void)pthread_key_create(&xdr_ioq_pool.key, xdr_ioq_pool_retire);
+}
+
+static struct xdr_ioq_pool_cache *
+xdr_ioq_pool_cache(void)
+{
+	struct xdr_ioq_pool_cache *cache = xdr_ioq_pool_self;
+	u_int c;
+
+	if (likely(cache))
+		return (cache);
+
+	pthread_once(&xdr_ioq_pool_once, xdr_ioq_pool_init);
+
+	cache = mem_zalloc(sizeof(*cache));
+	for (c = 0; c < XDR_IOQ_POOL_CLASSES; c++)
+		cache->stats[c].size = xdr_ioq_pool_size(c);
+
+	pthread_mutex_lock(&xdr_ioq_pool.mtx);
+	TAILQ_INSERT_TAIL(&xdr_ioq_pool.caches, cache, q);
+	pthread_mutex_unlock(&xdr_ioq_pool.mtx);
+
+	(void)pthread_setspecific(xdr_ioq_pool.key, cache);
+	xdr_ioq_pool_self = cache;
+	return (cache);
+}
+
+static void *
+xdr_ioq_pool_alloc(size_t size)
+{
+	struct xdr_ioq_pool_cache *cache;
+	struct xdr_ioq_pool_list *list;
+	struct xdr_ioq_pool_item *item;
+	u_int c = xdr_ioq_pool_class(size);
+
+	if (unlikely(c >= XDR_IOQ_POOL_CLASSES))
+		return (mem_alloc(size));
+
+	cache = xdr_ioq_pool_cache();
+	list = &cache->list[c];
+
+	if (unlikely(!list->head)) {
+		/* refill half from shared */
+		pthread_mutex_lock(&xdr_ioq_pool.mtx);
+		xdr_ioq_pool_move(list, &xdr_ioq_pool.list[c],
+				  xdr_ioq_pool_cache_max(c) / 2);
+		pthread_mutex_unlock(&xdr_ioq_pool.mtx);
+
+		if (!list->head) {
+			cache->stats[c].misses++;
+			return (mem_alloc(xdr_ioq_pool_size(c)));
+		}
+	}
+
+	item = list->head;
+	list->head = item->next;
+	list->count--;
+	cache->stats[c].hits++;
+	return (item);
+}
+
+static void
+xdr_ioq_pool_free(void *p, size_t size)
+{
+	struct xdr_ioq_pool_cache *cache;
+	struct xdr_ioq_pool_list *list;
+	struct xdr_ioq_pool_item *item = p;
+	u_int c = xdr_ioq_pool_class(size);
+
+	if (unlikely(c >= XDR_IOQ_POOL_CLASSES)) {
+		mem_free(p, size);
+		return;
+	}
+
+	cache = xdr_ioq_pool_cache();
+	list = &cache->list[c];
+
+	if (unlikely(list->count >= xdr_ioq_pool_cache_max(c))) {
+		/* spill half to shared */
+		struct xdr_ioq_pool_list *shared = &xdr_ioq_pool.list[c];
+		uint32_t room;
+
+		pthread_mutex_lock(&xdr_ioq_pool.mtx);
+		room = xdr_ioq_pool_shared_max(c) - shared->count;
+		xdr_ioq_pool_move(shared, list, MIN(room, list->count / 2));
+		pthread_mutex_unlock(&xdr_ioq_pool.mtx);
+
+		if (list->count >= xdr_ioq_pool_cache_max(c)) {
+			cache->stats[c].frees++;
+			mem_free(p, xdr_ioq_pool_size(c));
+			return;
+		}
+	}
+
+	item->next = list->head;
+	list->head = item;
+	list->count++;
+}
+
+/*
+ * Returns the number of classes, filling up to count stats.
+ *
+ * Counters of running threads are read without locking them.
+ */
+u_int
+xdr_ioq_pool_stats(struct xdr_ioq_pool_stats *stats, u_int count)
+{
+	struct xdr_ioq_pool_cache *cache;
+	u_int c;
+
+	count = MIN(count, XDR_IOQ_POOL_CLASSES);
+
+	pthread_mutex_lock(&xdr_ioq_pool.mtx);
+	for (c = 0; c < count; c++) {
+		stats[c] = xdr_ioq_pool.retired[c];
+		stats[c].size = xdr_ioq_pool_size(c);
+		stats[c].cached = xdr_ioq_pool.list[c].count;
+	}
+	TAILQ_FOREACH(cache, &xdr_ioq_pool.caches, q) {
+		for (c = 0; c < count; c++) {
+			stats[c].hits += cache->stats[c].hits;
+			stats[c].misses += cache->stats[c].misses;
+			stats[c].frees += cache->stats[c].frees;
+			stats[c].cached += cache->list[c].count;
+		}
+	}
+	pthread_mutex_unlock(&xdr_ioq_pool.mtx);
+
+	return (XDR_IOQ_POOL_CLASSES);
+}
+
+#define alloc_buffer(size) xdr_ioq_pool_alloc((size))
+#define free_buffer(addr,size) xdr_ioq_pool_free((addr), size)
 
 struct xdr_ioq_uv *
 xdr_ioq_uv_create(size_t size, u_int uio_flags)
 {
-	struct xdr_ioq_uv *uv = mem_zalloc(sizeof(struct xdr_ioq_uv));
+	struct xdr_ioq_uv *uv = xdr_ioq_pool_alloc(sizeof(struct xdr_ioq_uv));
+
+	memset(uv, 0, sizeof(struct xdr_ioq_uv));
 
 	if (size) {
 		uv->v.vio_base = alloc_buffer(size);
@@ -193,13 +447,13 @@ xdr_ioq_uv_release(struct xdr_ioq_uv *uv)
 		uv->u.uio_refer = NULL;
 	}
 
-	if (!(--uv->u.uio_references)) {
+	if (!atomic_dec_int32_t(&uv->u.uio_references)) {
 		if (uv->u.uio_release) {
 			/* handle both xdr_ioq_uv and vio */
 			uv->u.uio_release(&uv->u, UIO_FLAG_NONE);
 		} else if (uv->u.uio_flags & UIO_FLAG_FREE) {
 			free_buffer(uv->v.vio_base, ioquv_size(uv));
-			mem_free(uv, sizeof(*uv));
+			xdr_ioq_pool_free(uv, sizeof(*uv));
 		} else if (uv->u.uio_flags & UIO_FLAG_BUFQ) {
 			uv->u.uio_references = 1;	/* keeping one */
 			xdr_ioq_uv_recycle(uv->u.uio_p1, &uv->uvq);
@@ -212,6 +466,72 @@ xdr_ioq_uv_release(struct xdr_ioq_uv *uv)
 	}
 }
 
+/*
+ * Take a reference on the buffer holding p, an opaque decoded from
+ * xdrs with XDR_FLAG_ZEROCOPY, so that it outlives the stream.
+ * Drop it with xdr_ioq_uv_release().
+ *
+ * Returns NULL when p is not in an xdr_ioq buffer of this stream.
+ */
+struct xdr_ioq_uv *
+xdr_ioq_uv_hold(XDR *xdrs, const void *p)
+{
+	struct poolq_head *ioqh[2];
+	struct poolq_entry *have;
+	struct xdr_ioq_uv *uv;
+	int i;
+
+	if (xdrs->x_ops != &xdr_ioq_ops)
+		return (NULL);
+
+	ioqh[0] = &XIOQ(xdrs)->ioq_uv.uvqh;
+	ioqh[1] = &XIOQ(xdrs)->ioq_refer;
+	for (i = 0; i < 2; i++) {
+		TAILQ_FOREACH(have, &ioqh[i]->qh, q) {
+			if (have->qflags & IOQ_FLAG_SEGMENT)
+				continue;
+			uv = IOQ_(have);
+			if ((const uint8_t *)p >= uv->v.vio_base
+			 && (const uint8_t *)p < uv->v.vio_wrap) {
+				atomic_inc_int32_t(&uv->u.uio_references);
+				return (uv);
+			}
+		}
+	}
+	return (NULL);
+}
+
+/*
+ * Slow path of xdr_opaque_refer(), for an opaque that is not contiguous
+ * in the current buffer.  It is gathered into a buffer of its own, kept
+ * with the stream until xdr_ioq_destroy().
+ */
+bool
+xdr_ioq_refer(XDR *xdrs, char **cpp, u_int cnt)
+{
+	struct xdr_ioq_uv *uv;
+
+	if (xdrs->x_ops != &xdr_ioq_ops) {
+		__warnx(TIRPC_DEBUG_FLAG_ERROR,
+			"%s() XDR_FLAG_ZEROCOPY needs an xdr_ioq or xdrmem "
+			"stream",
+			__func__);
+		return (false);
+	}
+
+	uv = xdr_ioq_uv_create(cnt, UIO_FLAG_FREE);
+	if (!xdr_opaque_decode(xdrs, (char *)uv->v.vio_base, cnt)) {
+		xdr_ioq_uv_release(uv);
+		return (false);
+	}
+	uv->v.vio_tail = uv->v.vio_base + cnt;
+
+	(XIOQ(xdrs)->ioq_refer.qcount)++;
+	TAILQ_INSERT_TAIL(&XIOQ(xdrs)->ioq_refer.qh, &uv->uvq, q);
+	*cpp = (char *)uv->v.vio_base;
+	return (true);
+}
+
 /*
  * Set current read/insert or fill position.
  */
@@ -273,6 +593,7 @@ xdr_ioq_setup(struct xdr_ioq *xioq)
 	xioq->ioq_s.qflags = IOQ_FLAG_SEGMENT;
 
 	poolq_head_setup(&xioq->ioq_uv.uvqh);
+	poolq_head_setup(&xioq->ioq_refer);
 	pthread_cond_init(&xioq->ioq_cond, NULL);
 
 	xdrs->x_ops = &xdr_ioq_ops;
@@ -289,8 +610,9 @@ xdr_ioq_setup(struct xdr_ioq *xioq)
 struct xdr_ioq *
 xdr_ioq_create(size_t min_bsize, size_t max_bsize, u_int uio_flags)
 {
-	struct xdr_ioq *xioq = mem_zalloc(sizeof(struct xdr_ioq));
+	struct xdr_ioq *xioq = xdr_ioq_pool_alloc(sizeof(struct xdr_ioq));
 
+	memset(xioq, 0, sizeof(struct xdr_ioq));
 	xdr_ioq_setup(xioq);
 	xioq->xdrs[0].x_flags |= XDR_FLAG_FREE;
 	xioq->ioq_uv.min_bsize = min_bsize;
@@ -365,9 +687,9 @@ xdr_ioq_uv_append(struct xdr_ioq *xioq, u_int ioq_flags)
 			xioq->ioq_uv.plength -= len;
 			assert(uv->u.uio_flags & UIO_FLAG_FREE);
 
-			base = mem_alloc(xioq->ioq_uv.max_bsize);
+			base = alloc_buffer(xioq->ioq_uv.max_bsize);
 			memcpy(base, uv->v.vio_head, len);
-			mem_free(uv->v.vio_base, size);
+			free_buffer(uv->v.vio_base, size);
 			uv->v.vio_base =
 			uv->v.vio_head = base + 0;
 			uv->v.vio_tail = base + len;
@@ -750,15 +1072,18 @@ xdr_ioq_destroy(struct xdr_ioq *xioq, size_t qsize)
 		__func__, xioq);
 
 	xdr_ioq_release(&xioq->ioq_uv.uvqh);
+	xdr_ioq_release(&xioq->ioq_refer);
 
 	if (xioq->ioq_pool) {
 		xdr_ioq_uv_recycle(xioq->ioq_pool, &xioq->ioq_s);
 		return;
 	}
 	poolq_head_destroy(&xioq->ioq_uv.uvqh);
+	poolq_head_destroy(&xioq->ioq_refer);
 
 	if (xioq->xdrs[0].x_flags & XDR_FLAG_FREE) {
-		mem_free(xioq, qsize);
+		/* allocated by xdr_ioq_create() */
+		xdr_ioq_pool_free(xioq, sizeof(struct xdr_ioq));
 	}
 }
 
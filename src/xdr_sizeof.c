@@ -152,6 +152,7 @@ xdr_sizeof(xdrproc_t func, void *data)
 	x.x_handy = 0;
 	x.x_private = (caddr_t) NULL;
 	x.x_base = (caddr_t) 0;
+	x.x_flags = XDR_FLAG_NONE;
 
 	stat = func(&x, data);
 	if (x.x_private)
@@ -98,6 +98,7 @@ xdrstdio_create(XDR *xdrs, FILE *file, enum xdr_op op)
 	xdrs->x_data = NULL;
 	xdrs->x_base = NULL;
 	xdrs->x_handy = 0;
+	xdrs->x_flags = XDR_FLAG_NONE;
 }
 
 /*
@@ -0,0 +1,241 @@
+/*
+ * Calls per second over loopback TCP, at a given number of outstanding
+ * calls.  The server and client share one process and one event loop,
+ * so this measures the library (xid table, encode, dispatch), not the
+ * network.
+ *
+ *	clnt_async_bench [-n calls] [-c cork_calls [-u cork_usecs]]
+ *			 [window ...]
+ *
+ * Windows default to 1, 64 and 1024.  Each completion issues the next
+ * call, keeping that many in flight.  With -c, the client is corked
+ * (CLSET_CORK), by default for up to 200 usecs.
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include <rpc/rpc.h>
+#include <rpc/svc.h>
+#include <rpc/svc_rqst.h>
+#include <rpc/svc_auth.h>
+
+#define BENCH_PROG 0x20000099
+#define BENCH_VERS 1
+
+static CLIENT *clnt;
+static AUTH *auth;
+static struct timeval timeout = { 30, 0 };
+
+static pthread_mutex_t mtx = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cv = PTHREAD_COND_INITIALIZER;
+static unsigned int issued, done, failed, total;
+
+static enum xprt_stat
+bench_process(struct svc_req *req)
+{
+	bool no_dispatch;
+
+	if (svc_auth_authenticate(req, &no_dispatch) != AUTH_OK)
+		return svcerr_auth(req, AUTH_FAILED);
+	req->rq_msg.RPCM_ack.ar_results.where = NULL;
+	req->rq_msg.RPCM_ack.ar_results.proc = (xdrproc_t) xdr_void;
+	return svc_sendreply(req);
+}
+
+static enum xprt_stat
+bench_request(SVCXPRT *xprt, XDR *xdrs)
+{
+	struct svc_req req;
+	enum xprt_stat stat;
+
+	memset(&req, 0, sizeof(req));
+	req.rq_xprt = xprt;
+	req.rq_xdrs = xdrs;
+	stat = SVC_DECODE(&req);
+	XDR_DESTROY(xdrs);
+	return stat;
+}
+
+static enum xprt_stat
+bench_rendezvous(SVCXPRT *xprt)
+{
+	xprt->xp_dispatch.process_cb = bench_process;
+	return XPRT_IDLE;
+}
+
+static void bench_done(CLIENT *, struct rpc_err *, void *);
+
+static void
+bench_issue(void)
+{
+	if (clnt_call_async(clnt, auth, 1, (xdrproc_t) xdr_void, NULL,
+			    (xdrproc_t) xdr_void, NULL, timeout,
+			    bench_done, NULL) != RPC_SUCCESS) {
+		/* counted as completed, so the run ends */
+		bench_done(clnt, NULL, NULL);
+	}
+}
+
+static void
+bench_done(CLIENT *cl, struct rpc_err *err, void *arg)
+{
+	bool more;
+
+	pthread_mutex_lock(&mtx);
+	if (!err || err->re_status != RPC_SUCCESS)
+		failed++;
+	more = issued < total;
+	if (more)
+		issued++;
+	if (++done == total)
+		pthread_cond_signal(&cv);
+	pthread_mutex_unlock(&mtx);
+
+	if (more)
+		bench_issue();
+}
+
+static double
+bench_run(unsigned int window, unsigned int calls)
+{
+	struct timespec t0, t1;
+	unsigned int i;
+
+	if (window > calls)
+		window = calls;
+
+	pthread_mutex_lock(&mtx);
+	issued = window;
+	done = 0;
+	failed = 0;
+	total = calls;
+	pthread_mutex_unlock(&mtx);
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (i = 0; i < window; i++)
+		bench_issue();
+
+	pthread_mutex_lock(&mtx);
+	while (done < total)
+		pthread_cond_wait(&cv, &mtx);
+	pthread_mutex_unlock(&mtx);
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+
+	return (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+}
+
+int
+main(int argc, char **argv)
+{
+	svc_init_params svc_params = {
+		.request_cb = bench_request,
+		.flags = SVC_INIT_EPOLL | SVC_INIT_NOREG_XPRTS,
+		.max_connections = 64,
+		.max_events = 512,
+		.ioq_thrd_max = 64,
+		.channels = 2,
+	};
+	unsigned int windows[16] = { 1, 64, 1024 };
+	unsigned int nwindows = 3;
+	unsigned int calls = 200000;
+	struct sockaddr_in sin;
+	socklen_t slen = sizeof(sin);
+	struct netbuf raddr;
+	struct clnt_ctx_stats cs;
+	struct clnt_cork cork = { 0, 200 };
+	SVCXPRT *xprt;
+	uint32_t chan;
+	double secs;
+	int opt, lfd, fd;
+	unsigned int i;
+
+	while ((opt = getopt(argc, argv, "n:c:u:")) != -1) {
+		switch (opt) {
+		case 'n':
+			calls = strtoul(optarg, NULL, 0);
+			break;
+		case 'c':
+			cork.calls = strtoul(optarg, NULL, 0);
+			break;
+		case 'u':
+			cork.usecs = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-n calls] [-c cork_calls"
+				" [-u cork_usecs]] [window ...]\n", argv[0]);
+			return 1;
+		}
+	}
+	if (optind < argc) {
+		for (nwindows = 0; optind < argc && nwindows < 16; optind++)
+			windows[nwindows++] = strtoul(argv[optind], NULL, 0);
+	}
+
+	if (!svc_init(&svc_params)) {
+		fprintf(stderr, "svc_init failed\n");
+		return 1;
+	}
+	svc_rqst_new_evchan(&chan, NULL, SVC_RQST_FLAG_CHAN_AFFINITY);
+
+	memset(&sin, 0, sizeof(sin));
+	sin.sin_family = AF_INET;
+	sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	lfd = socket(AF_INET, SOCK_STREAM, 0);
+	if (lfd < 0
+	 || bind(lfd, (struct sockaddr *)&sin, sizeof(sin)) < 0
+	 || getsockname(lfd, (struct sockaddr *)&sin, &slen) < 0
+	 || listen(lfd, 16) < 0) {
+		perror("listen");
+		return 1;
+	}
+	xprt = svc_vc_ncreatef(lfd, 0, 0, SVC_CREATE_FLAG_CLOSE
+					| SVC_CREATE_FLAG_XPRT_NOREG);
+	xprt->xp_dispatch.rendezvous_cb = bench_rendezvous;
+	svc_rqst_evchan_reg(chan, xprt, SVC_RQST_FLAG_CHAN_AFFINITY);
+
+	fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (fd < 0 || connect(fd, (struct sockaddr *)&sin, sizeof(sin)) < 0) {
+		perror("connect");
+		return 1;
+	}
+	raddr.buf = &sin;
+	raddr.len = raddr.maxlen = sizeof(sin);
+	clnt = clnt_vc_ncreatef(fd, &raddr, BENCH_PROG, BENCH_VERS, 0, 0,
+				CLNT_CREATE_FLAG_NONE);
+	if (!clnt) {
+		fprintf(stderr, "clnt_vc_ncreatef failed\n");
+		return 1;
+	}
+	auth = authnone_ncreate();
+	if (cork.calls)
+		(void)CLNT_CONTROL(clnt, CLSET_CORK, (char *)&cork);
+
+	/* connect and warm up */
+	(void)bench_run(64, 10000);
+
+	for (i = 0; i < nwindows; i++) {
+		secs = bench_run(windows[i], calls);
+		printf("outstanding %5u: %u calls in %.3fs, %.0f calls/s%s\n",
+		       windows[i], calls, secs, calls / secs,
+		       failed ? " (errors)" : "");
+	}
+
+	if (CLNT_CONTROL(clnt, CLGET_CTX_STATS, (char *)&cs))
+		printf("call contexts: %" PRIu64 " reused, %" PRIu64
+		       " allocated, %" PRIu64 " freed, %u idle\n",
+		       cs.hits, cs.allocs, cs.frees, cs.idle);
+
+	AUTH_DESTROY(auth);
+	CLNT_DESTROY(clnt);
+	svc_shutdown(SVC_SHUTDOWN_FLAG_NONE);
+	return 0;
+}
@@ -0,0 +1,349 @@
+/*
+ * Retransmits and latency of connectionless calls over an impaired
+ * loopback path.  Calls go through a proxy thread that delays each
+ * datagram by delay plus up to jitter msecs, and drops loss percent of
+ * them (each way).  The server and client share one process.
+ *
+ *	clnt_dg_rtt [-n calls] [-t threads] [-d delay] [-j jitter]
+ *		    [-l loss] [-m rto_min] [interval ...]
+ *
+ * Each fixed interval (msecs, default 25 50 100 200 400) is run with
+ * CLSET_RTT_MIN equal to CLSET_RETRY_TIMEOUT, then the adaptive timer is
+ * run with the largest interval as its retry timeout and a floor of
+ * rto_min msecs (default 10).
+ */
+
+#include <inttypes.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include <rpc/rpc.h>
+#include <rpc/svc.h>
+#include <rpc/svc_rqst.h>
+#include <rpc/svc_auth.h>
+
+#define RTT_PROG 0x2000009a
+#define RTT_VERS 1
+
+#define PROXY_MAX 4096
+#define PROXY_MTU 2048
+
+static unsigned int delay_ms = 20, jitter_ms = 10, loss_pct = 5;
+static unsigned int threads = 4, calls = 2000;
+
+static CLIENT *clnt;
+static AUTH *auth;
+static struct timeval timeout = { 30, 0 };
+static double *lat;
+static unsigned int failed;
+
+static enum xprt_stat
+rtt_process(struct svc_req *req)
+{
+	bool no_dispatch;
+
+	if (svc_auth_authenticate(req, &no_dispatch) != AUTH_OK)
+		return svcerr_auth(req, AUTH_FAILED);
+	req->rq_msg.RPCM_ack.ar_results.where = NULL;
+	req->rq_msg.RPCM_ack.ar_results.proc = (xdrproc_t) xdr_void;
+	return svc_sendreply(req);
+}
+
+static enum xprt_stat
+rtt_request(SVCXPRT *xprt, XDR *xdrs)
+{
+	struct svc_req req;
+	enum xprt_stat stat;
+
+	memset(&req, 0, sizeof(req));
+	req.rq_xprt = xprt;
+	req.rq_xdrs = xdrs;
+	SVC_REF(xprt, SVC_REF_FLAG_NONE);
+	stat = SVC_DECODE(&req);
+	SVC_RELEASE(xprt, SVC_RELEASE_FLAG_NONE);
+	return stat;
+}
+
+static enum xprt_stat
+rtt_rendezvous(SVCXPRT *xprt)
+{
+	xprt->xp_dispatch.process_cb = rtt_process;
+	return SVC_RECV(xprt);
+}
+
+/*
+ * The impaired path.  Datagrams from the server go back to the last
+ * client address seen; all others go to the server.
+ */
+struct proxy_pkt {
+	struct timespec due;
+	struct sockaddr_in to;
+	size_t len;
+	char buf[PROXY_MTU];
+};
+
+static struct proxy_pkt *pending[PROXY_MAX];
+static unsigned int npending;
+static struct sockaddr_in server_sin, client_sin;
+static int proxy_fd;
+
+static long
+ms_until(const struct timespec *ts)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (ts->tv_sec - now.tv_sec) * 1000
+		+ (ts->tv_nsec - now.tv_nsec + 999999) / 1000000;
+}
+
+static void *
+proxy_thread(void *arg)
+{
+	struct proxy_pkt *pkt;
+	struct sockaddr_in from;
+	socklen_t flen;
+	struct pollfd pfd = { .fd = proxy_fd, .events = POLLIN };
+	unsigned int i, first;
+	long wait;
+	ssize_t n;
+
+	for (;;) {
+		for (first = 0, i = 1; i < npending; i++)
+			if (ms_until(&pending[i]->due)
+			    < ms_until(&pending[first]->due))
+				first = i;
+		wait = npending ? ms_until(&pending[first]->due) : -1;
+		if (!npending || wait > 0) {
+			if (poll(&pfd, 1, wait) < 0)
+				break;
+		}
+		if (npending && ms_until(&pending[first]->due) <= 0) {
+			pkt = pending[first];
+			pending[first] = pending[--npending];
+			(void)sendto(proxy_fd, pkt->buf, pkt->len, 0,
+				     (struct sockaddr *)&pkt->to,
+				     sizeof(pkt->to));
+			free(pkt);
+			continue;
+		}
+		if (!(pfd.revents & POLLIN))
+			continue;
+
+		pkt = malloc(sizeof(*pkt));
+		flen = sizeof(from);
+		n = recvfrom(proxy_fd, pkt->buf, sizeof(pkt->buf), 0,
+			     (struct sockaddr *)&from, &flen);
+		if (n < 0 || npending == PROXY_MAX
+		 || (unsigned int)(random() % 100) < loss_pct) {
+			free(pkt);
+			continue;
+		}
+		pkt->len = n;
+		if (from.sin_port == server_sin.sin_port) {
+			pkt->to = client_sin;
+		} else {
+			client_sin = from;
+			pkt->to = server_sin;
+		}
+		clock_gettime(CLOCK_MONOTONIC, &pkt->due);
+		pkt->due.tv_nsec += (delay_ms
+				     + (jitter_ms ? random() % jitter_ms : 0))
+				    * 1000000L;
+		while (pkt->due.tv_nsec >= 1000000000) {
+			pkt->due.tv_sec++;
+			pkt->due.tv_nsec -= 1000000000;
+		}
+		pending[npending++] = pkt;
+	}
+	return NULL;
+}
+
+static void *
+rtt_worker(void *arg)
+{
+	struct timespec t0, t1;
+	unsigned int i;
+
+	for (i = (uintptr_t)arg; i < calls; i += threads) {
+		clock_gettime(CLOCK_MONOTONIC, &t0);
+		if (clnt_call(clnt, auth, 1, (xdrproc_t) xdr_void, NULL,
+			      (xdrproc_t) xdr_void, NULL, timeout)
+		    != RPC_SUCCESS)
+			__sync_fetch_and_add(&failed, 1);
+		clock_gettime(CLOCK_MONOTONIC, &t1);
+		lat[i] = (t1.tv_sec - t0.tv_sec) * 1e3
+			+ (t1.tv_nsec - t0.tv_nsec) / 1e6;
+	}
+	return NULL;
+}
+
+static int
+lat_cmp(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+
+	return (x > y) - (x < y);
+}
+
+static void
+rtt_run(const char *mode, unsigned int interval, unsigned int rto_min)
+{
+	struct sockaddr_in sin;
+	socklen_t slen = sizeof(sin);
+	struct netbuf raddr;
+	struct timeval tv;
+	struct clnt_rtt rtt;
+	pthread_t thr[256];
+	double sum = 0;
+	unsigned int i;
+	int fd;
+
+	memset(&sin, 0, sizeof(sin));
+	sin.sin_family = AF_INET;
+	sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	fd = socket(AF_INET, SOCK_DGRAM, 0);
+	if (fd < 0 || bind(fd, (struct sockaddr *)&sin, sizeof(sin)) < 0) {
+		perror("client socket");
+		exit(1);
+	}
+	(void)getsockname(proxy_fd, (struct sockaddr *)&sin, &slen);
+	raddr.buf = &sin;
+	raddr.len = raddr.maxlen = sizeof(sin);
+	clnt = clnt_dg_ncreatef(fd, &raddr, RTT_PROG, RTT_VERS, 0, 0,
+				SVC_CREATE_FLAG_CLOSE);
+	if (!clnt) {
+		fprintf(stderr, "clnt_dg_ncreatef failed\n");
+		exit(1);
+	}
+	tv.tv_sec = interval / 1000;
+	tv.tv_usec = (interval % 1000) * 1000;
+	(void)CLNT_CONTROL(clnt, CLSET_RETRY_TIMEOUT, (char *)&tv);
+	tv.tv_sec = rto_min / 1000;
+	tv.tv_usec = (rto_min % 1000) * 1000;
+	(void)CLNT_CONTROL(clnt, CLSET_RTT_MIN, (char *)&tv);
+
+	failed = 0;
+	for (i = 0; i < threads; i++)
+		pthread_create(&thr[i], NULL, rtt_worker, (void *)(uintptr_t)i);
+	for (i = 0; i < threads; i++)
+		pthread_join(thr[i], NULL);
+
+	for (i = 0; i < calls; i++)
+		sum += lat[i];
+	qsort(lat, calls, sizeof(*lat), lat_cmp);
+	(void)CLNT_CONTROL(clnt, CLGET_RTT, (char *)&rtt);
+	printf("%-8s %4ums: %6" PRIu64 " retransmits, latency mean %6.1fms"
+	       " p99 %6.1fms, srtt %5.1fms rto %5.1fms%s\n",
+	       mode, interval, rtt.retransmits, sum / calls,
+	       lat[calls * 99 / 100], rtt.srtt / 1e3, rtt.rto / 1e3,
+	       failed ? " (errors)" : "");
+	CLNT_DESTROY(clnt);
+}
+
+int
+main(int argc, char **argv)
+{
+	svc_init_params svc_params = {
+		.request_cb = rtt_request,
+		.flags = SVC_INIT_EPOLL | SVC_INIT_NOREG_XPRTS,
+		.max_connections = 64,
+		.max_events = 512,
+		.ioq_thrd_max = 64,
+		.channels = 2,
+	};
+	unsigned int intervals[16] = { 25, 50, 100, 200, 400 };
+	unsigned int nintervals = 5;
+	unsigned int rto_min = 10;
+	unsigned int i, max = 0;
+	struct sockaddr_in sin;
+	socklen_t slen = sizeof(sin);
+	SVCXPRT *xprt;
+	pthread_t thr;
+	uint32_t chan;
+	int opt, sfd;
+
+	while ((opt = getopt(argc, argv, "n:t:d:j:l:m:")) != -1) {
+		switch (opt) {
+		case 'n':
+			calls = strtoul(optarg, NULL, 0);
+			break;
+		case 't':
+			threads = strtoul(optarg, NULL, 0);
+			break;
+		case 'd':
+			delay_ms = strtoul(optarg, NULL, 0);
+			break;
+		case 'j':
+			jitter_ms = strtoul(optarg, NULL, 0);
+			break;
+		case 'l':
+			loss_pct = strtoul(optarg, NULL, 0);
+			break;
+		case 'm':
+			rto_min = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-n calls] [-t threads]"
+				" [-d delay] [-j jitter] [-l loss]"
+				" [-m rto_min] [interval ...]\n", argv[0]);
+			return 1;
+		}
+	}
+	if (optind < argc) {
+		for (nintervals = 0; optind < argc && nintervals < 16;
+		     optind++)
+			intervals[nintervals++] = strtoul(argv[optind], NULL, 0);
+	}
+	if (!calls || !threads || threads > 256 || !nintervals) {
+		fprintf(stderr, "bad arguments\n");
+		return 1;
+	}
+	lat = calloc(calls, sizeof(*lat));
+
+	if (!svc_init(&svc_params)) {
+		fprintf(stderr, "svc_init failed\n");
+		return 1;
+	}
+	svc_rqst_new_evchan(&chan, NULL, SVC_RQST_FLAG_CHAN_AFFINITY);
+
+	memset(&sin, 0, sizeof(sin));
+	sin.sin_family = AF_INET;
+	sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	sfd = socket(AF_INET, SOCK_DGRAM, 0);
+	proxy_fd = socket(AF_INET, SOCK_DGRAM, 0);
+	if (sfd < 0 || proxy_fd < 0
+	 || bind(sfd, (struct sockaddr *)&sin, sizeof(sin)) < 0
+	 || getsockname(sfd, (struct sockaddr *)&server_sin, &slen) < 0
+	 || bind(proxy_fd, (struct sockaddr *)&sin, sizeof(sin)) < 0) {
+		perror("bind");
+		return 1;
+	}
+	xprt = svc_dg_ncreatef(sfd, 0, 0, SVC_CREATE_FLAG_CLOSE
+					| SVC_CREATE_FLAG_XPRT_NOREG);
+	xprt->xp_dispatch.rendezvous_cb = rtt_rendezvous;
+	svc_rqst_evchan_reg(chan, xprt, SVC_RQST_FLAG_CHAN_AFFINITY);
+	pthread_create(&thr, NULL, proxy_thread, NULL);
+	auth = authnone_ncreate();
+
+	printf("delay %ums jitter %ums loss %u%%, %u threads x %u calls\n",
+	       delay_ms, jitter_ms, loss_pct, threads, calls / threads);
+	for (i = 0; i < nintervals; i++) {
+		rtt_run("fixed", intervals[i], intervals[i]);
+		if (intervals[i] > max)
+			max = intervals[i];
+	}
+	rtt_run("adaptive", max, rto_min);
+
+	AUTH_DESTROY(auth);
+	svc_shutdown(SVC_SHUTDOWN_FLAG_NONE);
+	return 0;
+}
@@ -0,0 +1,247 @@
+/*
+ * Datagrams per second served over loopback UDP.  Client threads send
+ * a prepared NULL call, each keeping a window of calls outstanding on
+ * its own socket, and count the replies.  The server shares the process.
+ *
+ *	svc_dg_bench [-b dg_recv_max] [-l listeners] [-t threads]
+ *		     [-w window] [-s secs]
+ *
+ * -b 1 (the default) receives with recvmsg(), one datagram per event;
+ * larger values receive up to that many per recvmmsg(), and send their
+ * replies together by sendmmsg().
+ *
+ * -l n serves the port from n SO_REUSEPORT sockets, each on its own event
+ * channel (on cpu i % online cpus), by svc_reuseport_ncreate().
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include <rpc/rpc.h>
+#include <rpc/svc.h>
+#include <rpc/svc_rqst.h>
+#include <rpc/svc_auth.h>
+
+#define BENCH_PROG 0x2000009b
+#define BENCH_VERS 1
+
+static unsigned int threads = 4, window = 32, secs = 5, listeners = 1;
+static struct sockaddr_in server_sin;
+static char call_buf[128];
+static u_int call_len;
+static volatile int running = 1;
+static uint64_t replies, resends;
+
+static enum xprt_stat
+bench_process(struct svc_req *req)
+{
+	bool no_dispatch;
+
+	if (svc_auth_authenticate(req, &no_dispatch) != AUTH_OK)
+		return svcerr_auth(req, AUTH_FAILED);
+	req->rq_msg.RPCM_ack.ar_results.where = NULL;
+	req->rq_msg.RPCM_ack.ar_results.proc = (xdrproc_t) xdr_void;
+	return svc_sendreply(req);
+}
+
+static enum xprt_stat
+bench_request(SVCXPRT *xprt, XDR *xdrs)
+{
+	struct svc_req req;
+	enum xprt_stat stat;
+
+	memset(&req, 0, sizeof(req));
+	req.rq_xprt = xprt;
+	req.rq_xdrs = xdrs;
+	SVC_REF(xprt, SVC_REF_FLAG_NONE);
+	stat = SVC_DECODE(&req);
+	SVC_RELEASE(xprt, SVC_RELEASE_FLAG_NONE);
+	return stat;
+}
+
+static enum xprt_stat
+bench_rendezvous(SVCXPRT *xprt)
+{
+	xprt->xp_dispatch.process_cb = bench_process;
+	return SVC_RECV(xprt);
+}
+
+static void *
+bench_client(void *arg)
+{
+	struct timeval tv = { 0, 50000 };
+	char buf[512];
+	uint64_t n = 0, lost = 0;
+	unsigned int i;
+	int fd;
+
+	fd = socket(AF_INET, SOCK_DGRAM, 0);
+	if (fd < 0
+	 || connect(fd, (struct sockaddr *)&server_sin,
+		    sizeof(server_sin)) < 0) {
+		perror("client socket");
+		exit(1);
+	}
+	(void)setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+	for (i = 0; i < window; i++)
+		(void)send(fd, call_buf, call_len, 0);
+	while (running) {
+		if (recv(fd, buf, sizeof(buf), 0) > 0) {
+			n++;
+			(void)send(fd, call_buf, call_len, 0);
+			continue;
+		}
+		/* lost (socket buffers overrun), refill the window */
+		lost++;
+		for (i = 0; i < window; i++)
+			(void)send(fd, call_buf, call_len, 0);
+	}
+	__sync_fetch_and_add(&replies, n);
+	__sync_fetch_and_add(&resends, lost);
+	close(fd);
+	return NULL;
+}
+
+int
+main(int argc, char **argv)
+{
+	svc_init_params svc_params = {
+		.request_cb = bench_request,
+		.flags = SVC_INIT_EPOLL | SVC_INIT_NOREG_XPRTS,
+		.max_connections = 64,
+		.max_events = 512,
+		.ioq_thrd_max = 64,
+		.channels = 2,
+	};
+	struct rpc_msg call_msg;
+	struct sockaddr_in sin;
+	socklen_t slen = sizeof(sin);
+	struct timespec t0, t1;
+	pthread_t thr[256];
+	SVCXPRT *xprts[64];
+	int cpus[64];
+	SVCXPRT *xprt;
+	AUTH *auth;
+	XDR xdrs;
+	uint32_t chan;
+	rpcproc_t proc = 0;
+	double elapsed;
+	unsigned int i;
+	int opt, sfd;
+
+	while ((opt = getopt(argc, argv, "b:l:t:w:s:")) != -1) {
+		switch (opt) {
+		case 'b':
+			svc_params.dg_recv_max = strtoul(optarg, NULL, 0);
+			break;
+		case 'l':
+			listeners = strtoul(optarg, NULL, 0);
+			break;
+		case 't':
+			threads = strtoul(optarg, NULL, 0);
+			break;
+		case 'w':
+			window = strtoul(optarg, NULL, 0);
+			break;
+		case 's':
+			secs = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-b dg_recv_max]"
+				" [-l listeners] [-t threads] [-w window]"
+				" [-s secs]\n", argv[0]);
+			return 1;
+		}
+	}
+	if (!threads || threads > 256 || !window || !secs
+	 || !listeners || listeners > 64) {
+		fprintf(stderr, "bad arguments\n");
+		return 1;
+	}
+
+	if (!svc_init(&svc_params)) {
+		fprintf(stderr, "svc_init failed\n");
+		return 1;
+	}
+
+	memset(&sin, 0, sizeof(sin));
+	sin.sin_family = AF_INET;
+	sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (listeners > 1) {
+		struct svc_reuseport rp = {
+			.addr = (struct sockaddr *)&sin,
+			.addrlen = sizeof(sin),
+			.type = SOCK_DGRAM,
+			.count = listeners,
+			.cpus = cpus,
+			.rendezvous_cb = bench_rendezvous,
+		};
+		long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+		for (i = 0; i < listeners; i++)
+			cpus[i] = ncpus > 0 ? i % ncpus : -1;
+		if (svc_reuseport_ncreate(&rp, xprts) != listeners
+		 || getsockname(xprts[0]->xp_fd,
+				(struct sockaddr *)&server_sin, &slen) < 0) {
+			fprintf(stderr, "svc_reuseport_ncreate failed\n");
+			return 1;
+		}
+	} else {
+		svc_rqst_new_evchan(&chan, NULL, SVC_RQST_FLAG_CHAN_AFFINITY);
+		sfd = socket(AF_INET, SOCK_DGRAM, 0);
+		if (sfd < 0
+		 || bind(sfd, (struct sockaddr *)&sin, sizeof(sin)) < 0
+		 || getsockname(sfd, (struct sockaddr *)&server_sin,
+				&slen) < 0) {
+			perror("bind");
+			return 1;
+		}
+		xprt = svc_dg_ncreatef(sfd, 0, 0, SVC_CREATE_FLAG_CLOSE
+						| SVC_CREATE_FLAG_XPRT_NOREG);
+		xprt->xp_dispatch.rendezvous_cb = bench_rendezvous;
+		svc_rqst_evchan_reg(chan, xprt, SVC_RQST_FLAG_CHAN_AFFINITY);
+	}
+
+	/* one NULL call, sent as is (replies are only counted) */
+	auth = authnone_ncreate();
+	memset(&call_msg, 0, sizeof(call_msg));
+	call_msg.rm_xid = 1;
+	call_msg.cb_prog = BENCH_PROG;
+	call_msg.cb_vers = BENCH_VERS;
+	xdrmem_create(&xdrs, call_buf, sizeof(call_buf), XDR_ENCODE);
+	if (!xdr_callhdr(&xdrs, &call_msg)
+	 || !XDR_PUTINT32(&xdrs, (int32_t *)&proc)
+	 || !AUTH_MARSHALL(auth, &xdrs)) {
+		fprintf(stderr, "call encode failed\n");
+		return 1;
+	}
+	call_len = XDR_GETPOS(&xdrs);
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (i = 0; i < threads; i++)
+		pthread_create(&thr[i], NULL, bench_client, NULL);
+	sleep(secs);
+	running = 0;
+	for (i = 0; i < threads; i++)
+		pthread_join(thr[i], NULL);
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	elapsed = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+
+	printf("dg_recv_max %u, %u listeners, %u threads x window %u: %" PRIu64
+	       " replies in %.2fs, %.0f packets/s (%" PRIu64 " refills)\n",
+	       svc_params.dg_recv_max ? svc_params.dg_recv_max : 1, listeners,
+	       threads, window, replies, elapsed, replies / elapsed, resends);
+
+	AUTH_DESTROY(auth);
+	svc_shutdown(SVC_SHUTDOWN_FLAG_NONE);
+	return 0;
+}
@@ -0,0 +1,116 @@
+/*
+ * Nanoseconds per element to encode and decode counted arrays of
+ * uint32_t and uint64_t on an xdrmem stream, by xdr_array() with the
+ * xdr_uint32_t / xdr_uint64_t element procedures against the bulk
+ * xdr_array_u32() / xdr_array_u64(), for a range of element counts.
+ * Each decode is checked against the encoded array.
+ *
+ *	xdr_array_bench [-r rounds]
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include <rpc/rpc.h>
+#include <rpc/xdr.h>
+
+#define MAX_ELEM 4096
+
+static const u_int counts[] = { 1, 2, 4, 8, 16, 64, 256, 1024, MAX_ELEM };
+static unsigned int rounds = 2000000;
+static char buf[BYTES_PER_XDR_UNIT + MAX_ELEM * sizeof(uint64_t)];
+
+static double
+now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* w is 4 or 8, bulk selects the new routines */
+static double
+run(void *in, void *out, u_int n, u_int w, bool bulk)
+{
+	unsigned int iter = rounds / n + 1;
+	xdrproc_t proc = (w == 4) ? (xdrproc_t) xdr_uint32_t
+				  : (xdrproc_t) xdr_uint64_t;
+	double t0, t1;
+	unsigned int i;
+	XDR xdrs;
+	u_int c;
+	bool ok;
+
+	t0 = now();
+	for (i = 0; i < iter; i++) {
+		void *p = in;
+		void *q = out;
+
+		c = n;
+		xdrmem_create(&xdrs, buf, sizeof(buf), XDR_ENCODE);
+		ok = !bulk ? xdr_array(&xdrs, (char **)&p, &c, MAX_ELEM, w,
+				       proc)
+		   : (w == 4) ? xdr_array_u32(&xdrs, (uint32_t **)&p, &c,
+					      MAX_ELEM)
+		   : xdr_array_u64(&xdrs, (uint64_t **)&p, &c, MAX_ELEM);
+		xdrmem_create(&xdrs, buf, sizeof(buf), XDR_DECODE);
+		ok = ok && (!bulk ? xdr_array(&xdrs, (char **)&q, &c,
+					      MAX_ELEM, w, proc)
+			    : (w == 4) ? xdr_array_u32(&xdrs,
+						       (uint32_t **)&q, &c,
+						       MAX_ELEM)
+			    : xdr_array_u64(&xdrs, (uint64_t **)&q, &c,
+					    MAX_ELEM));
+		if (!ok || c != n || memcmp(in, out, n * w)) {
+			fprintf(stderr, "%s u%u x %u: round trip failed\n",
+				bulk ? "bulk" : "xdr_array", w * 8, n);
+			exit(1);
+		}
+	}
+	t1 = now();
+	return (t1 - t0) / ((double)iter * n);
+}
+
+int
+main(int argc, char **argv)
+{
+	static uint64_t in[MAX_ELEM], out[MAX_ELEM];
+	double per, bulk;
+	unsigned int i, w;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "r:")) != -1) {
+		switch (opt) {
+		case 'r':
+			rounds = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-r rounds]\n", argv[0]);
+			return 1;
+		}
+	}
+	if (!rounds) {
+		fprintf(stderr, "bad arguments\n");
+		return 1;
+	}
+
+	for (i = 0; i < MAX_ELEM; i++)
+		in[i] = ((uint64_t)random() << 32) | random();
+
+	printf("%-4s %6s %14s %14s %8s\n", "type", "count",
+	       "xdr_array ns", "bulk ns", "speedup");
+	for (w = 4; w <= 8; w += 4) {
+		for (i = 0; i < sizeof(counts) / sizeof(counts[0]); i++) {
+			per = run(in, out, counts[i], w, false);
+			bulk = run(in, out, counts[i], w, true);
+			printf("u%-3u %6u %14.2f %14.2f %7.1fx\n", w * 8,
+			       counts[i], per, bulk, per / bulk);
+		}
+	}
+	return 0;
+}